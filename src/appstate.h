@@ -14,4 +14,5 @@ typedef struct fln_app_state {
 	lua_State *L;
 	SDL_Window *window;
 	SDL_GLContext ogl_context;
+	bool render_thread; // --render-thread：在单独的线程上回放绘制命令
 } fln_app_state;
@@ -0,0 +1,415 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "bytecode.h"
+
+#include <SDL3/SDL_filesystem.h>
+#include <lauxlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode_format.h"
+#include "job.h"
+#include "mapped_file.h"
+#include "memory.h"
+#include "profiler.h"
+
+static char *cache_dir = nullptr; // 以分隔符结尾，nullptr 表示不使用缓存
+static fln_mapped_file archive;
+static bool has_archive = false;
+
+typedef struct prefetch_request {
+	char path[1024];
+	fln_job *job;
+	const char *bytecode; // 失败时为 nullptr
+	size_t size;
+	char *cached; // 来自缓存文件，SDL_free 释放
+	char *dumped; // 新编译的，fln_free 释放
+} prefetch_request;
+
+static prefetch_request *prefetch = nullptr;
+
+// FNV-1a，以 Lua 版本作为初始值的一部分，不同版本的缓存不会互相覆盖
+#define HASH_SEED (0xcbf29ce484222325ull ^ LUA_VERSION_RELEASE_NUM)
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+	const unsigned char *p = data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static int compare_entry(const void *key, const void *element) {
+	return strcmp(key, ((const fln_bytecode_archive_entry *)element)->name);
+}
+
+static const fln_bytecode_archive_entry *find_entry(const char *name) {
+	if (!has_archive) {
+		return nullptr;
+	}
+	const fln_bytecode_archive_header *header = archive.data;
+	return bsearch(name, fln_bytecode_archive_entries(archive.data), header->entries_count, sizeof(fln_bytecode_archive_entry), compare_entry);
+}
+
+static int load_bytecode(lua_State *L, const char *path, const char *data, size_t size) {
+	lua_pushfstring(L, "@%s", path);
+	int status = luaL_loadbufferx(L, data, size, lua_tostring(L, -1), "b");
+	lua_remove(L, -2);
+	return status;
+}
+
+static int load_entry(lua_State *L, const fln_bytecode_archive_entry *entry) {
+	return load_bytecode(L, entry->name, (const char *)archive.data + entry->offset, entry->size);
+}
+
+// 归档中的路径不带 "./" 前缀
+static const char *archive_name(const char *path) {
+	while (path[0] == '.' && (path[1] == '/' || path[1] == '\\')) {
+		path += 2;
+	}
+	return path;
+}
+
+typedef struct dump_buffer {
+	char *data;
+	size_t size;
+	size_t capacity;
+} dump_buffer;
+
+static int dump_writer(lua_State *L, const void *p, size_t size, void *ud) {
+	dump_buffer *buffer = ud;
+	if (buffer->size + size > buffer->capacity) {
+		size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+		while (capacity < buffer->size + size) {
+			capacity *= 2;
+		}
+		char *data = fln_realloc(buffer->data, capacity);
+		if (!data) {
+			return 1;
+		}
+		buffer->data = data;
+		buffer->capacity = capacity;
+	}
+	memcpy(buffer->data + buffer->size, p, size);
+	buffer->size += size;
+	return 0;
+}
+
+// 把栈顶已编译的函数写入缓存，先写临时文件再改名，失败时只是下次重新编译
+// 缓存默认开启，保留调试信息，错误信息中的文件名和行号与直接加载源码一致
+static void write_cache(lua_State *L, const char *cache_path, uint64_t hash, size_t source_size) {
+	fln_bytecode_cache_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FLN_BYTECODE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = FLN_BYTECODE_CACHE_VERSION;
+	header.lua_version = LUA_VERSION_RELEASE_NUM;
+	header.source_hash = hash;
+	header.source_size = source_size;
+
+	dump_buffer buffer = { nullptr, 0, 0 };
+	if (dump_writer(L, &header, sizeof(header), &buffer) == 0 && lua_dump(L, dump_writer, &buffer, 0) == 0) {
+		char temp_path[1024];
+		snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache_path);
+		if (!SDL_SaveFile(temp_path, buffer.data, buffer.size) || !SDL_RenamePath(temp_path, cache_path)) {
+			SDL_RemovePath(temp_path);
+		}
+	}
+	fln_free(buffer.data);
+}
+
+// 计算源码的哈希和对应的缓存文件路径，源码无法读取时返回 false
+// 字节码中保存了 chunkname，加载时传入的名字会被忽略，所以路径（即 luaL_loadfile 使用的 "@path"）也是键的一部分，
+// 内容相同的两个文件、或者经过不同路径找到的同一个文件各自缓存，错误信息中的文件名与直接加载源码一致
+static bool cache_key(const char *path, char *cache_path, size_t cache_path_size, uint64_t *hash, size_t *source_size) {
+	void *source = SDL_LoadFile(path, source_size);
+	if (!source) {
+		return false;
+	}
+	*hash = hash_bytes(HASH_SEED, source, *source_size);
+	*hash = hash_bytes(*hash, path, strlen(path) + 1);
+	SDL_free(source);
+	snprintf(cache_path, cache_path_size, "%s%016llx.luac", cache_dir, (unsigned long long)*hash);
+	return true;
+}
+
+// 命中时返回整个缓存文件（用 SDL_free 释放），字节码从 header 之后开始
+static char *read_cache(const char *cache_path, uint64_t hash, size_t source_size, size_t *size) {
+	char *cached = SDL_LoadFile(cache_path, size);
+	if (!cached) {
+		return nullptr;
+	}
+	const fln_bytecode_cache_header *header = (const fln_bytecode_cache_header *)cached;
+	bool valid = *size > sizeof(*header)
+			&& memcmp(header->magic, FLN_BYTECODE_CACHE_MAGIC, sizeof(header->magic)) == 0
+			&& header->version == FLN_BYTECODE_CACHE_VERSION
+			&& header->lua_version == LUA_VERSION_RELEASE_NUM
+			&& header->source_hash == hash
+			&& header->source_size == source_size;
+	if (!valid) {
+		SDL_free(cached);
+		return nullptr;
+	}
+	return cached;
+}
+
+// 与 luaL_loadfile 相同，命中缓存时跳过词法和语法分析
+static int load_cached(lua_State *L, const char *path) {
+	char cache_path[1024];
+	uint64_t hash;
+	size_t source_size;
+	if (!cache_dir || !cache_key(path, cache_path, sizeof(cache_path), &hash, &source_size)) {
+		// 源码读取失败时交给 luaL_loadfile 生成错误信息
+		return luaL_loadfile(L, path);
+	}
+	size_t cached_size;
+	char *cached = read_cache(cache_path, hash, source_size, &cached_size);
+	if (cached) {
+		size_t offset = sizeof(fln_bytecode_cache_header);
+		int status = load_bytecode(L, path, cached + offset, cached_size - offset);
+		SDL_free(cached);
+		if (status == LUA_OK) {
+			return LUA_OK;
+		}
+		// 缓存损坏时重新编译并覆盖
+		lua_pop(L, 1);
+	}
+	int status = luaL_loadfile(L, path);
+	if (status == LUA_OK) {
+		write_cache(L, cache_path, hash, source_size);
+	}
+	return status;
+}
+
+static int load(lua_State *L, const char *path) {
+	const fln_bytecode_archive_entry *entry = find_entry(archive_name(path));
+	if (entry) {
+		return load_entry(L, entry);
+	}
+	return load_cached(L, path);
+}
+
+// 在归档中依次查找 name.lua 和 name/init.lua
+static const fln_bytecode_archive_entry *find_module(const char *name) {
+	char path[FLN_BYTECODE_NAME_SIZE];
+	const char *suffixes[] = { ".lua", "/init.lua" };
+	for (int i = 0; i < 2; i++) {
+		int len = snprintf(path, sizeof(path), "%s%s", name, suffixes[i]);
+		if (len < 0 || len >= (int)sizeof(path)) {
+			return nullptr;
+		}
+		for (char *p = path + len - strlen(suffixes[i]) - 1; p >= path; p--) {
+			if (*p == '.') {
+				*p = '/';
+			}
+		}
+		const fln_bytecode_archive_entry *entry = find_entry(path);
+		if (entry) {
+			return entry;
+		}
+	}
+	return nullptr;
+}
+
+// 替换 package.searchers 中的 Lua 文件搜索器
+static int l_searcher(lua_State *L) {
+	const char *name = luaL_checkstring(L, 1);
+	const fln_bytecode_archive_entry *entry = find_module(name);
+	if (entry) {
+		if (load_entry(L, entry) != LUA_OK) {
+			return luaL_error(L, "error loading module '%s' from archive:\n\t%s", name, lua_tostring(L, -1));
+		}
+		lua_pushstring(L, entry->name);
+		return 2;
+	}
+
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchpath");
+	lua_pushvalue(L, 1);
+	lua_getfield(L, -3, "path");
+	lua_call(L, 2, 2);
+	if (lua_isnil(L, -2)) {
+		// 返回 searchpath 给出的错误信息
+		return 1;
+	}
+	const char *filename = lua_tostring(L, -2);
+	if (load_cached(L, filename) != LUA_OK) {
+		return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, filename, lua_tostring(L, -1));
+	}
+	lua_pushstring(L, filename);
+	return 2;
+}
+
+static bool open_archive(const char *path) {
+	if (!fln_map_file(&archive, path)) {
+		printf("failed to open script archive '%s'\n", path);
+		return false;
+	}
+	const char *err = fln_bytecode_archive_validate(archive.data, archive.size);
+	if (err) {
+		printf("invalid script archive '%s': %s\n", path, err);
+		fln_unmap_file(&archive);
+		return false;
+	}
+	const fln_bytecode_archive_header *header = archive.data;
+	if (header->lua_version != LUA_VERSION_RELEASE_NUM) {
+		printf("script archive '%s' was built for Lua %u, expected %d\n", path, header->lua_version, LUA_VERSION_RELEASE_NUM);
+		fln_unmap_file(&archive);
+		return false;
+	}
+	has_archive = true;
+	return true;
+}
+
+static void open_cache(const char *dir) {
+	char *pref = nullptr;
+	if (!dir) {
+		pref = SDL_GetPrefPath("flandre", "flandre");
+		if (!pref) {
+			printf("bytecode cache disabled: %s\n", SDL_GetError());
+			return;
+		}
+		dir = pref;
+	}
+	size_t len = strlen(dir);
+	bool has_separator = len > 0 && (dir[len - 1] == '/' || dir[len - 1] == '\\');
+	const char *subdir = pref ? "bytecode/" : "";
+	size_t size = len + 1 + strlen(subdir) + 1;
+	cache_dir = fln_alloc(size);
+	if (cache_dir) {
+		snprintf(cache_dir, size, "%s%s%s", dir, has_separator ? "" : "/", subdir);
+		if (!SDL_CreateDirectory(cache_dir)) {
+			printf("bytecode cache disabled: cannot create '%s'\n", cache_dir);
+			fln_free(cache_dir);
+			cache_dir = nullptr;
+		}
+	}
+	SDL_free(pref);
+}
+
+bool fln_bytecode_init(lua_State *L, const char *dir, const char *archive_path) {
+	if (archive_path && !open_archive(archive_path)) {
+		return false;
+	}
+	if (!dir || strcmp(dir, "off") != 0) {
+		open_cache(dir);
+	}
+	if (!has_archive && !cache_dir) {
+		return true;
+	}
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchers");
+	lua_pushcfunction(L, l_searcher);
+	lua_rawseti(L, -2, 2);
+	lua_pop(L, 2);
+	return true;
+}
+
+// 在工作线程上读取缓存或者在独立的 lua_State 中编译，结果以字节码的形式交给主线程
+static void prefetch_work(void *userdata) {
+	prefetch_request *request = userdata;
+	FLN_ZONE_BEGIN("prefetch script");
+	char cache_path[1024];
+	uint64_t hash;
+	size_t source_size;
+	bool has_key = cache_dir && cache_key(request->path, cache_path, sizeof(cache_path), &hash, &source_size);
+	if (has_key) {
+		size_t cached_size;
+		char *cached = read_cache(cache_path, hash, source_size, &cached_size);
+		if (cached) {
+			request->cached = cached;
+			request->bytecode = cached + sizeof(fln_bytecode_cache_header);
+			request->size = cached_size - sizeof(fln_bytecode_cache_header);
+			FLN_ZONE_END();
+			return;
+		}
+	}
+	lua_State *L = luaL_newstate();
+	if (L && luaL_loadfile(L, request->path) == LUA_OK) {
+		if (has_key) {
+			write_cache(L, cache_path, hash, source_size);
+		}
+		// 与缓存一样保留调试信息，错误信息中有文件名和行号
+		dump_buffer buffer = { nullptr, 0, 0 };
+		if (lua_dump(L, dump_writer, &buffer, 0) == 0) {
+			request->dumped = buffer.data;
+			request->bytecode = buffer.data;
+			request->size = buffer.size;
+		} else {
+			fln_free(buffer.data);
+		}
+	}
+	if (L) {
+		lua_close(L);
+	}
+	FLN_ZONE_END();
+}
+
+static void free_prefetch(void) {
+	if (prefetch->job) {
+		fln_job_wait(prefetch->job);
+	}
+	SDL_free(prefetch->cached);
+	fln_free(prefetch->dumped);
+	fln_free(prefetch);
+	prefetch = nullptr;
+}
+
+void fln_bytecode_prefetch(const char *path) {
+	if (prefetch || find_entry(archive_name(path)) || strlen(path) >= sizeof(prefetch->path)) {
+		return;
+	}
+	prefetch = fln_calloc(1, sizeof(prefetch_request));
+	if (!prefetch) {
+		return;
+	}
+	strcpy(prefetch->path, path);
+	prefetch->job = fln_job_submit(prefetch_work, nullptr, prefetch);
+	if (!prefetch->job) {
+		fln_free(prefetch);
+		prefetch = nullptr;
+	}
+}
+
+int fln_bytecode_dofile(lua_State *L, const char *path) {
+	int status = -1;
+	if (prefetch && strcmp(prefetch->path, path) == 0) {
+		FLN_ZONE_BEGIN("wait prefetch");
+		fln_job_wait(prefetch->job);
+		FLN_ZONE_END();
+		prefetch->job = nullptr;
+		if (prefetch->bytecode) {
+			status = load_bytecode(L, path, prefetch->bytecode, prefetch->size);
+			if (status != LUA_OK) {
+				lua_pop(L, 1);
+			}
+		}
+		free_prefetch();
+	}
+	// 没有预先编译或者失败时（例如语法错误）重新加载，得到正常的错误信息
+	if (status != LUA_OK) {
+		status = load(L, path);
+	}
+	if (status == LUA_OK) {
+		status = lua_pcall(L, 0, LUA_MULTRET, 0);
+	}
+	return status;
+}
+
+void fln_bytecode_quit(void) {
+	if (prefetch) {
+		free_prefetch();
+	}
+	if (has_archive) {
+		fln_unmap_file(&archive);
+		has_archive = false;
+	}
+	fln_free(cache_dir);
+	cache_dir = nullptr;
+}
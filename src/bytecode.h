@@ -0,0 +1,29 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <lua.h>
+
+// 脚本加载：
+// 1. archive_path 不为空时先在预编译归档（flandre-luac 生成）中查找
+// 2. 否则读取源码，以源码内容、路径和 Lua 版本的哈希为键在 cache_dir 中查找字节码（保留调试信息），没有则编译后写入
+// cache_dir 为 nullptr 时使用用户数据目录下的 bytecode/，为 "off" 时不使用缓存
+// 安装后 require 的 Lua 文件搜索器被替换，仍然按 package.path 查找源码
+
+// 在执行根脚本之前调用，归档无法打开时返回 false
+bool fln_bytecode_init(lua_State *L, const char *cache_dir, const char *archive_path);
+
+// 在工作线程上提前读取缓存或编译 path，与创建窗口、OpenGL 上下文等主线程上的初始化重叠
+// 之后对同一个 path 的 fln_bytecode_dofile 等待并直接加载结果；只用于根脚本
+void fln_bytecode_prefetch(const char *path);
+
+// 与 luaL_dofile 相同，经过归档和缓存加载
+int fln_bytecode_dofile(lua_State *L, const char *path);
+
+// 在 lua_close 之后调用，归档的映射要保留到所有脚本加载完毕
+void fln_bytecode_quit(void);
@@ -0,0 +1,83 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// 预编译脚本归档（.fla），由 flandre-luac 生成
+// 文件布局：header | entries（按 name 排序） | 字节码数据
+// name 是相对于脚本根目录、以 '/' 分隔的路径，例如 "root.lua"、"ui/init.lua"
+// 字节码只能被同样版本、同样字长的 Lua 加载，lua_version 不一致时整个归档被忽略
+
+#define FLN_BYTECODE_ARCHIVE_MAGIC "FLNLUAC"
+#define FLN_BYTECODE_ARCHIVE_VERSION 1
+#define FLN_BYTECODE_NAME_SIZE 128
+
+typedef struct fln_bytecode_archive_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t lua_version; // LUA_VERSION_RELEASE_NUM
+	uint32_t entries_count;
+	uint32_t reserved;
+} fln_bytecode_archive_header;
+
+typedef struct fln_bytecode_archive_entry {
+	char name[FLN_BYTECODE_NAME_SIZE];
+	uint64_t offset;
+	uint64_t size;
+} fln_bytecode_archive_entry;
+
+// 字节码缓存文件：header | 字节码
+#define FLN_BYTECODE_CACHE_MAGIC "FLNLUAB"
+#define FLN_BYTECODE_CACHE_VERSION 2 // 2：保留调试信息
+
+typedef struct fln_bytecode_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t lua_version;
+	uint64_t source_hash; // 源码内容与路径的哈希
+	uint64_t source_size;
+} fln_bytecode_cache_header;
+
+static inline const fln_bytecode_archive_entry *fln_bytecode_archive_entries(const void *data) {
+	return (const fln_bytecode_archive_entry *)((const char *)data + sizeof(fln_bytecode_archive_header));
+}
+
+// 检查 header 以及所有条目是否都落在文件范围内
+// 返回 nullptr 表示合法，否则返回错误描述
+static inline const char *fln_bytecode_archive_validate(const void *data, uint64_t size) {
+	if (size < sizeof(fln_bytecode_archive_header)) {
+		return "file too small";
+	}
+	const fln_bytecode_archive_header *header = data;
+	if (memcmp(header->magic, FLN_BYTECODE_ARCHIVE_MAGIC, sizeof(header->magic)) != 0) {
+		return "bad magic";
+	}
+	if (header->version != FLN_BYTECODE_ARCHIVE_VERSION) {
+		return "unsupported version";
+	}
+	uint64_t table_size = (uint64_t)header->entries_count * sizeof(fln_bytecode_archive_entry);
+	if (table_size > size - sizeof(fln_bytecode_archive_header)) {
+		return "entries out of range";
+	}
+	const fln_bytecode_archive_entry *entries = fln_bytecode_archive_entries(data);
+	for (uint32_t i = 0; i < header->entries_count; i++) {
+		const fln_bytecode_archive_entry *entry = &entries[i];
+		if (memchr(entry->name, '\0', sizeof(entry->name)) == nullptr) {
+			return "invalid entry name";
+		}
+		if (i > 0 && strcmp(entries[i - 1].name, entry->name) >= 0) {
+			return "entries are not sorted";
+		}
+		if (entry->offset > size || entry->size > size - entry->offset) {
+			return "bytecode out of range";
+		}
+	}
+	return nullptr;
+}
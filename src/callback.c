@@ -1,11 +1,25 @@
 #include "callback.h"
+#include <SDL3/SDL_timer.h>
 #include <lauxlib.h>
 #include <lua.h>
 
+#include "error.h"
+#include "keyboard.h"
+#include "timer.h"
+
 static int KEY_ITERATE_FUNC = 0x0d000721;
 static int KEY_DRAW_FUNC = 0x9961;
 static int KEY_EXIT_FUNC = 0x45451919;
-//static int KEY_EVENT_FUNC = 0x0004545;
+static int KEY_EVENT_FUNC = 0x0004545;
+static int KEY_EVENT_ARRAY = 0;
+
+// 固定步长：iterate 以 tick_rate 运行，每帧最多追赶 max_steps 次，draw 收到插值系数
+// tick_rate 为 0 时每帧调用一次 iterate，参数为这一帧的时长
+static double tick_rate = 0.0;
+static int max_steps = 5;
+static uint64_t last_time = 0; // 上一次 fln_iterate 的时间（纳秒）
+static double accumulator = 0.0; // 还没模拟的时间（秒）
+static double alpha = 1.0;
 
 static int l_placeholder(lua_State *L) {
 	return 0;
@@ -32,31 +46,143 @@ static int l_exit(lua_State *L) {
 	return 0;
 }
 
-/*
+// callback.tick_rate(hz, max_steps)，hz 为 0 时关闭固定步长
+// 键盘的 just_pressed/just_released 以及动作的边沿由 iterate 消费：一帧内没有 iterate 时留到之后的帧，
+// 多次 iterate 时只有第一次能看到；iterate 消费过的边沿在同一帧的 draw 中也不再可见
+static int l_tick_rate(lua_State *L) {
+	double hz = luaL_checknumber(L, 1);
+	lua_Integer steps = luaL_optinteger(L, 2, max_steps);
+	if (hz < 0.0) {
+		return fln_error(L, "invalid tick rate: %f", hz);
+	}
+	if (steps < 1) {
+		return fln_error(L, "invalid max steps: %d", (int)steps);
+	}
+	tick_rate = hz;
+	max_steps = (int)steps;
+	accumulator = 0.0;
+	alpha = 1.0;
+	return 0;
+}
+
+// 传入 nil 取消回调
 static int l_event(lua_State *L) {
 	lua_settop(L, 1);
-	luaL_checktype(L, 1, LUA_TFUNCTION);
+	if (!lua_isnil(L, 1)) {
+		luaL_checktype(L, 1, LUA_TFUNCTION);
+	}
 	lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_EVENT_FUNC);
 	return 0;
 }
-*/
 
-void fln_iterate(lua_State *L) {
+static void call_iterate(lua_State *L, double dt) {
 	lua_rawgetp(L, LUA_REGISTRYINDEX, &KEY_ITERATE_FUNC);
-	if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+	lua_pushnumber(L, dt);
+	if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
 		printf("(in iterate callback) lua: %s\n", lua_tostring(L, -1));
 		lua_pushcfunction(L, l_placeholder);
 		lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_ITERATE_FUNC);
 	}
+	fln_timer_end_script_zones();
+	fln_keyboard_consume_edges();
+}
+
+void fln_iterate(lua_State *L) {
+	uint64_t now = fln_timer_now_ns();
+	double frame_dt = last_time ? (double)(now - last_time) / 1e9 : 0.0;
+	last_time = now;
+	if (tick_rate <= 0.0) {
+		call_iterate(L, frame_dt);
+		return;
+	}
+	double step = 1.0 / tick_rate;
+	if (frame_dt == 0.0) {
+		frame_dt = step; // 第一帧也模拟一次
+	}
+	// 卡顿（拖动窗口、断点）之后不要一口气补上所有时间
+	accumulator += frame_dt < step * max_steps ? frame_dt : step * max_steps;
+	int steps = 0;
+	while (accumulator >= step && steps < max_steps) {
+		call_iterate(L, step);
+		accumulator -= step;
+		steps++;
+	}
+	// 达到上限仍然落后时丢弃积压，模拟变慢而不是越积越多
+	if (accumulator >= step) {
+		accumulator = SDL_fmod(accumulator, step);
+	}
+	alpha = accumulator / step;
 }
 
 void fln_draw(lua_State *L) {
 	lua_rawgetp(L, LUA_REGISTRYINDEX, &KEY_DRAW_FUNC);
-	if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+	lua_pushnumber(L, alpha);
+	if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
 		printf("(in draw callback) lua: %s\n", lua_tostring(L, -1));
 		lua_pushcfunction(L, l_placeholder);
 		lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_DRAW_FUNC);
 	}
+	fln_timer_end_script_zones();
+}
+
+static const char *event_type_names[FLN_EVENT_TYPE_COUNT] = {
+	[FLN_EVENT_KEY_DOWN] = "key_down",
+	[FLN_EVENT_KEY_UP] = "key_up",
+	[FLN_EVENT_MOUSE_DOWN] = "mouse_down",
+	[FLN_EVENT_MOUSE_UP] = "mouse_up",
+	[FLN_EVENT_MOUSE_MOTION] = "mouse_motion",
+	[FLN_EVENT_MOUSE_WHEEL] = "mouse_wheel",
+	[FLN_EVENT_WINDOW_RESIZED] = "window_resized",
+	[FLN_EVENT_FOCUS_GAINED] = "focus_gained",
+	[FLN_EVENT_FOCUS_LOST] = "focus_lost",
+};
+
+void fln_deliver_events(lua_State *L, const fln_event_record *records, size_t count) {
+	if (count == 0) {
+		return;
+	}
+	if (lua_rawgetp(L, LUA_REGISTRYINDEX, &KEY_EVENT_FUNC) != LUA_TFUNCTION) {
+		lua_pop(L, 1);
+		return;
+	}
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &KEY_EVENT_ARRAY);
+	// 记录的表只在数组变长时创建，之后每帧覆盖所有字段
+	for (size_t i = 0; i < count; i++) {
+		const fln_event_record *record = &records[i];
+		if (lua_rawgeti(L, -1, (lua_Integer)i + 1) != LUA_TTABLE) {
+			lua_pop(L, 1);
+			lua_createtable(L, 0, 9);
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, -3, (lua_Integer)i + 1);
+		}
+		lua_pushstring(L, event_type_names[record->type]);
+		lua_setfield(L, -2, "type");
+		lua_pushinteger(L, record->code);
+		lua_setfield(L, -2, "code");
+		lua_pushnumber(L, record->x);
+		lua_setfield(L, -2, "x");
+		lua_pushnumber(L, record->y);
+		lua_setfield(L, -2, "y");
+		lua_pushnumber(L, record->dx);
+		lua_setfield(L, -2, "dx");
+		lua_pushnumber(L, record->dy);
+		lua_setfield(L, -2, "dy");
+		lua_pushinteger(L, record->mod);
+		lua_setfield(L, -2, "mod");
+		lua_pushboolean(L, record->repeat);
+		lua_setfield(L, -2, "repeat");
+		lua_pushinteger(L, (lua_Integer)record->timestamp);
+		lua_setfield(L, -2, "timestamp");
+		lua_pop(L, 1);
+	}
+	lua_pushinteger(L, (lua_Integer)count);
+	if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+		printf("(in event callback) lua: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		lua_pushnil(L);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_EVENT_FUNC);
+	}
+	fln_timer_end_script_zones();
 }
 
 void fln_exit(lua_State *L) {
@@ -66,19 +192,27 @@ void fln_exit(lua_State *L) {
 		lua_pushcfunction(L, l_placeholder);
 		lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_EXIT_FUNC);
 	}
+	fln_timer_end_script_zones();
 }
 
-int fln_luaopen_callback(lua_State *L) {
+void fln_callback_init(lua_State *L) {
     lua_pushcfunction(L, l_placeholder);
     lua_pushvalue(L, -1);
 	lua_pushvalue(L, -1);
     lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_ITERATE_FUNC);
     lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_DRAW_FUNC);
 	lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_EXIT_FUNC);
+	lua_newtable(L);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_EVENT_ARRAY);
+}
+
+int fln_luaopen_callback(lua_State *L) {
 	const luaL_Reg funcs[] = {
 		{ "iterate", l_iterate },
 		{ "draw", l_draw },
 		{"exit", l_exit},
+		{ "tick_rate", l_tick_rate },
+		{ "event", l_event },
 		{ nullptr, nullptr }
 	};
 	luaL_newlib(L, funcs);
@@ -10,10 +10,21 @@
 #include <SDL3/SDL_events.h>
 #include <lua.h>
 
+#include "event.h"
+
+// 每帧调用一次；固定步长模式下会调用 iterate 回调 0 到 max_steps 次
 void fln_iterate(lua_State *);
 
+// draw 回调的参数为插值系数 alpha：上一次 iterate 之后经过的时间占一个步长的比例，未开启固定步长时为 1
 void fln_draw(lua_State *);
 
 void fln_exit(lua_State *L);
 
+// 把这一帧的事件一次性交给 event 回调：event(events, n)，events 是每帧复用的数组，只有前 n 项有效
+// 每一项都是 { type, code, x, y, dx, dy, mod, repeat, timestamp }，回调之后不要保留它们
+void fln_deliver_events(lua_State *L, const fln_event_record *records, size_t count);
+
+// 设置默认的（空）回调，主循环依赖它们，不能等到脚本第一次访问 callback 模块
+void fln_callback_init(lua_State *L);
+
 int fln_luaopen_callback(lua_State *);
\ No newline at end of file
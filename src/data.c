@@ -8,77 +8,156 @@
 #include "data.h"
 
 #include "error.h"
+#include "image_codec.h"
+#include "image_ops.h"
+#include "job.h"
 #include "memory.h"
-#include <freetype2/freetype/freetype.h>
+#include "text.h"
 #include <lauxlib.h>
 #include <lua.h>
 
-#include <png.h>
-#include <pngconf.h>
+// 解码结果放入新的 fln.image userdata
+static int push_image(lua_State *L, const fln_image *decoded) {
+	fln_image *image = lua_newuserdata(L, sizeof(fln_image));
+	luaL_setmetatable(L, FLN_USERTYPE_IMAGE);
+	*image = *decoded;
+	return 1;
+}
 
-static bool chack_png_error(png_image *context) {
-	const png_uint_32 failed = PNG_IMAGE_FAILED(*context);
-	if (failed & PNG_IMAGE_ERROR) {
-		return true;
-	}
-	else {
-		return false;
+static int decode_image(lua_State *L, bool (*decode)(const void *, size_t, fln_image *, const char **)) {
+	size_t size;
+	const char *data = luaL_checklstring(L, 1, &size);
+	fln_image decoded;
+	const char *err = nullptr;
+	if (!decode(data, size, &decoded, &err)) {
+		return fln_error(L, "%s", err);
 	}
+	return push_image(L, &decoded);
 }
 
 static int l_png(lua_State *L) {
-	const unsigned char *data = (const unsigned char *)luaL_checkstring(L, 1);
-	lua_len(L, 1);
-	size_t size = lua_tointeger(L, -1);
+	return decode_image(L, fln_image_decode_png);
+}
+
+static int l_qoi(lua_State *L) {
+	return decode_image(L, fln_image_decode_qoi);
+}
 
-	png_image context;
-	fln_image_format fmt;
+// 根据文件头自动识别 PNG / QOI / FLNI
+static int l_image(lua_State *L) {
+	return decode_image(L, fln_image_decode);
+}
 
-	context.version = PNG_IMAGE_VERSION;
-	context.opaque = nullptr;
+// 异步解码 --------------------------------------------------------------------
+
+typedef struct decode_task {
+	lua_State *L; // 主线程；虚拟机关闭后置空，done 只负责释放
+	int bytes_ref; // 保持输入字符串存活
+	int callback_ref;
+	const char *data;
+	size_t size;
+	fln_image image;
+	const char *err;
+	bool ok;
+	fln_job *job;
+	struct decode_task *prev;
+	struct decode_task *next;
+} decode_task;
+
+static decode_task *pending_tasks = nullptr;
+static int KEY_DECODE_SENTINEL = 0;
+
+static void decode_task_work(void *userdata) {
+	decode_task *task = userdata;
+	task->ok = fln_image_decode(task->data, task->size, &task->image, &task->err);
+}
+
+// 在 lua_pcall 中创建 image 并回调，内存错误和回调中的错误都不会逃出 fln_job_poll
+static int l_decode_task_deliver(lua_State *L) {
+	decode_task *task = lua_touserdata(L, 1);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, task->callback_ref);
+	if (task->ok) {
+		push_image(L, &task->image);
+		task->image.data = nullptr; // 所有权交给 Lua
+		lua_pushnil(L);
+	} else {
+		lua_pushnil(L);
+		lua_pushstring(L, task->err);
+	}
+	lua_call(L, 2, 0);
+	return 0;
+}
 
-	{
-		int res = png_image_begin_read_from_memory(&context, data, size);
-		if (chack_png_error(&context)) {
-			return fln_error(L, "PNG error: %s", context.message);
+static void decode_task_done(void *userdata) {
+	decode_task *task = userdata;
+	if (task->prev) {
+		task->prev->next = task->next;
+	} else {
+		pending_tasks = task->next;
+	}
+	if (task->next) {
+		task->next->prev = task->prev;
+	}
+	lua_State *L = task->L;
+	if (L) {
+		lua_pushcfunction(L, l_decode_task_deliver);
+		lua_pushlightuserdata(L, task);
+		if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+			printf("(in image_async callback) lua: %s\n", lua_tostring(L, -1));
+			lua_pop(L, 1);
 		}
+		luaL_unref(L, LUA_REGISTRYINDEX, task->callback_ref);
+		luaL_unref(L, LUA_REGISTRYINDEX, task->bytes_ref);
+	}
+	// 虚拟机已经关闭，或者创建 userdata 之前就失败了
+	if (task->ok) {
+		fln_free(task->image.data);
 	}
-	context.format &= ~(PNG_FORMAT_FLAG_BGR | PNG_FORMAT_FLAG_AFIRST | PNG_FORMAT_FLAG_LINEAR | PNG_FORMAT_FLAG_COLORMAP);
-	switch (context.format) {
-		case PNG_FORMAT_GRAY:
-			fmt = FLN_IMAGE_FORMAT_R8;
-			break;
-		case PNG_FORMAT_GA:
-			fmt = FLN_IMAGE_FORMAT_RG8;
-			break;
-		case PNG_FORMAT_RGB:
-			fmt = FLN_IMAGE_FORMAT_RGB8;
-			break;
-		case PNG_FORMAT_RGBA:
-			fmt = FLN_IMAGE_FORMAT_RGBA8;
-			break;
-		default:
-			png_image_free(&context);
-			return fln_error(L, "unsupported image format");
-	}
-	unsigned int stride = PNG_IMAGE_ROW_STRIDE(context);
-	unsigned char *img_data = fln_alloc(PNG_IMAGE_BUFFER_SIZE(context, stride));
-	if (img_data == nullptr) {
+	fln_free(task);
+}
+
+// 虚拟机关闭时，让还没完成的任务不再回调 Lua，并等它们结束（输入字符串马上就要被释放）
+static int l_decode_sentinel_gc(lua_State *L) {
+	for (decode_task *task = pending_tasks; task; task = task->next) {
+		task->L = nullptr;
+	}
+	while (pending_tasks) {
+		fln_job_wait(pending_tasks->job); // done 会把任务从链表中移除
+	}
+	return 0;
+}
+
+// data.image_async(bytes, function(image, err) end)
+static int l_image_async(lua_State *L) {
+	size_t size;
+	const char *data = luaL_checklstring(L, 1, &size);
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+	decode_task *task = fln_calloc(1, sizeof(decode_task));
+	if (!task) {
 		return fln_error(L, "bad alloc");
 	}
-	{
-		int res = png_image_finish_read(&context, nullptr, img_data, stride, nullptr);
-		if (chack_png_error(&context)) {
-			return fln_error(L, "PNG error: %s", context.message);
-		}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	task->L = lua_tothread(L, -1);
+	lua_pop(L, 1);
+	lua_pushvalue(L, 2);
+	task->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_pushvalue(L, 1);
+	task->bytes_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	task->data = data;
+	task->size = size;
+	task->job = fln_job_submit(decode_task_work, decode_task_done, task);
+	if (!task->job) {
+		luaL_unref(L, LUA_REGISTRYINDEX, task->callback_ref);
+		luaL_unref(L, LUA_REGISTRYINDEX, task->bytes_ref);
+		fln_free(task);
+		return fln_error(L, "failed to submit decode job");
 	}
-	fln_image *image = lua_newuserdata(L, sizeof(fln_image));
-	luaL_setmetatable(L, FLN_USERTYPE_IMAGE);
-	image->width = context.width;
-	image->height = context.height;
-	image->format = fmt;
-	image->data = img_data;
-	return 1;
+	task->next = pending_tasks;
+	if (pending_tasks) {
+		pending_tasks->prev = task;
+	}
+	pending_tasks = task;
+	return 0;
 }
 
 static int l_image_size(lua_State *L) {
@@ -90,6 +169,80 @@ static int l_image_size(lua_State *L) {
 	return 2;
 }
 
+static int l_image_format(lua_State *L) {
+	static const char *const names[] = { "r8", "rg8", "rgb8", "rgba8" };
+	fln_image *image = luaL_checkudata(L, 1, FLN_USERTYPE_IMAGE);
+	lua_pushstring(L, names[image->format]);
+	return 1;
+}
+
+static fln_image *check_image_data(lua_State *L) {
+	fln_image *image = luaL_checkudata(L, 1, FLN_USERTYPE_IMAGE);
+	if (!image->data) {
+		fln_error(L, "invalid image data");
+	}
+	return image;
+}
+
+static int l_image_premultiply(lua_State *L) {
+	fln_image *image = check_image_data(L);
+	if (!fln_image_premultiply(image)) {
+		return fln_error(L, "premultiply requires an rgba8 or rg8 image");
+	}
+	return 0;
+}
+
+static int l_image_swizzle(lua_State *L) {
+	fln_image *image = check_image_data(L);
+	const char *pattern = luaL_checkstring(L, 2);
+	if (!fln_image_swizzle(image, pattern)) {
+		return fln_error(L, "invalid swizzle '%s' (requires an rgba8 image and a pattern like \"bgra\")", pattern);
+	}
+	return 0;
+}
+
+static int l_image_flip(lua_State *L) {
+	fln_image *image = check_image_data(L);
+	if (!fln_image_flip(image)) {
+		return fln_error(L, "bad alloc");
+	}
+	return 0;
+}
+
+static int l_image_expand(lua_State *L) {
+	fln_image *image = check_image_data(L);
+	if (image->format == FLN_IMAGE_FORMAT_RGBA8) {
+		return 0;
+	}
+	if (!fln_image_expand_rgba(image)) {
+		return fln_error(L, "expand requires an rgb8 image");
+	}
+	return 0;
+}
+
+static int l_image_downscale(lua_State *L) {
+	fln_image *image = check_image_data(L);
+	if (!fln_image_downscale(image)) {
+		return fln_error(L, "image is too small to downscale: %dx%d", image->width, image->height);
+	}
+	return 0;
+}
+
+// image:encode("qoi" | "raw") -> string
+static int l_image_encode(lua_State *L) {
+	static const char *const formats[] = { "qoi", "raw", nullptr };
+	fln_image *image = check_image_data(L);
+	int format = luaL_checkoption(L, 2, "qoi", formats);
+	size_t size = 0;
+	void *bytes = format == 0 ? fln_image_encode_qoi(image, &size) : fln_image_encode_raw(image, &size);
+	if (!bytes) {
+		return fln_error(L, "failed to encode image as %s", formats[format]);
+	}
+	lua_pushlstring(L, bytes, size);
+	fln_free(bytes);
+	return 1;
+}
+
 static int l_image_release(lua_State *L) {
 	fln_image *image = luaL_checkudata(L, 1, FLN_USERTYPE_IMAGE);
 	if (image->data) {
@@ -99,33 +252,224 @@ static int l_image_release(lua_State *L) {
 	return 0;
 }
 
-static int l_font(lua_State *L) {
-	const unsigned char *data = (const unsigned char *)luaL_checkstring(L, 1);
-	lua_len(L, 1);
-	size_t size = lua_tointeger(L, -1);
-	FT_Library context;
-	FT_Face face;
-	FT_Error err;
-	err = FT_Init_FreeType(&context);
-	if (err != FT_Err_Ok) {
-		return luaL_error(L, "failed to initialize FreeType Library: %s", FT_Error_String(err));
-	}
-	err = FT_New_Memory_Face(context, data, size, 0, &face);
-	if (err != FT_Err_Ok) {
-		return luaL_error(L, "failed to load FreeType Face in memory: %s", FT_Error_String(err));
-	}
-	fln_font font;
-	
+static int l_model(lua_State *L) {
+	const char *path = luaL_checkstring(L, 1);
+	fln_model *model = lua_newuserdata(L, sizeof(fln_model));
+	model->header = nullptr;
+	if (!fln_map_file(&model->file, path)) {
+		return fln_error(L, "failed to map model file '%s'", path);
+	}
+	luaL_setmetatable(L, FLN_USERTYPE_MODEL);
+	const char *err = fln_mesh_blob_validate(model->file.data, model->file.size);
+	if (err) {
+		fln_unmap_file(&model->file);
+		return fln_error(L, "invalid model file '%s': %s", path, err);
+	}
+	model->header = model->file.data;
+	return 1;
+}
+
+static int l_model_counts(lua_State *L) {
+	fln_model *model = luaL_checkudata(L, 1, FLN_USERTYPE_MODEL);
+	if (model->header) {
+		lua_pushinteger(L, model->header->vertices_size / fln_mesh_blob_stride(model->header));
+		lua_pushinteger(L, model->header->indices_size / sizeof(uint32_t));
+		return 2;
+	}
 	return 0;
 }
 
+static int l_model_release(lua_State *L) {
+	fln_model *model = luaL_checkudata(L, 1, FLN_USERTYPE_MODEL);
+	if (model->header) {
+		fln_unmap_file(&model->file);
+		model->header = nullptr;
+	}
+	return 0;
+}
+
+// 未指定 preload 时预生成的字符：可打印 ASCII
+static size_t default_preload(uint32_t *codepoints) {
+	size_t count = 0;
+	for (uint32_t c = 0x20; c < 0x7F; c++) {
+		codepoints[count++] = c;
+	}
+	return count;
+}
+
+static int l_font(lua_State *L) {
+	/*
+	flandre.data.font(bytes, {
+		sdf = `bool`,  生成 SDF 字形（默认 false）
+		size = `integer`,  SDF 字形的基准大小（默认 48）
+		preload = `string`  在工作线程上预生成的字符（默认可打印 ASCII）
+	})
+	*/
+	size_t size;
+	const char *data = luaL_checklstring(L, 1, &size);
+	bool sdf = false;
+	lua_Integer sdf_size = 48;
+	const char *preload = nullptr;
+	size_t preload_size = 0;
+	if (lua_type(L, 2) == LUA_TTABLE) {
+		lua_getfield(L, 2, "sdf");
+		sdf = lua_toboolean(L, -1);
+		lua_getfield(L, 2, "size");
+		sdf_size = luaL_optinteger(L, -1, sdf_size);
+		lua_getfield(L, 2, "preload");
+		preload = luaL_optlstring(L, -1, nullptr, &preload_size);
+		lua_pop(L, 3);
+		if (sdf_size <= 0 || sdf_size > 256) {
+			return fln_error(L, "invalid SDF base size: %d", (int)sdf_size);
+		}
+	}
+
+	fln_font *font = lua_newuserdata(L, sizeof(fln_font));
+	const char *err = nullptr;
+	if (!fln_font_open(font, data, size, &err)) {
+		return fln_error(L, "failed to load font: %s", err);
+	}
+	luaL_setmetatable(L, FLN_USERTYPE_FONT);
+
+	if (sdf) {
+		uint32_t *codepoints = fln_alloc((preload ? preload_size : 0x7F - 0x20) * sizeof(uint32_t));
+		if (!codepoints) {
+			return fln_error(L, "bad alloc");
+		}
+		size_t count = 0;
+		if (preload) {
+			const char *cursor = preload;
+			while (cursor < preload + preload_size) {
+				codepoints[count++] = fln_utf8_next(&cursor, preload + preload_size);
+			}
+		} else {
+			count = default_preload(codepoints);
+		}
+		bool ok = fln_font_enable_sdf(font, sdf_size, codepoints, count);
+		fln_free(codepoints);
+		if (!ok) {
+			return fln_error(L, "failed to start SDF generation");
+		}
+	}
+	return 1;
+}
+
+static unsigned int check_font_size(lua_State *L, int arg) {
+	lua_Integer size = luaL_checkinteger(L, arg);
+	luaL_argcheck(L, size > 0 && size <= 1024, arg, "invalid font size");
+	return (unsigned int)size;
+}
+
+static int l_font_glyph(lua_State *L) {
+	fln_font *font = luaL_checkudata(L, 1, FLN_USERTYPE_FONT);
+	if (!font->face) {
+		return fln_error(L, "invalid font");
+	}
+	FT_ULong codepoint = luaL_checkinteger(L, 2);
+	unsigned int size = check_font_size(L, 3);
+	const fln_glyph *glyph = fln_font_glyph(font, FT_Get_Char_Index(font->face, codepoint), size);
+	if (!glyph) {
+		return fln_error(L, "failed to rasterize glyph U+%04X", (unsigned int)codepoint);
+	}
+	const fln_glyph_atlas *atlas = fln_font_atlas();
+	lua_Number scale = fln_font_scale(font, size);
+	lua_pushnumber(L, (lua_Number)glyph->x / atlas->width);
+	lua_pushnumber(L, (lua_Number)glyph->y / atlas->height);
+	lua_pushnumber(L, (lua_Number)(glyph->x + glyph->width) / atlas->width);
+	lua_pushnumber(L, (lua_Number)(glyph->y + glyph->height) / atlas->height);
+	lua_pushnumber(L, glyph->width * scale);
+	lua_pushnumber(L, glyph->height * scale);
+	lua_pushnumber(L, glyph->bearing_x * scale);
+	lua_pushnumber(L, glyph->bearing_y * scale);
+	lua_pushnumber(L, glyph->advance * scale);
+	return 9;
+}
+
+static int l_font_kerning(lua_State *L) {
+	fln_font *font = luaL_checkudata(L, 1, FLN_USERTYPE_FONT);
+	if (!font->face) {
+		return fln_error(L, "invalid font");
+	}
+	FT_ULong left = luaL_checkinteger(L, 2);
+	FT_ULong right = luaL_checkinteger(L, 3);
+	unsigned int size = check_font_size(L, 4);
+	FT_Vector kerning = { 0, 0 };
+	if (FT_HAS_KERNING(font->face) && fln_font_set_size(font, size)) {
+		FT_Get_Kerning(font->face, FT_Get_Char_Index(font->face, left), FT_Get_Char_Index(font->face, right), FT_KERNING_DEFAULT, &kerning);
+	}
+	lua_pushnumber(L, kerning.x / 64.0);
+	return 1;
+}
+
+static int l_font_metrics(lua_State *L) {
+	fln_font *font = luaL_checkudata(L, 1, FLN_USERTYPE_FONT);
+	if (!font->face) {
+		return fln_error(L, "invalid font");
+	}
+	unsigned int size = check_font_size(L, 2);
+	if (!fln_font_set_size(font, size)) {
+		return fln_error(L, "failed to set font size %d", size);
+	}
+	const FT_Size_Metrics *metrics = &font->face->size->metrics;
+	lua_pushnumber(L, metrics->ascender / 64.0);
+	lua_pushnumber(L, metrics->descender / 64.0);
+	lua_pushnumber(L, metrics->height / 64.0);
+	return 3;
+}
+
+// font:measure(text, size, max_width) -> width, height
+static int l_font_measure(lua_State *L) {
+	fln_font *font = luaL_checkudata(L, 1, FLN_USERTYPE_FONT);
+	if (!font->face) {
+		return fln_error(L, "invalid font");
+	}
+	size_t len;
+	const char *text = luaL_checklstring(L, 2, &len);
+	unsigned int size = check_font_size(L, 3);
+	float max_width = luaL_optnumber(L, 4, 0.0);
+	fln_text_layout layout;
+	if (!fln_text_layout_run(font, text, len, size, max_width, FLN_TEXT_ALIGN_LEFT, 1.0f, &layout)) {
+		return fln_error(L, "failed to lay out text");
+	}
+	lua_pushnumber(L, layout.width);
+	lua_pushnumber(L, layout.height);
+	return 2;
+}
+
+static int l_font_sdf(lua_State *L) {
+	fln_font *font = luaL_checkudata(L, 1, FLN_USERTYPE_FONT);
+	if (!font->sdf) {
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	lua_pushboolean(L, true);
+	lua_pushinteger(L, font->sdf_size);
+	lua_pushinteger(L, FLN_SDF_SPREAD);
+	return 3;
+}
+
+static int l_font_ready(lua_State *L) {
+	fln_font *font = luaL_checkudata(L, 1, FLN_USERTYPE_FONT);
+	lua_pushboolean(L, fln_font_ready(font));
+	return 1;
+}
+
 static int l_font_release(lua_State *L) {
+	fln_font *font = luaL_checkudata(L, 1, FLN_USERTYPE_FONT);
+	fln_font_close(font);
 	return 0;
 }
 
 int fln_luaopen_data(lua_State *L) {
 	const luaL_Reg image_meths[] = {
 		{ "size", l_image_size },
+		{ "format", l_image_format },
+		{ "premultiply", l_image_premultiply },
+		{ "swizzle", l_image_swizzle },
+		{ "flip", l_image_flip },
+		{ "expand", l_image_expand },
+		{ "downscale", l_image_downscale },
+		{ "encode", l_image_encode },
 		{ "release", l_image_release },
 		{ "__gc", l_image_release },
 		{ nullptr, nullptr }
@@ -134,18 +478,46 @@ int fln_luaopen_data(lua_State *L) {
 	lua_pushvalue(L, -1);
 	lua_setfield(L, -2, "__index");
 	luaL_setfuncs(L, image_meths, 0);
-	/*
-		const luaL_Reg font_meths[] = {
-			{"generate", l_font_generate},
-			{"release", l_font_release},
-			{"__gc", l_font_release},
-			{nullptr, nullptr}};
-		luaL_newmetatable(L, FLN_USERTYPE_FONT);
-		lua_pushvalue(L, -1);
-		lua_setfield(L, -2, "__index");
-		luaL_setfuncs(L, font_meths, 0);
-	*/
-	const luaL_Reg funcs[] = { { "png", l_png }, /*{"ttf", ltf},*/ { nullptr, nullptr } };
+	const luaL_Reg model_meths[] = {
+		{ "counts", l_model_counts },
+		{ "release", l_model_release },
+		{ "__gc", l_model_release },
+		{ nullptr, nullptr }
+	};
+	luaL_newmetatable(L, FLN_USERTYPE_MODEL);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, model_meths, 0);
+	const luaL_Reg font_meths[] = {
+		{ "glyph", l_font_glyph },
+		{ "kerning", l_font_kerning },
+		{ "metrics", l_font_metrics },
+		{ "measure", l_font_measure },
+		{ "sdf", l_font_sdf },
+		{ "ready", l_font_ready },
+		{ "release", l_font_release },
+		{ "__gc", l_font_release },
+		{ nullptr, nullptr }
+	};
+	luaL_newmetatable(L, FLN_USERTYPE_FONT);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, font_meths, 0);
+	lua_newuserdata(L, 0);
+	lua_newtable(L);
+	lua_pushcfunction(L, l_decode_sentinel_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_DECODE_SENTINEL);
+	const luaL_Reg funcs[] = {
+		{ "png", l_png },
+		{ "qoi", l_qoi },
+		{ "image", l_image },
+		{ "image_async", l_image_async },
+		{ "model", l_model },
+		{ "font", l_font },
+		{ nullptr, nullptr }
+	};
 	luaL_newlib(L, funcs);
 	return 1;
 }
@@ -10,12 +10,14 @@
 #include <lauxlib.h>
 #include <lua.h>
 #include <stddef.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
+
+#include "font.h"
+#include "mapped_file.h"
+#include "mesh_format.h"
 
 #define FLN_USERTYPE_ARCHIVE "fln.archive" // TODO
 #define FLN_USERTYPE_IMAGE "fln.image"
-#define FLN_USERTYPE_MODEL "fln.model" // TODO
+#define FLN_USERTYPE_MODEL "fln.model"
 #define FLN_USERTYPE_FONT "fln.font"
 
 typedef enum fln_image_format {
@@ -32,9 +34,10 @@ typedef struct fln_image {
 	unsigned char *data;
 } fln_image;
 
-typedef struct fln_font {
-	FT_Library context;
-	FT_Face face;
-} fln_font;
+// 映射到内存中的 .flm 网格，header 和数据都直接指向映射区域
+typedef struct fln_model {
+	fln_mapped_file file;
+	const fln_mesh_blob_header *header;
+} fln_model;
 
 int fln_luaopen_data(lua_State *L);
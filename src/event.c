@@ -0,0 +1,202 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "event.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "callback.h"
+#include "graphics.h"
+#include "keyboard.h"
+#include "memory.h"
+#include "mouse.h"
+#include "pacing.h"
+#include "profiler.h"
+#include "replay.h"
+
+// 有界的多生产者队列（Vyukov），每个格子的 sequence 表示它当前可以被写入还是读取
+// 消费者只有主线程，读取端不需要 CAS
+#define QUEUE_CAPACITY 4096
+#define QUEUE_MASK (QUEUE_CAPACITY - 1)
+
+typedef struct queue_cell {
+	atomic_size_t sequence;
+	SDL_Event event;
+} queue_cell;
+
+static queue_cell cells[QUEUE_CAPACITY];
+static atomic_size_t enqueue_pos;
+static size_t dequeue_pos = 0;
+static atomic_uint dropped; // 队列满时丢弃的事件数
+
+// 交给脚本的记录，每帧复用
+static fln_event_record *records = nullptr;
+static size_t records_count = 0;
+static size_t records_capacity = 0;
+
+void fln_event_init(void) {
+	for (size_t i = 0; i < QUEUE_CAPACITY; i++) {
+		atomic_init(&cells[i].sequence, i);
+	}
+	atomic_init(&enqueue_pos, 0);
+	atomic_init(&dropped, 0);
+	dequeue_pos = 0;
+}
+
+bool fln_event_push(const SDL_Event *event) {
+	size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+	queue_cell *cell;
+	while (true) {
+		cell = &cells[pos & QUEUE_MASK];
+		size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+			return false;
+		} else {
+			pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+		}
+	}
+	cell->event = *event;
+	atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+	return true;
+}
+
+static bool pop(SDL_Event *event) {
+	queue_cell *cell = &cells[dequeue_pos & QUEUE_MASK];
+	size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+	if (sequence != dequeue_pos + 1) {
+		return false;
+	}
+	*event = cell->event;
+	atomic_store_explicit(&cell->sequence, dequeue_pos + QUEUE_CAPACITY, memory_order_release);
+	dequeue_pos++;
+	return true;
+}
+
+static fln_event_record *push_record(fln_event_type type, uint64_t timestamp) {
+	if (records_count == records_capacity) {
+		size_t capacity = records_capacity ? records_capacity * 2 : 64;
+		fln_event_record *data = fln_realloc(records, capacity * sizeof(fln_event_record));
+		if (!data) {
+			return nullptr;
+		}
+		records = data;
+		records_capacity = capacity;
+	}
+	fln_event_record *record = &records[records_count++];
+	memset(record, 0, sizeof(*record));
+	record->type = type;
+	record->timestamp = timestamp;
+	return record;
+}
+
+// 只转换脚本关心的事件
+static void convert(fln_app_state *appstate, const SDL_Event *event) {
+	fln_event_record *record;
+	switch (event->type) {
+		case SDL_EVENT_KEY_DOWN:
+		case SDL_EVENT_KEY_UP:
+			record = push_record(event->type == SDL_EVENT_KEY_DOWN ? FLN_EVENT_KEY_DOWN : FLN_EVENT_KEY_UP, event->key.timestamp);
+			if (record) {
+				record->code = event->key.scancode;
+				record->mod = event->key.mod;
+				record->repeat = event->key.repeat;
+			}
+			break;
+		case SDL_EVENT_MOUSE_BUTTON_DOWN:
+		case SDL_EVENT_MOUSE_BUTTON_UP:
+			record = push_record(event->type == SDL_EVENT_MOUSE_BUTTON_DOWN ? FLN_EVENT_MOUSE_DOWN : FLN_EVENT_MOUSE_UP, event->button.timestamp);
+			if (record) {
+				record->code = event->button.button;
+				record->x = event->button.x;
+				record->y = event->button.y;
+			}
+			break;
+		case SDL_EVENT_MOUSE_MOTION:
+			record = push_record(FLN_EVENT_MOUSE_MOTION, event->motion.timestamp);
+			if (record) {
+				record->x = event->motion.x;
+				record->y = event->motion.y;
+				record->dx = event->motion.xrel;
+				record->dy = event->motion.yrel;
+			}
+			break;
+		case SDL_EVENT_MOUSE_WHEEL:
+			record = push_record(FLN_EVENT_MOUSE_WHEEL, event->wheel.timestamp);
+			if (record) {
+				record->x = event->wheel.x;
+				record->y = event->wheel.y;
+			}
+			break;
+		case SDL_EVENT_WINDOW_RESIZED:
+			record = push_record(FLN_EVENT_WINDOW_RESIZED, event->window.timestamp);
+			if (record) {
+				int width, height;
+				SDL_GetWindowSizeInPixels(appstate->window, &width, &height);
+				record->x = (float)width;
+				record->y = (float)height;
+			}
+			break;
+		case SDL_EVENT_WINDOW_FOCUS_GAINED:
+			push_record(FLN_EVENT_FOCUS_GAINED, event->window.timestamp);
+			break;
+		case SDL_EVENT_WINDOW_FOCUS_LOST:
+			push_record(FLN_EVENT_FOCUS_LOST, event->window.timestamp);
+			break;
+		default:
+			break;
+	}
+}
+
+static void process(fln_app_state *appstate, const SDL_Event *event) {
+	fln_receive_keyboard_events(event);
+	fln_receive_mouse_events(event);
+	// 窗口尺寸的变化在主线程上、绘制之前生效
+	fln_gfx_receive_window_events(appstate, event);
+	fln_pacing_receive_events(event);
+	fln_replay_record(event);
+	convert(appstate, event);
+}
+
+void fln_event_dispatch(fln_app_state *appstate) {
+	FLN_ZONE_BEGIN("event");
+	records_count = 0;
+	fln_mouse_new_frame();
+	SDL_Event event;
+	while (pop(&event)) {
+		if (fln_replay_accept(&event)) {
+			process(appstate, &event);
+		}
+	}
+	// 回放时注入录制的这一帧的输入
+	while (fln_replay_next(appstate, &event)) {
+		process(appstate, &event);
+	}
+	fln_replay_end_frame();
+	fln_keyboard_update();
+	fln_mouse_update();
+	unsigned int count = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+	if (count) {
+		printf("event queue is full, %u events dropped\n", count);
+	}
+	fln_deliver_events(appstate->L, records, records_count);
+	FLN_ZONE_END();
+}
+
+void fln_event_quit(void) {
+	fln_free(records);
+	records = nullptr;
+	records_count = 0;
+	records_capacity = 0;
+}
@@ -0,0 +1,50 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <SDL3/SDL_events.h>
+#include <stdint.h>
+
+#include "appstate.h"
+
+// 事件队列：SDL_AppEvent 可能在别的线程上被调用，事件先放进无锁队列，
+// 每帧开始时在主线程上统一处理（更新键盘、鼠标、窗口状态），再一次性交给脚本的 event 回调
+
+typedef enum fln_event_type {
+	FLN_EVENT_KEY_DOWN,
+	FLN_EVENT_KEY_UP,
+	FLN_EVENT_MOUSE_DOWN,
+	FLN_EVENT_MOUSE_UP,
+	FLN_EVENT_MOUSE_MOTION,
+	FLN_EVENT_MOUSE_WHEEL,
+	FLN_EVENT_WINDOW_RESIZED,
+	FLN_EVENT_FOCUS_GAINED,
+	FLN_EVENT_FOCUS_LOST,
+	FLN_EVENT_TYPE_COUNT
+} fln_event_type;
+
+// 交给脚本的紧凑记录，所有字段对每种事件都有定义（用不到的为 0）
+typedef struct fln_event_record {
+	fln_event_type type;
+	int code; // 键盘为 scancode，鼠标为按键编号
+	float x, y; // 鼠标位置、滚轮量或窗口像素尺寸
+	float dx, dy; // 鼠标的相对移动
+	uint16_t mod; // 修饰键
+	bool repeat; // 按住不放产生的重复按下
+	uint64_t timestamp; // 纳秒
+} fln_event_record;
+
+void fln_event_init(void);
+
+// 任意线程调用，队列满时丢弃并返回 false
+bool fln_event_push(const SDL_Event *event);
+
+// 主线程每帧开始时调用
+void fln_event_dispatch(fln_app_state *appstate);
+
+void fln_event_quit(void);
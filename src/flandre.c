@@ -14,44 +14,50 @@
 #include "mouse.h"
 #include "system.h"
 #include "timer.h"
+#include "profiler.h"
+#include <lauxlib.h>
 #include <lua.h>
+#include <string.h>
+
+// 子模块在第一次访问时才创建，之后直接存在 flandre 表中，不再经过 __index
+static const luaL_Reg modules[] = {
+	{ "system", fln_luaopen_system },
+	{ "timer", fln_luaopenimer },
+	{ "data", fln_luaopen_data },
+	{ "callback", fln_luaopen_callback },
+	{ "math", fln_luaopen_math },
+	{ "graphics", fln_luaopen_graphics },
+	{ "keyboard", fln_luaopen_keyboard },
+	{ "mouse", fln_luaopen_mouse },
+	{ nullptr, nullptr },
+};
+
+static int l_index(lua_State *L) {
+	const char *name = lua_tostring(L, 2);
+	if (!name) {
+		return 0;
+	}
+	for (const luaL_Reg *module = modules; module->name; module++) {
+		if (strcmp(module->name, name) == 0) {
+			FLN_ZONE_BEGIN(module->name);
+			lua_pushcfunction(L, module->func);
+			lua_call(L, 0, 1);
+			FLN_ZONE_END();
+			lua_pushvalue(L, 2);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, 1);
+			return 1;
+		}
+	}
+	return 0;
+}
 
 int fln_luaopen(lua_State *L) {
-	lua_settop(L, 0);
+	fln_callback_init(L);
 	lua_newtable(L);
-
-	lua_pushcfunction(L, fln_luaopen_system);
-	lua_call(L, 0, 1);
-	lua_setfield(L, 1, "system");
-
-	lua_pushcfunction(L, fln_luaopenimer);
-	lua_call(L, 0, 1);
-	lua_setfield(L, 1, "timer");
-
-	lua_pushcfunction(L, fln_luaopen_data);
-	lua_call(L, 0, 1);
-	lua_setfield(L, 1, "data");
-
-	lua_pushcfunction(L, fln_luaopen_callback);
-	lua_call(L, 0, 1);
-	lua_setfield(L, 1, "callback");
-
-	lua_pushcfunction(L, fln_luaopen_math);
-	lua_call(L, 0, 1);
-	lua_setfield(L, 1, "math");
-
-	lua_pushcfunction(L, fln_luaopen_graphics);
-	lua_call(L, 0, 1);
-	lua_setfield(L, 1, "graphics");
-
-	lua_pushcfunction(L, fln_luaopen_keyboard);
-	lua_call(L, 0, 1);
-	lua_setfield(L, 1, "keyboard");
-
-	lua_pushcfunction(L, fln_luaopen_mouse);
-	lua_call(L, 0, 1);
-	lua_setfield(L, 1, "mouse");
-
-	lua_settop(L, 1);
+	lua_createtable(L, 0, 1);
+	lua_pushcfunction(L, l_index);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
 	return 1;
 }
@@ -0,0 +1,577 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "font.h"
+
+#include <SDL3/SDL_mutex.h>
+#include <string.h>
+
+#include "job.h"
+#include "memory.h"
+
+static FT_Library library = nullptr;
+
+// 多个线程共用一个 FT_Library 时，FT_New_Face / FT_Done_Face 需要加锁
+static SDL_Mutex *library_mutex = nullptr;
+
+static fln_glyph_atlas atlas;
+static uint32_t next_font_serial = 0;
+
+FT_Library fln_font_library(void) {
+	if (!library) {
+		FT_Error err = FT_Init_FreeType(&library);
+		if (err != FT_Err_Ok) {
+			printf("failed to initialize FreeType Library: %s\n", FT_Error_String(err));
+			library = nullptr;
+			return nullptr;
+		}
+		library_mutex = SDL_CreateMutex();
+		if (!library_mutex) {
+			printf("failed to create FreeType mutex: %s\n", SDL_GetError());
+			FT_Done_FreeType(library);
+			library = nullptr;
+		}
+	}
+	return library;
+}
+
+static FT_Error new_face(const fln_font *font, FT_Face *face) {
+	SDL_LockMutex(library_mutex);
+	FT_Error err = FT_New_Memory_Face(library, font->data, font->data_size, 0, face);
+	SDL_UnlockMutex(library_mutex);
+	return err;
+}
+
+static void done_face(FT_Face face) {
+	SDL_LockMutex(library_mutex);
+	FT_Done_Face(face);
+	SDL_UnlockMutex(library_mutex);
+}
+
+// atlas -----------------------------------------------------------------------
+
+static bool atlas_init(void) {
+	if (atlas.pixels) {
+		return true;
+	}
+	atlas.pixels = fln_calloc(FLN_GLYPH_ATLAS_SIZE * FLN_GLYPH_ATLAS_SIZE, 1);
+	if (!atlas.pixels) {
+		return false;
+	}
+	atlas.width = FLN_GLYPH_ATLAS_SIZE;
+	atlas.height = FLN_GLYPH_ATLAS_SIZE;
+	atlas.shelves_count = 0;
+	atlas.next_y = 0;
+	atlas.glyphs = nullptr;
+	atlas.version = 1;
+	fln_font_atlas_clear_dirty(&atlas);
+	return true;
+}
+
+static void mark_dirty(int x0, int y0, int x1, int y1) {
+	if (atlas.dirty_x0 > x0) {
+		atlas.dirty_x0 = x0;
+	}
+	if (atlas.dirty_y0 > y0) {
+		atlas.dirty_y0 = y0;
+	}
+	if (atlas.dirty_x1 < x1) {
+		atlas.dirty_x1 = x1;
+	}
+	if (atlas.dirty_y1 < y1) {
+		atlas.dirty_y1 = y1;
+	}
+	atlas.version++;
+}
+
+static void evict_shelf(int index) {
+	fln_glyph_shelf *shelf = &atlas.shelves[index];
+	fln_glyph *glyph = shelf->glyphs;
+	while (glyph) {
+		fln_glyph *next = glyph->shelf_next;
+		HASH_DEL(atlas.glyphs, glyph);
+		fln_free(glyph);
+		glyph = next;
+	}
+	shelf->glyphs = nullptr;
+	shelf->x = 0;
+	shelf->generation++;
+	// 清掉旧像素，否则新字形的边距里会残留旧内容
+	memset(atlas.pixels + (size_t)shelf->y * atlas.width, 0, (size_t)shelf->height * atlas.width);
+	mark_dirty(0, shelf->y, atlas.width, shelf->y + shelf->height);
+}
+
+static void evict_all(void) {
+	fln_glyph *glyph, *tmp;
+	HASH_ITER(hh, atlas.glyphs, glyph, tmp) {
+		HASH_DEL(atlas.glyphs, glyph);
+		fln_free(glyph);
+	}
+	// 之后新建的 shelf 复用这些位置，generation 继续递增
+	for (int i = 0; i < atlas.shelves_count; i++) {
+		atlas.shelves[i].glyphs = nullptr;
+		atlas.shelves[i].generation++;
+	}
+	atlas.shelves_count = 0;
+	atlas.next_y = 0;
+	memset(atlas.pixels, 0, (size_t)atlas.width * atlas.height);
+	mark_dirty(0, 0, atlas.width, atlas.height);
+}
+
+// 为 w x h（含边距）的矩形找一个 shelf，必要时新建或淘汰
+static int allocate_shelf(int w, int h) {
+	int best = -1;
+	for (int i = 0; i < atlas.shelves_count; i++) {
+		fln_glyph_shelf *shelf = &atlas.shelves[i];
+		// 太高的 shelf 会浪费空间，只接受高度相近的
+		if (shelf->height >= h && shelf->height <= h + h / 2 + 4 && shelf->x + w <= atlas.width) {
+			if (best < 0 || shelf->height < atlas.shelves[best].height) {
+				best = i;
+			}
+		}
+	}
+	if (best >= 0) {
+		return best;
+	}
+
+	int height = (h + 3) & ~3;
+	if (atlas.next_y + height > atlas.height) {
+		height = h;
+	}
+	if (atlas.next_y + height <= atlas.height && atlas.shelves_count < FLN_GLYPH_ATLAS_MAX_SHELVES) {
+		fln_glyph_shelf *shelf = &atlas.shelves[atlas.shelves_count];
+		shelf->y = atlas.next_y;
+		shelf->height = height;
+		shelf->x = 0;
+		shelf->last_used = atlas.frame;
+		shelf->glyphs = nullptr;
+		atlas.next_y += height;
+		return atlas.shelves_count++;
+	}
+
+	// 图集已满：淘汰最久未使用、且放得下的 shelf
+	// 本帧用过的 shelf 不能淘汰，本帧已经生成的顶点还引用着其中字形的 UV
+	int victim = -1;
+	bool used_this_frame = false;
+	for (int i = 0; i < atlas.shelves_count; i++) {
+		fln_glyph_shelf *shelf = &atlas.shelves[i];
+		if (shelf->last_used == atlas.frame) {
+			used_this_frame = true;
+			continue;
+		}
+		if (shelf->height >= h && (victim < 0 || shelf->last_used < atlas.shelves[victim].last_used)) {
+			victim = i;
+		}
+	}
+	if (victim >= 0) {
+		evict_shelf(victim);
+		return victim;
+	}
+
+	// 本帧的字形已经占满了能用的位置，放弃这个字形，下一帧再尝试
+	if (used_this_frame) {
+		atlas.deferrals++;
+		return -1;
+	}
+	if (h > atlas.height) {
+		return -1;
+	}
+	// 没有足够高的 shelf，且所有 shelf 本帧都没用过，整个清空重新排列
+	evict_all();
+	return allocate_shelf(w, h);
+}
+
+fln_glyph_atlas *fln_font_atlas(void) {
+	return atlas_init() ? &atlas : nullptr;
+}
+
+void fln_font_atlas_clear_dirty(fln_glyph_atlas *atlas) {
+	atlas->dirty_x0 = atlas->width;
+	atlas->dirty_y0 = atlas->height;
+	atlas->dirty_x1 = 0;
+	atlas->dirty_y1 = 0;
+}
+
+bool fln_font_atlas_touch(const fln_glyph_shelf_ref *refs, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		if (refs[i].shelf >= atlas.shelves_count || atlas.shelves[refs[i].shelf].generation != refs[i].generation) {
+			return false;
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		atlas.shelves[refs[i].shelf].last_used = atlas.frame;
+	}
+	return true;
+}
+
+void fln_font_new_frame(void) {
+	atlas.frame++;
+}
+
+// 把一张 8 位灰度位图放进图集并加入缓存
+static const fln_glyph *atlas_insert(const fln_glyph_key *key, const unsigned char *pixels, int width, int height, int pitch, int bearing_x, int bearing_y, float advance) {
+	fln_glyph *glyph = fln_alloc(sizeof(fln_glyph));
+	if (!glyph) {
+		return nullptr;
+	}
+	memset(glyph, 0, sizeof(fln_glyph));
+	glyph->key = *key;
+	glyph->bearing_x = bearing_x;
+	glyph->bearing_y = bearing_y;
+	glyph->advance = advance;
+	glyph->shelf = -1;
+
+	if (width > 0 && height > 0) {
+		int w = width + FLN_GLYPH_PADDING * 2;
+		int h = height + FLN_GLYPH_PADDING * 2;
+		int index = w <= atlas.width ? allocate_shelf(w, h) : -1;
+		if (index < 0) {
+			fln_free(glyph);
+			return nullptr;
+		}
+		fln_glyph_shelf *shelf = &atlas.shelves[index];
+		glyph->x = shelf->x + FLN_GLYPH_PADDING;
+		glyph->y = shelf->y + FLN_GLYPH_PADDING;
+		glyph->width = width;
+		glyph->height = height;
+		glyph->shelf = index;
+		glyph->shelf_next = shelf->glyphs;
+		shelf->glyphs = glyph;
+		shelf->x += w;
+		shelf->last_used = atlas.frame;
+		for (int row = 0; row < height; row++) {
+			memcpy(atlas.pixels + (size_t)(glyph->y + row) * atlas.width + glyph->x, pixels + (size_t)row * pitch, width);
+		}
+		mark_dirty(glyph->x, glyph->y, glyph->x + glyph->width, glyph->y + glyph->height);
+	}
+
+	HASH_ADD(hh, atlas.glyphs, key, sizeof(fln_glyph_key), glyph);
+	return glyph;
+}
+
+static fln_glyph *atlas_find(const fln_glyph_key *key) {
+	fln_glyph *glyph = nullptr;
+	HASH_FIND(hh, atlas.glyphs, key, sizeof(fln_glyph_key), glyph);
+	return glyph;
+}
+
+static void make_key(fln_glyph_key *key, const fln_font *font, uint32_t glyph_index, unsigned int size) {
+	memset(key, 0, sizeof(fln_glyph_key));
+	key->face = font->face;
+	key->size = font->sdf ? font->sdf_size : size;
+	key->glyph = glyph_index;
+}
+
+// 加载并渲染字形到 face->glyph，sdf 为 true 时输出距离场
+static bool render_glyph(FT_Face face, uint32_t glyph_index, bool sdf) {
+	if (FT_Load_Glyph(face, glyph_index, sdf ? FT_LOAD_DEFAULT | FT_LOAD_NO_BITMAP : FT_LOAD_RENDER | FT_LOAD_NO_BITMAP) != FT_Err_Ok) {
+		return false;
+	}
+	// 空白字形（例如空格）没有轮廓，sdf 渲染器会报错，直接当作空位图
+	if (sdf && face->glyph->format == FT_GLYPH_FORMAT_OUTLINE && face->glyph->outline.n_contours > 0) {
+		return FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF) == FT_Err_Ok;
+	}
+	return true;
+}
+
+static bool usable_bitmap(const FT_Bitmap *bitmap) {
+	return bitmap->pixel_mode == FT_PIXEL_MODE_GRAY && bitmap->pitch >= 0;
+}
+
+// SDF 预生成 ------------------------------------------------------------------
+
+typedef struct sdf_bitmap {
+	uint32_t glyph;
+	int width;
+	int height;
+	int bearing_x;
+	int bearing_y;
+	float advance;
+	unsigned char *pixels;
+} sdf_bitmap;
+
+typedef struct sdf_job {
+	fln_font *font;
+	uint32_t *codepoints;
+	size_t count;
+	sdf_bitmap *bitmaps;
+	size_t bitmaps_count;
+} sdf_job;
+
+// 工作线程：使用独立的 face，避免和主线程争用同一个 FT_Face
+static void sdf_job_work(void *userdata) {
+	sdf_job *job = userdata;
+	FT_Face face;
+	if (new_face(job->font, &face) != FT_Err_Ok) {
+		return;
+	}
+	if (FT_Set_Pixel_Sizes(face, 0, job->font->sdf_size) == FT_Err_Ok) {
+		for (size_t i = 0; i < job->count; i++) {
+			uint32_t glyph_index = FT_Get_Char_Index(face, job->codepoints[i]);
+			if (!render_glyph(face, glyph_index, true)) {
+				continue;
+			}
+			const FT_Bitmap *bitmap = &face->glyph->bitmap;
+			sdf_bitmap *out = &job->bitmaps[job->bitmaps_count];
+			out->glyph = glyph_index;
+			out->width = usable_bitmap(bitmap) ? bitmap->width : 0;
+			out->height = usable_bitmap(bitmap) ? bitmap->rows : 0;
+			out->bearing_x = face->glyph->bitmap_left;
+			out->bearing_y = face->glyph->bitmap_top;
+			out->advance = face->glyph->advance.x / 64.0f;
+			out->pixels = nullptr;
+			if (out->width > 0 && out->height > 0) {
+				out->pixels = fln_alloc((size_t)out->width * out->height);
+				if (!out->pixels) {
+					continue;
+				}
+				for (int row = 0; row < out->height; row++) {
+					memcpy(out->pixels + (size_t)row * out->width, bitmap->buffer + (size_t)row * bitmap->pitch, out->width);
+				}
+			}
+			job->bitmaps_count++;
+		}
+	}
+	done_face(face);
+}
+
+// 主线程：把生成好的字形放进图集
+static void sdf_job_done(void *userdata) {
+	sdf_job *job = userdata;
+	for (size_t i = 0; i < job->bitmaps_count; i++) {
+		sdf_bitmap *bitmap = &job->bitmaps[i];
+		fln_glyph_key key;
+		make_key(&key, job->font, bitmap->glyph, job->font->sdf_size);
+		if (atlas_init() && !atlas_find(&key)) {
+			atlas_insert(&key, bitmap->pixels, bitmap->width, bitmap->height, bitmap->width, bitmap->bearing_x, bitmap->bearing_y, bitmap->advance);
+		}
+		fln_free(bitmap->pixels);
+	}
+	job->font->job = nullptr;
+	fln_free(job->bitmaps);
+	fln_free(job->codepoints);
+	fln_free(job);
+}
+
+// 字体关闭时取消：生成好的字形直接丢弃，不放进图集
+static void sdf_job_cancelled(void *userdata) {
+	sdf_job *job = userdata;
+	for (size_t i = 0; i < job->bitmaps_count; i++) {
+		fln_free(job->bitmaps[i].pixels);
+	}
+	job->font->job = nullptr;
+	fln_free(job->bitmaps);
+	fln_free(job->codepoints);
+	fln_free(job);
+}
+
+// font ------------------------------------------------------------------------
+
+bool fln_font_open(fln_font *font, const void *data, size_t size, const char **err) {
+	font->face = nullptr;
+	font->data = nullptr;
+	font->data_size = 0;
+	font->current_size = 0;
+	font->sdf = false;
+	font->sdf_size = 0;
+	font->job = nullptr;
+	font->serial = ++next_font_serial;
+	FT_Library lib = fln_font_library();
+	if (!lib) {
+		*err = "FreeType Library is not available";
+		return false;
+	}
+	font->data = fln_alloc(size);
+	if (!font->data) {
+		*err = "bad alloc";
+		return false;
+	}
+	memcpy(font->data, data, size);
+	font->data_size = size;
+	FT_Error ft_err = new_face(font, &font->face);
+	if (ft_err != FT_Err_Ok) {
+		*err = FT_Error_String(ft_err);
+		if (!*err) {
+			*err = "unknown FreeType error";
+		}
+		fln_free(font->data);
+		font->data = nullptr;
+		font->face = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void fln_font_close(fln_font *font) {
+	if (!font->face) {
+		return;
+	}
+	// 工作线程可能还在读字体数据，必须等它结束；结果不再放进图集，避免挤掉其他字体的 shelf
+	if (font->job) {
+		fln_job_cancel(font->job, sdf_job_cancelled);
+	}
+	// face 释放后地址可能被复用，必须把属于它的字形都清掉
+	// 留下的空间不回收，其他字形的 UV 不变，shelf 的 generation 不需要递增
+	// 排版缓存以 serial 区分字体，这个字体的结果不会再被命中
+	for (int i = 0; i < atlas.shelves_count; i++) {
+		fln_glyph **link = &atlas.shelves[i].glyphs;
+		while (*link) {
+			fln_glyph *glyph = *link;
+			if (glyph->key.face == font->face) {
+				*link = glyph->shelf_next;
+				HASH_DEL(atlas.glyphs, glyph);
+				fln_free(glyph);
+			} else {
+				link = &glyph->shelf_next;
+			}
+		}
+	}
+	fln_glyph *glyph, *tmp;
+	HASH_ITER(hh, atlas.glyphs, glyph, tmp) {
+		if (glyph->key.face == font->face) {
+			HASH_DEL(atlas.glyphs, glyph);
+			fln_free(glyph);
+		}
+	}
+	done_face(font->face);
+	font->face = nullptr;
+	fln_free(font->data);
+	font->data = nullptr;
+}
+
+bool fln_font_enable_sdf(fln_font *font, unsigned int base_size, const uint32_t *codepoints, size_t count) {
+	if (!font->face || font->job) {
+		return false;
+	}
+	font->sdf = true;
+	font->sdf_size = base_size;
+	if (count == 0) {
+		return true;
+	}
+	sdf_job *job = fln_calloc(1, sizeof(sdf_job));
+	if (!job) {
+		return false;
+	}
+	job->font = font;
+	job->count = count;
+	job->codepoints = fln_alloc(count * sizeof(uint32_t));
+	job->bitmaps = fln_alloc(count * sizeof(sdf_bitmap));
+	if (!job->codepoints || !job->bitmaps) {
+		fln_free(job->codepoints);
+		fln_free(job->bitmaps);
+		fln_free(job);
+		return false;
+	}
+	memcpy(job->codepoints, codepoints, count * sizeof(uint32_t));
+	font->job = fln_job_submit(sdf_job_work, sdf_job_done, job);
+	if (!font->job) {
+		fln_free(job->codepoints);
+		fln_free(job->bitmaps);
+		fln_free(job);
+		return false;
+	}
+	return true;
+}
+
+bool fln_font_ready(const fln_font *font) {
+	return font->job == nullptr;
+}
+
+bool fln_font_set_size(fln_font *font, unsigned int size) {
+	if (font->current_size == size) {
+		return true;
+	}
+	if (FT_Set_Pixel_Sizes(font->face, 0, size) != FT_Err_Ok) {
+		return false;
+	}
+	font->current_size = size;
+	return true;
+}
+
+float fln_font_scale(const fln_font *font, unsigned int size) {
+	return font->sdf ? (float)size / font->sdf_size : 1.0f;
+}
+
+const fln_glyph *fln_font_glyph(fln_font *font, uint32_t glyph_index, unsigned int size) {
+	if (!font->face || !atlas_init()) {
+		return nullptr;
+	}
+	fln_glyph_key key;
+	make_key(&key, font, glyph_index, size);
+
+	fln_glyph *glyph = atlas_find(&key);
+	if (glyph) {
+		if (glyph->shelf >= 0) {
+			atlas.shelves[glyph->shelf].last_used = atlas.frame;
+		}
+		return glyph;
+	}
+
+	// 未命中（包括后台任务还没生成到的 SDF 字形）就在主线程上生成
+	if (!fln_font_set_size(font, key.size) || !render_glyph(font->face, glyph_index, font->sdf)) {
+		return nullptr;
+	}
+	FT_GlyphSlot slot = font->face->glyph;
+	const FT_Bitmap *bitmap = &slot->bitmap;
+	bool usable = usable_bitmap(bitmap);
+	return atlas_insert(&key, bitmap->buffer, usable ? bitmap->width : 0, usable ? bitmap->rows : 0, bitmap->pitch,
+			slot->bitmap_left, slot->bitmap_top, slot->advance.x / 64.0f);
+}
+
+uint32_t fln_utf8_next(const char **cursor, const char *end) {
+	const unsigned char *s = (const unsigned char *)*cursor;
+	size_t left = end - *cursor;
+	uint32_t c = s[0];
+	int len;
+	if (c < 0x80) {
+		*cursor += 1;
+		return c;
+	} else if ((c & 0xE0) == 0xC0) {
+		len = 2;
+		c &= 0x1F;
+	} else if ((c & 0xF0) == 0xE0) {
+		len = 3;
+		c &= 0x0F;
+	} else if ((c & 0xF8) == 0xF0) {
+		len = 4;
+		c &= 0x07;
+	} else {
+		*cursor += 1;
+		return 0xFFFD;
+	}
+	if ((size_t)len > left) {
+		*cursor = end;
+		return 0xFFFD;
+	}
+	for (int i = 1; i < len; i++) {
+		if ((s[i] & 0xC0) != 0x80) {
+			*cursor += i;
+			return 0xFFFD;
+		}
+		c = (c << 6) | (s[i] & 0x3F);
+	}
+	*cursor += len;
+	return c;
+}
+
+void fln_font_quit(void) {
+	if (atlas.pixels) {
+		fln_glyph *glyph, *tmp;
+		HASH_ITER(hh, atlas.glyphs, glyph, tmp) {
+			HASH_DEL(atlas.glyphs, glyph);
+			fln_free(glyph);
+		}
+		fln_free(atlas.pixels);
+		memset(&atlas, 0, sizeof(atlas));
+	}
+	if (library) {
+		FT_Done_FreeType(library);
+		SDL_DestroyMutex(library_mutex);
+		library = nullptr;
+		library_mutex = nullptr;
+	}
+}
@@ -0,0 +1,123 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <uthash.h>
+
+#define FLN_GLYPH_ATLAS_SIZE 1024
+#define FLN_GLYPH_ATLAS_MAX_SHELVES 256
+#define FLN_GLYPH_PADDING 1
+#define FLN_SDF_SPREAD 8 // FreeType sdf 渲染器的默认 spread（像素）
+
+struct fln_job;
+
+typedef struct fln_font {
+	FT_Face face;
+	unsigned char *data; // FT_New_Memory_Face 要求字体数据在 face 存活期间一直有效
+	size_t data_size;
+	unsigned int current_size;
+	bool sdf; // SDF 字形只在 sdf_size 下生成一次，任意大小都用它缩放
+	unsigned int sdf_size;
+	struct fln_job *job; // 后台预生成 SDF 字形的任务
+	uint32_t serial; // 打开时分配，排版缓存用它区分字体（face 的地址在关闭后可能被复用）
+} fln_font;
+
+// 字形缓存的键：(face, 像素大小, 字形索引)
+typedef struct fln_glyph_key {
+	FT_Face face;
+	uint32_t size;
+	uint32_t glyph;
+} fln_glyph_key;
+
+typedef struct fln_glyph {
+	fln_glyph_key key;
+	int x; // 在图集中的位置（像素），不含边距
+	int y;
+	int width;
+	int height;
+	int bearing_x;
+	int bearing_y;
+	float advance;
+	int shelf; // 所在的 shelf，空白字形（例如空格）为 -1
+	struct fln_glyph *shelf_next;
+	UT_hash_handle hh;
+} fln_glyph;
+
+// 图集按行（shelf）分配，整行是淘汰的最小单位
+typedef struct fln_glyph_shelf {
+	int y;
+	int height;
+	int x; // 下一个可用的横坐标
+	uint64_t last_used;
+	unsigned int generation; // 有字形被移出时递增，记录了 UV 的排版结果据此判断是否失效
+	fln_glyph *glyphs;
+} fln_glyph_shelf;
+
+// 排版结果对某个 shelf 的依赖
+typedef struct fln_glyph_shelf_ref {
+	int shelf;
+	unsigned int generation;
+} fln_glyph_shelf_ref;
+
+// 进程内唯一的 R8 字形图集，GPU 端由图形后端根据 version 和脏矩形同步
+typedef struct fln_glyph_atlas {
+	int width;
+	int height;
+	unsigned char *pixels;
+	fln_glyph_shelf shelves[FLN_GLYPH_ATLAS_MAX_SHELVES];
+	int shelves_count;
+	int next_y;
+	fln_glyph *glyphs;
+	uint64_t frame;
+	unsigned int version;
+	unsigned int deferrals; // 本帧放不下、推迟到之后的帧生成的字形数，只增不减
+	int dirty_x0;
+	int dirty_y0;
+	int dirty_x1;
+	int dirty_y1;
+} fln_glyph_atlas;
+
+FT_Library fln_font_library(void);
+
+bool fln_font_open(fln_font *font, const void *data, size_t size, const char **err);
+
+void fln_font_close(fln_font *font);
+
+// 切换为 SDF 字形，并在工作线程上预生成 codepoints 中的字形
+bool fln_font_enable_sdf(fln_font *font, unsigned int base_size, const uint32_t *codepoints, size_t count);
+
+// 后台任务是否已经完成
+bool fln_font_ready(const fln_font *font);
+
+bool fln_font_set_size(fln_font *font, unsigned int size);
+
+// 字形度量需要乘上的缩放（只有 SDF 字体不为 1）
+float fln_font_scale(const fln_font *font, unsigned int size);
+
+// 查找字形，未缓存时栅格化并放入图集；图集满时按 LRU 淘汰
+// SDF 字体会忽略 size，总是返回 sdf_size 下的字形
+const fln_glyph *fln_font_glyph(fln_font *font, uint32_t glyph_index, unsigned int size);
+
+// 解码一个 UTF-8 字符并前移 cursor，非法字节返回 U+FFFD
+uint32_t fln_utf8_next(const char **cursor, const char *end);
+
+fln_glyph_atlas *fln_font_atlas(void);
+
+void fln_font_atlas_clear_dirty(fln_glyph_atlas *atlas);
+
+// 用于绕过字形查找、直接复用 UV 的情况：引用的 shelf 都没有淘汰过字形时标记它们在本帧被使用过并返回 true
+bool fln_font_atlas_touch(const fln_glyph_shelf_ref *refs, size_t count);
+
+// 每帧调用一次，用于 LRU 判断
+void fln_font_new_frame(void);
+
+void fln_font_quit(void);
@@ -0,0 +1,183 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "gc.h"
+
+#include <SDL3/SDL_timer.h>
+#include <lauxlib.h>
+
+#include "error.h"
+#include "profiler.h"
+#include "stats.h"
+
+typedef enum gc_mode {
+	GC_MODE_FRAME, // 每帧按预算步进
+	GC_MODE_INCREMENTAL, // Lua 自带的增量模式，由分配触发
+	GC_MODE_GENERATIONAL,
+} gc_mode;
+
+static const char *const mode_names[] = { "frame", "incremental", "generational", nullptr };
+
+static struct {
+	bool initialized;
+	gc_mode mode;
+	double budget_ms; // 每帧最多用于步进的时间
+	int step_kb; // 每次 LUA_GCSTEP 的工作量
+	int pause; // 一轮结束后，堆增长到上一轮结束时的 pause% 才开始下一轮
+	size_t cycle_kb; // 上一轮结束时的堆大小
+	bool idle; // 在两轮之间等待堆增长
+	uint64_t frames; // 做过步进的帧数
+	uint64_t steps;
+	uint64_t cycles;
+	uint64_t total_ticks;
+	uint64_t last_ticks;
+	uint64_t max_ticks;
+} gc = {
+	.mode = GC_MODE_FRAME,
+	.budget_ms = 1.0,
+	.step_kb = 16,
+	.pause = 150,
+};
+
+static size_t heap_kb(lua_State *L) {
+	return (size_t)lua_gc(L, LUA_GCCOUNT, 0);
+}
+
+static void apply_mode(lua_State *L) {
+	switch (gc.mode) {
+		case GC_MODE_FRAME:
+			lua_gc(L, LUA_GCINC, 0, 0, 0);
+			lua_gc(L, LUA_GCSTOP, 0);
+			gc.cycle_kb = heap_kb(L);
+			gc.idle = false;
+			break;
+		case GC_MODE_INCREMENTAL:
+			lua_gc(L, LUA_GCINC, 0, 0, 0);
+			lua_gc(L, LUA_GCRESTART, 0);
+			break;
+		case GC_MODE_GENERATIONAL:
+			lua_gc(L, LUA_GCGEN, 0, 0);
+			lua_gc(L, LUA_GCRESTART, 0);
+			break;
+	}
+}
+
+void fln_gc_init(lua_State *L) {
+	gc.initialized = true;
+	apply_mode(L);
+}
+
+void fln_gc_frame(lua_State *L) {
+	if (!gc.initialized || gc.mode != GC_MODE_FRAME) {
+		return;
+	}
+	size_t kb = heap_kb(L);
+	if (gc.idle) {
+		if (kb * 100 < gc.cycle_kb * (size_t)gc.pause) {
+			gc.last_ticks = 0;
+			return;
+		}
+		gc.idle = false;
+	}
+	FLN_ZONE_BEGIN("gc");
+	uint64_t start = SDL_GetPerformanceCounter();
+	uint64_t budget = (uint64_t)(gc.budget_ms * (double)SDL_GetPerformanceFrequency() / 1000.0);
+	// 堆已经超过上一轮结束时的两倍，说明步进跟不上分配速度，临时放宽预算
+	if (kb > gc.cycle_kb * 2) {
+		budget *= 4;
+	}
+	uint64_t elapsed;
+	do {
+		gc.steps++;
+		if (lua_gc(L, LUA_GCSTEP, gc.step_kb)) {
+			gc.cycles++;
+			gc.cycle_kb = heap_kb(L);
+			gc.idle = true;
+			elapsed = SDL_GetPerformanceCounter() - start;
+			break;
+		}
+		elapsed = SDL_GetPerformanceCounter() - start;
+	} while (elapsed < budget);
+	FLN_ZONE_END();
+	gc.frames++;
+	gc.last_ticks = elapsed;
+	gc.total_ticks += elapsed;
+	if (gc.max_ticks < elapsed) {
+		gc.max_ticks = elapsed;
+	}
+	fln_counters.gc_ticks += elapsed;
+}
+
+static double ticks_to_ms(uint64_t ticks) {
+	return (double)ticks * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static void push_stats(lua_State *L) {
+	lua_createtable(L, 0, 10);
+	lua_pushstring(L, mode_names[gc.mode]);
+	lua_setfield(L, -2, "mode");
+	lua_pushnumber(L, gc.budget_ms);
+	lua_setfield(L, -2, "budget");
+	lua_pushinteger(L, (lua_Integer)heap_kb(L) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0));
+	lua_setfield(L, -2, "memory");
+	lua_pushinteger(L, (lua_Integer)gc.cycles);
+	lua_setfield(L, -2, "cycles");
+	lua_pushinteger(L, (lua_Integer)gc.steps);
+	lua_setfield(L, -2, "steps");
+	lua_pushnumber(L, ticks_to_ms(gc.last_ticks));
+	lua_setfield(L, -2, "last_pause");
+	lua_pushnumber(L, ticks_to_ms(gc.max_ticks));
+	lua_setfield(L, -2, "max_pause");
+	lua_pushnumber(L, gc.frames ? ticks_to_ms(gc.total_ticks) / (double)gc.frames : 0.0);
+	lua_setfield(L, -2, "mean_pause");
+	lua_pushnumber(L, ticks_to_ms(gc.total_ticks));
+	lua_setfield(L, -2, "total_pause");
+}
+
+// system.gc() 返回统计，时间单位为毫秒
+// system.gc{ mode = "frame" | "incremental" | "generational", budget = 毫秒, step = KB, pause = 百分比 }
+// 修改设置，pause 时间只统计 frame 模式下引擎主动做的步进
+static int l_gc(lua_State *L) {
+	if (lua_isnoneornil(L, 1)) {
+		push_stats(L);
+		return 1;
+	}
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_getfield(L, 1, "mode");
+	lua_getfield(L, 1, "budget");
+	lua_getfield(L, 1, "step");
+	lua_getfield(L, 1, "pause");
+	gc_mode mode = lua_isnil(L, -4) ? gc.mode : (gc_mode)luaL_checkoption(L, -4, nullptr, mode_names);
+	double budget = luaL_optnumber(L, -3, gc.budget_ms);
+	lua_Integer step = luaL_optinteger(L, -2, gc.step_kb);
+	lua_Integer pause = luaL_optinteger(L, -1, gc.pause);
+	lua_pop(L, 4);
+	if (budget <= 0.0) {
+		return fln_error(L, "invalid gc budget: %f", budget);
+	}
+	if (step < 1 || step > 1024 * 1024) {
+		return fln_error(L, "invalid gc step size: %d", (int)step);
+	}
+	if (pause < 100 || pause > 1000) {
+		return fln_error(L, "invalid gc pause: %d (100 - 1000)", (int)pause);
+	}
+	gc.budget_ms = budget;
+	gc.step_kb = (int)step;
+	gc.pause = (int)pause;
+	if (mode != gc.mode) {
+		gc.mode = mode;
+		if (gc.initialized) {
+			apply_mode(L);
+		}
+	}
+	return 0;
+}
+
+void fln_gc_setfuncs(lua_State *L) {
+	lua_pushcfunction(L, l_gc);
+	lua_setfield(L, -2, "gc");
+}
@@ -0,0 +1,22 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <lua.h>
+
+// Lua GC 调度：默认停止由分配触发的回收，改为每帧在 end_drawing 之后按时间预算做增量步进，
+// 避免回收发生在 draw 中间造成卡顿
+
+// 根脚本执行完之后调用
+void fln_gc_init(lua_State *L);
+
+// 每帧 end_drawing 之后调用
+void fln_gc_frame(lua_State *L);
+
+// 在栈顶的表（flandre.system）中注册 gc 函数
+void fln_gc_setfuncs(lua_State *L);
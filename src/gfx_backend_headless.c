@@ -0,0 +1,239 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "gfx_backend_headless.h"
+
+#include "gfx_backend_ogl.h"
+
+#ifdef FLN_HEADLESS_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <SDL3/SDL.h>
+#include <string.h>
+
+#include "opengl/glad.h"
+
+// 没有交换链的节流，CPU 最多领先 GPU 这么多帧，保证测得的帧时间有意义
+#define FRAMES_IN_FLIGHT 2
+
+static fln_gfx_backend base; // OpenGL 后端，资源相关的实现全部复用
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static GLuint framebuffer = 0;
+static GLuint color_buffer = 0;
+static GLuint depth_buffer = 0;
+static int framebuffer_width = 0;
+static int framebuffer_height = 0;
+static GLsync frame_fences[FRAMES_IN_FLIGHT];
+static int frame_index = 0;
+
+static bool has_extension(const char *extensions, const char *name) {
+	if (!extensions) {
+		return false;
+	}
+	size_t len = strlen(name);
+	for (const char *p = strstr(extensions, name); p; p = strstr(p + len, name)) {
+		if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static EGLDisplay get_display(void) {
+	const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (get_platform_display && has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+		return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	// 不是 Mesa 的话，默认显示在没有窗口系统时通常也能创建无表面上下文
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static EGLContext create_context(EGLConfig config) {
+	// llvmpipe 的版本较旧时只有 4.5
+	static const EGLint versions[][2] = { { 4, 6 }, { 4, 5 } };
+	for (size_t i = 0; i < sizeof(versions) / sizeof(versions[0]); i++) {
+		const EGLint attributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, versions[i][0],
+			EGL_CONTEXT_MINOR_VERSION, versions[i][1],
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		EGLContext result = eglCreateContext(display, config, EGL_NO_CONTEXT, attributes);
+		if (result != EGL_NO_CONTEXT) {
+			if (i > 0) {
+				printf("headless: OpenGL %d.%d context (shaders requiring #version 460 will fail)\n", versions[i][0], versions[i][1]);
+			}
+			return result;
+		}
+	}
+	return EGL_NO_CONTEXT;
+}
+
+static bool resize_framebuffer(int width, int height) {
+	if (framebuffer == 0) {
+		glGenFramebuffers(1, &framebuffer);
+		glGenRenderbuffers(1, &color_buffer);
+		glGenRenderbuffers(1, &depth_buffer);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	// 一直绑定着，相当于默认帧缓冲（截图也从这里读取）
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("headless: incomplete framebuffer %dx%d\n", width, height);
+		return false;
+	}
+	fln_gfx_ogl_set_window_framebuffer(framebuffer, width, height);
+	framebuffer_width = width;
+	framebuffer_height = height;
+	return true;
+}
+
+static SDL_WindowFlags sdl_configure(fln_app_state *appstate) {
+	// 窗口只用来承载尺寸、标题等状态，使用 offscreen 视频驱动时不会显示
+	return SDL_WINDOW_HIDDEN;
+}
+
+static bool init(fln_app_state *appstate) {
+	if (appstate->render_thread) {
+		printf("headless: --render-thread is ignored\n");
+	}
+	display = get_display();
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		printf("headless: failed to initialize EGL display\n");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		printf("headless: EGL does not support desktop OpenGL\n");
+		return false;
+	}
+	const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (!has_extension(extensions, "EGL_KHR_surfaceless_context")) {
+		printf("headless: EGL_KHR_surfaceless_context is not supported\n");
+		return false;
+	}
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	if (!has_extension(extensions, "EGL_KHR_no_config_context")) {
+		const EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLint count = 0;
+		if (!eglChooseConfig(display, config_attributes, &config, 1, &count) || count == 0) {
+			printf("headless: no suitable EGL config\n");
+			return false;
+		}
+	}
+	context = create_context(config);
+	if (context == EGL_NO_CONTEXT) {
+		printf("headless: failed to create OpenGL context (0x%x)\n", eglGetError());
+		return false;
+	}
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		printf("headless: failed to call eglMakeCurrent()\n");
+		return false;
+	}
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		printf("failed to call gladLoadGLLoader()\n");
+		return false;
+	}
+	printf("headless: EGL %d.%d, %s\n", major, minor, (const char *)glGetString(GL_RENDERER));
+
+	int width, height;
+	SDL_GetWindowSizeInPixels(appstate->window, &width, &height);
+	if (!resize_framebuffer(width, height)) {
+		return false;
+	}
+	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+	return true;
+}
+
+static bool begin_drawing(fln_app_state *appstate) {
+	int width, height;
+	SDL_GetWindowSizeInPixels(appstate->window, &width, &height);
+	if (width > 0 && height > 0 && (width != framebuffer_width || height != framebuffer_height)) {
+		resize_framebuffer(width, height);
+	}
+	return base.begin_drawing(appstate);
+}
+
+static bool end_drawing(fln_app_state *appstate) {
+	bool result = fln_gfx_ogl_end_offscreen_frame(appstate);
+	frame_fences[frame_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame_index = (frame_index + 1) % FRAMES_IN_FLIGHT;
+	GLsync oldest = frame_fences[frame_index];
+	if (oldest) {
+		glClientWaitSync(oldest, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+		glDeleteSync(oldest);
+		frame_fences[frame_index] = nullptr;
+	}
+	return result;
+}
+
+static bool destroy_resource(fln_app_state *appstate) {
+	for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		if (frame_fences[i]) {
+			glDeleteSync(frame_fences[i]);
+			frame_fences[i] = nullptr;
+		}
+	}
+	fln_gfx_ogl_destroy_objects();
+	if (framebuffer) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &color_buffer);
+		glDeleteRenderbuffers(1, &depth_buffer);
+		framebuffer = 0;
+		color_buffer = 0;
+		depth_buffer = 0;
+	}
+	if (display != EGL_NO_DISPLAY) {
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context != EGL_NO_CONTEXT) {
+			eglDestroyContext(display, context);
+			context = EGL_NO_CONTEXT;
+		}
+		eglTerminate(display);
+		display = EGL_NO_DISPLAY;
+	}
+	return true;
+}
+
+bool fln_gfx_headless_available(void) {
+	return true;
+}
+
+fln_gfx_backend fln_gfx_init_backend_headless() {
+	base = fln_gfx_init_backend_ogl();
+	fln_gfx_backend backend = base;
+	backend.name = "headless";
+	backend.sdl_configure = sdl_configure;
+	backend.init = init;
+	backend.begin_drawing = begin_drawing;
+	backend.end_drawing = end_drawing;
+	backend.destroy_resource = destroy_resource;
+	backend.set_vsync = nullptr; // 没有交换链
+	return backend;
+}
+
+#else
+
+bool fln_gfx_headless_available(void) {
+	return false;
+}
+
+fln_gfx_backend fln_gfx_init_backend_headless() {
+	return fln_gfx_init_backend_ogl();
+}
+
+#endif
@@ -0,0 +1,17 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include "gfx_interface.h"
+
+// 无窗口后端：通过 EGL surfaceless 创建 OpenGL 上下文并渲染到 FBO，
+// 不需要显示器（Mesa llvmpipe 即可），用于 CI 和性能测试
+// 只在定义了 FLN_HEADLESS_EGL 时可用
+bool fln_gfx_headless_available(void);
+
+fln_gfx_backend fln_gfx_init_backend_headless();
@@ -0,0 +1,631 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "gfx_backend_null.h"
+
+#include <SDL3/SDL.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <string.h>
+
+#include "data.h"
+#include "error.h"
+#include "font.h"
+#include "gfx_backend_ogl.h"
+#include "math.h"
+#include "stats.h"
+#include "text.h"
+
+#define HISTOGRAM_BUCKETS 16
+
+typedef enum null_call {
+	CALL_PIPELINE,
+	CALL_PIPELINE_UNIFORM,
+	CALL_PIPELINE_SUBMIT,
+	CALL_PIPELINE_SUBMIT_INSTANCED,
+	CALL_MESH,
+	CALL_TEXTURE2D,
+	CALL_TEXT,
+	CALL_TARGET,
+	CALL_RENDER_TO,
+	CALL_COUNT,
+} null_call;
+
+static const char *const call_names[CALL_COUNT] = {
+	"pipeline",
+	"uniform",
+	"submit",
+	"submit_instanced",
+	"mesh",
+	"texture2d",
+	"text",
+	"target",
+	"render_to",
+};
+
+// 每种调用的统计
+// 直方图按每帧调用次数分桶：第 1 个桶为 0 次，第 i 个桶为 [2^(i-2), 2^(i-1)) 次，最后一个桶包含更多
+typedef struct call_stats {
+	uint64_t frame_count; // 当前帧
+	uint64_t last_frame_count;
+	uint64_t max_frame_count;
+	uint64_t total_count;
+	uint64_t total_ticks; // 调用本身的耗时
+	uint64_t histogram[HISTOGRAM_BUCKETS];
+} call_stats;
+
+// 帧时间的直方图按微秒分桶，规则同上
+typedef struct frame_stats {
+	uint64_t frames;
+	uint64_t last_end; // 上一帧结束时的计数器
+	uint64_t total_ticks;
+	uint64_t min_ticks;
+	uint64_t max_ticks;
+	uint64_t histogram[HISTOGRAM_BUCKETS];
+} frame_stats;
+
+static call_stats calls[CALL_COUNT];
+static frame_stats frame;
+static uint64_t submitted_elements = 0; // 本帧提交的索引数（含实例化）
+static uint64_t last_frame_elements = 0;
+
+typedef struct null_pipeline {
+	bool valid;
+	bool blend;
+} null_pipeline;
+
+typedef struct null_mesh {
+	unsigned int vertices_count;
+} null_mesh;
+
+typedef struct null_texture2d {
+	bool valid;
+	bool atlas; // graphics.glyph_atlas() 返回的纹理，不能释放
+	int width;
+	int height;
+} null_texture2d;
+
+typedef struct null_target {
+	bool valid;
+	int width;
+	int height;
+	int color_count;
+} null_target;
+
+typedef struct null_text {
+	fln_text_buffer buffer; // 必须是第一个成员
+} null_text;
+
+static int bucket(uint64_t value) {
+	if (value == 0) {
+		return 0;
+	}
+	int index = 1;
+	while (value > 1 && index < HISTOGRAM_BUCKETS - 1) {
+		value >>= 1;
+		index++;
+	}
+	return index;
+}
+
+static inline void record_call(null_call call, uint64_t start) {
+	calls[call].frame_count++;
+	calls[call].total_ticks += SDL_GetPerformanceCounter() - start;
+}
+
+// pipeline ------------------------------------------------------------------
+
+static int l_pipeline(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	lua_settop(L, 1);
+	luaL_checktype(L, 1, LUA_TTABLE);
+	null_pipeline *pl = lua_newuserdata(L, sizeof(null_pipeline));
+	luaL_setmetatable(L, FLN_USERTYPE_PIPELINE);
+	pl->valid = false;
+	lua_getfield(L, 1, "shaders");
+	if (lua_type(L, -1) != LUA_TTABLE) {
+		return fln_error(L, "`shaders` not found, or invalid type");
+	}
+	lua_getfield(L, -1, "vertex");
+	luaL_checkstring(L, -1);
+	lua_getfield(L, -2, "fragment");
+	luaL_checkstring(L, -1);
+	lua_pop(L, 3);
+	lua_getfield(L, 1, "blend");
+	pl->blend = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	pl->valid = true;
+	record_call(CALL_PIPELINE, start);
+	return 1;
+}
+
+static int l_m_pipeline_release(lua_State *L) {
+	null_pipeline *pl = luaL_checkudata(L, 1, FLN_USERTYPE_PIPELINE);
+	pl->valid = false;
+	return 0;
+}
+
+static int l_m_pipeline_uniform(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	null_pipeline *pl = luaL_checkudata(L, 1, FLN_USERTYPE_PIPELINE);
+	if (!pl->valid) {
+		return fln_error(L, "invalid pipeline");
+	}
+	luaL_checkstring(L, 2);
+	int size = lua_gettop(L) - 2;
+	if (size == 1 && lua_type(L, 3) == LUA_TUSERDATA) {
+		void *transform = luaL_testudata(L, 3, FLN_USERTYPE_TRANSFORM);
+		null_texture2d *texture = luaL_testudata(L, 3, FLN_USERTYPE_TEXTURE2D);
+		if (transform) {
+			if (!*(void **)transform) {
+				return fln_error(L, "invalid transform");
+			}
+		} else if (texture) {
+			if (!texture->valid) {
+				return fln_error(L, "invalid texture");
+			}
+		} else {
+			return fln_error(L, "invalid userdata");
+		}
+	} else if (size >= 1 && size <= 4) {
+		for (int i = 3; i < 3 + size; i++) {
+			if (lua_type(L, i) != LUA_TNUMBER) {
+				return fln_error(L, "unsupported uniform arguments (invalid size or type)");
+			}
+		}
+	} else {
+		return fln_error(L, "unsupported uniform arguments (invalid size or type)");
+	}
+	fln_counters.uniform_calls++;
+	record_call(CALL_PIPELINE_UNIFORM, start);
+	return 0;
+}
+
+static int l_m_pipeline_submit(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	null_pipeline *pl = luaL_checkudata(L, 1, FLN_USERTYPE_PIPELINE);
+	if (!pl->valid) {
+		return fln_error(L, "invalid pipeline");
+	}
+	null_text *text = luaL_testudata(L, 2, FLN_USERTYPE_TEXT);
+	if (text) {
+		if (!fln_text_buffer_prepare(&text->buffer)) {
+			return fln_error(L, "failed to lay out text");
+		}
+		text->buffer.dirty = false;
+		submitted_elements += text->buffer.count / 4 * 6;
+		fln_counters.triangles += text->buffer.count / 4 * 2;
+	} else {
+		null_mesh *mesh = luaL_checkudata(L, 2, FLN_USERTYPE_MESH);
+		if (mesh->vertices_count == 0) {
+			return fln_error(L, "invalid mesh");
+		}
+		submitted_elements += mesh->vertices_count;
+		fln_counters.triangles += mesh->vertices_count / 3;
+	}
+	fln_counters.draw_calls++;
+	record_call(CALL_PIPELINE_SUBMIT, start);
+	return 0;
+}
+
+static int l_m_pipeline_submit_instanced(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	null_pipeline *pl = luaL_checkudata(L, 1, FLN_USERTYPE_PIPELINE);
+	if (!pl->valid) {
+		return fln_error(L, "invalid pipeline");
+	}
+	null_mesh *mesh = luaL_checkudata(L, 2, FLN_USERTYPE_MESH);
+	if (mesh->vertices_count == 0) {
+		return fln_error(L, "invalid mesh");
+	}
+	lua_Integer num = luaL_checkinteger(L, 3);
+	if (num < 1) {
+		return fln_error(L, "invalid instance count: %d", (int)num);
+	}
+	submitted_elements += (uint64_t)mesh->vertices_count * num;
+	fln_counters.draw_calls++;
+	fln_counters.triangles += (uint64_t)(mesh->vertices_count / 3) * num;
+	fln_counters.instances += num;
+	record_call(CALL_PIPELINE_SUBMIT_INSTANCED, start);
+	return 0;
+}
+
+// mesh ----------------------------------------------------------------------
+
+static int l_mesh(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	fln_model *model = luaL_testudata(L, 1, FLN_USERTYPE_MODEL);
+	unsigned int count;
+	if (model) {
+		if (!model->header) {
+			return fln_error(L, "invalid model");
+		}
+		count = model->header->indices_size / sizeof(uint32_t);
+	} else {
+		lua_settop(L, 4);
+		luaL_checkstring(L, 1);
+		luaL_checkstring(L, 2);
+		luaL_checkstring(L, 3);
+		count = luaL_len(L, 2) / sizeof(unsigned int);
+		size_t attributes_count = luaL_len(L, 3) / sizeof(unsigned int);
+		if (!lua_isnoneornil(L, 4)) {
+			luaL_checkstring(L, 4);
+			if (luaL_len(L, 4) / sizeof(unsigned int) != attributes_count) {
+				return fln_error(L, "attributes count must equal to divisors count");
+			}
+		}
+	}
+	null_mesh *mesh = lua_newuserdata(L, sizeof(null_mesh));
+	luaL_setmetatable(L, FLN_USERTYPE_MESH);
+	mesh->vertices_count = count;
+	record_call(CALL_MESH, start);
+	return 1;
+}
+
+static int l_m_mesh_release(lua_State *L) {
+	null_mesh *mesh = luaL_checkudata(L, 1, FLN_USERTYPE_MESH);
+	mesh->vertices_count = 0;
+	return 0;
+}
+
+// texture -------------------------------------------------------------------
+
+static int l_texture2d(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	fln_image *image = luaL_checkudata(L, 1, FLN_USERTYPE_IMAGE);
+	if (!image->data) {
+		return fln_error(L, "invalid image data");
+	}
+	if (image->width <= 0 || image->height <= 0) {
+		return fln_error(L, "invalid image size: %dx%d", image->width, image->height);
+	}
+	null_texture2d *texture = lua_newuserdata(L, sizeof(null_texture2d));
+	luaL_setmetatable(L, FLN_USERTYPE_TEXTURE2D);
+	texture->valid = true;
+	texture->atlas = false;
+	texture->width = image->width;
+	texture->height = image->height;
+	record_call(CALL_TEXTURE2D, start);
+	return 1;
+}
+
+static int KEY_GLYPH_ATLAS = 0;
+
+static int l_glyph_atlas(lua_State *L) {
+	if (lua_rawgetp(L, LUA_REGISTRYINDEX, &KEY_GLYPH_ATLAS) == LUA_TUSERDATA) {
+		return 1;
+	}
+	lua_pop(L, 1);
+	fln_glyph_atlas *atlas = fln_font_atlas();
+	if (!atlas) {
+		return fln_error(L, "failed to allocate glyph atlas");
+	}
+	null_texture2d *texture = lua_newuserdata(L, sizeof(null_texture2d));
+	luaL_setmetatable(L, FLN_USERTYPE_TEXTURE2D);
+	texture->valid = true;
+	texture->atlas = true;
+	texture->width = atlas->width;
+	texture->height = atlas->height;
+	lua_pushvalue(L, -1);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_GLYPH_ATLAS);
+	return 1;
+}
+
+static int l_texture2d_size(lua_State *L) {
+	null_texture2d *texture = luaL_checkudata(L, 1, FLN_USERTYPE_TEXTURE2D);
+	lua_pushinteger(L, texture->width);
+	lua_pushinteger(L, texture->height);
+	return 2;
+}
+
+static int l_texture2d_release(lua_State *L) {
+	null_texture2d *texture = luaL_checkudata(L, 1, FLN_USERTYPE_TEXTURE2D);
+	if (texture->atlas) {
+		return fln_error(L, "the glyph atlas texture cannot be released");
+	}
+	texture->valid = false;
+	return 0;
+}
+
+// text ----------------------------------------------------------------------
+
+static int l_text(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	null_text *text = lua_newuserdata(L, sizeof(null_text));
+	fln_text_buffer_init(&text->buffer);
+	luaL_setmetatable(L, FLN_USERTYPE_TEXT);
+	record_call(CALL_TEXT, start);
+	return 1;
+}
+
+static int l_m_text_release(lua_State *L) {
+	null_text *text = luaL_checkudata(L, 1, FLN_USERTYPE_TEXT);
+	fln_text_buffer_free(&text->buffer);
+	return 0;
+}
+
+// target --------------------------------------------------------------------
+
+static int l_target(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	fln_gfx_target_desc desc;
+	fln_gfx_check_target_desc(L, 1, &desc);
+	null_target *target = lua_newuserdata(L, sizeof(null_target));
+	target->valid = true;
+	target->width = desc.width;
+	target->height = desc.height;
+	target->color_count = desc.color_count;
+	luaL_setmetatable(L, FLN_USERTYPE_TARGET);
+	// 颜色附件同样是可以传给 uniform 的纹理
+	lua_createtable(L, desc.color_count, 0);
+	for (int i = 0; i < desc.color_count; i++) {
+		null_texture2d *texture = lua_newuserdata(L, sizeof(null_texture2d));
+		luaL_setmetatable(L, FLN_USERTYPE_TEXTURE2D);
+		texture->valid = true;
+		texture->atlas = false;
+		texture->width = desc.width;
+		texture->height = desc.height;
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_setiuservalue(L, -2, 1);
+	record_call(CALL_TARGET, start);
+	return 1;
+}
+
+static int l_m_target_texture(lua_State *L) {
+	null_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+	lua_Integer index = luaL_optinteger(L, 2, 1);
+	if (index < 1 || index > target->color_count) {
+		return fln_error(L, "invalid color attachment index: %d (1 - %d)", (int)index, target->color_count);
+	}
+	lua_getiuservalue(L, 1, 1);
+	lua_rawgeti(L, -1, index);
+	return 1;
+}
+
+static int l_m_target_size(lua_State *L) {
+	null_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+	lua_pushinteger(L, target->width);
+	lua_pushinteger(L, target->height);
+	return 2;
+}
+
+static int l_m_target_clear(lua_State *L) {
+	null_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+	if (!target->valid) {
+		return fln_error(L, "invalid target");
+	}
+	return 0;
+}
+
+static int l_m_target_release(lua_State *L) {
+	null_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+	target->valid = false;
+	return 0;
+}
+
+static int l_render_to(lua_State *L) {
+	uint64_t start = SDL_GetPerformanceCounter();
+	if (!lua_isnoneornil(L, 1)) {
+		null_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+		if (!target->valid) {
+			return fln_error(L, "invalid target");
+		}
+	}
+	record_call(CALL_RENDER_TO, start);
+	return 0;
+}
+
+// 没有 GPU 时间可以测量，只检查参数，比例固定为 1
+static int l_dynamic_resolution(lua_State *L) {
+	if (!lua_isboolean(L, 1)) {
+		luaL_checktype(L, 1, LUA_TTABLE);
+	}
+	return 0;
+}
+
+static int l_resolution_scale(lua_State *L) {
+	lua_pushnumber(L, 1.0);
+	lua_pushnumber(L, 0.0);
+	return 2;
+}
+
+// scope 只检查配对
+static int gpu_scope_depth = 0;
+
+static int l_gpu_begin(lua_State *L) {
+	luaL_checkstring(L, 1);
+	gpu_scope_depth++;
+	return 0;
+}
+
+static int l_gpu_end(lua_State *L) {
+	if (gpu_scope_depth == 0) {
+		return fln_error(L, "gpu_end() without matching gpu_begin()");
+	}
+	gpu_scope_depth--;
+	return 0;
+}
+
+static int l_gpu_times(lua_State *L) {
+	lua_newtable(L);
+	lua_pushnumber(L, 0.0);
+	return 2;
+}
+
+static int l_capture(lua_State *L) {
+	// 没有帧缓冲可以读取
+	lua_pushboolean(L, false);
+	return 1;
+}
+
+// 统计 ------------------------------------------------------------------------
+
+static void push_histogram(lua_State *L, const uint64_t *histogram) {
+	lua_createtable(L, HISTOGRAM_BUCKETS, 0);
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		lua_pushinteger(L, (lua_Integer)histogram[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+}
+
+static void set_number(lua_State *L, const char *name, double value) {
+	lua_pushnumber(L, value);
+	lua_setfield(L, -2, name);
+}
+
+// graphics.stats([reset]) -> table
+/*
+	{
+		frames = `integer`,
+		elements = `integer`, -- 上一帧提交的索引数
+		frame_time = { mean, min, max (秒), histogram (按微秒) },
+		calls = { [name] = { total, last, max, mean (每帧), time (秒), histogram } }
+	}
+*/
+static int l_stats(lua_State *L) {
+	bool reset = lua_toboolean(L, 1);
+	double frequency = (double)SDL_GetPerformanceFrequency();
+	uint64_t frames = frame.frames;
+
+	lua_createtable(L, 0, 4);
+	lua_pushinteger(L, (lua_Integer)frames);
+	lua_setfield(L, -2, "frames");
+	lua_pushinteger(L, (lua_Integer)last_frame_elements);
+	lua_setfield(L, -2, "elements");
+
+	lua_createtable(L, 0, 4);
+	set_number(L, "mean", frames ? frame.total_ticks / frequency / frames : 0.0);
+	set_number(L, "min", frames ? frame.min_ticks / frequency : 0.0);
+	set_number(L, "max", frame.max_ticks / frequency);
+	push_histogram(L, frame.histogram);
+	lua_setfield(L, -2, "histogram");
+	lua_setfield(L, -2, "frame_time");
+
+	lua_createtable(L, 0, CALL_COUNT);
+	for (int i = 0; i < CALL_COUNT; i++) {
+		const call_stats *stats = &calls[i];
+		lua_createtable(L, 0, 6);
+		lua_pushinteger(L, (lua_Integer)stats->total_count);
+		lua_setfield(L, -2, "total");
+		lua_pushinteger(L, (lua_Integer)stats->last_frame_count);
+		lua_setfield(L, -2, "last");
+		lua_pushinteger(L, (lua_Integer)stats->max_frame_count);
+		lua_setfield(L, -2, "max");
+		set_number(L, "mean", frames ? (double)stats->total_count / frames : 0.0);
+		set_number(L, "time", stats->total_ticks / frequency);
+		push_histogram(L, stats->histogram);
+		lua_setfield(L, -2, "histogram");
+		lua_setfield(L, -2, call_names[i]);
+	}
+	lua_setfield(L, -2, "calls");
+
+	if (reset) {
+		uint64_t last_end = frame.last_end;
+		memset(calls, 0, sizeof(calls));
+		memset(&frame, 0, sizeof(frame));
+		frame.last_end = last_end;
+	}
+	return 1;
+}
+
+// 生命周期 --------------------------------------------------------------------
+
+static SDL_WindowFlags sdl_configure(fln_app_state *appstate) {
+	return 0;
+}
+
+static bool init(fln_app_state *appstate) {
+	memset(calls, 0, sizeof(calls));
+	memset(&frame, 0, sizeof(frame));
+	return true;
+}
+
+static bool begin_drawing(fln_app_state *appstate) {
+	return true;
+}
+
+static bool end_drawing(fln_app_state *appstate) {
+	uint64_t now = SDL_GetPerformanceCounter();
+	// 调用发生在 iterate 和 draw 中，所以以帧末为界统计
+	for (int i = 0; i < CALL_COUNT; i++) {
+		call_stats *stats = &calls[i];
+		stats->histogram[bucket(stats->frame_count)]++;
+		stats->total_count += stats->frame_count;
+		if (stats->max_frame_count < stats->frame_count) {
+			stats->max_frame_count = stats->frame_count;
+		}
+		stats->last_frame_count = stats->frame_count;
+		stats->frame_count = 0;
+	}
+	last_frame_elements = submitted_elements;
+	submitted_elements = 0;
+	gpu_scope_depth = 0;
+	if (frame.last_end) {
+		uint64_t ticks = now - frame.last_end;
+		uint64_t micros = ticks * 1000000 / SDL_GetPerformanceFrequency();
+		frame.histogram[bucket(micros)]++;
+		frame.total_ticks += ticks;
+		if (frame.frames == 0 || frame.min_ticks > ticks) {
+			frame.min_ticks = ticks;
+		}
+		if (frame.max_ticks < ticks) {
+			frame.max_ticks = ticks;
+		}
+		frame.frames++;
+	}
+	frame.last_end = now;
+	return true;
+}
+
+static bool destroy_resource(fln_app_state *appstate) {
+	return true;
+}
+
+static void receive_window_events(fln_app_state *appstate, const SDL_Event *event) {
+}
+
+fln_gfx_backend fln_gfx_init_backend_null() {
+	fln_gfx_backend backend;
+	memset(&backend, 0, sizeof(backend));
+	backend.name = "null";
+	backend.sdl_configure = sdl_configure;
+	backend.init = init;
+	backend.begin_drawing = begin_drawing;
+	backend.end_drawing = end_drawing;
+	backend.destroy_resource = destroy_resource;
+	backend.receive_window_events = receive_window_events;
+	backend.l_pipeline = l_pipeline;
+	backend.l_pipeline_release = l_m_pipeline_release;
+	backend.l_pipeline_uniform = l_m_pipeline_uniform;
+	backend.l_pipeline_submit = l_m_pipeline_submit;
+	backend.l_pipeline_submit_instanced = l_m_pipeline_submit_instanced;
+	backend.l_mesh = l_mesh;
+	backend.l_mesh_release = l_m_mesh_release;
+	backend.l_texture2d = l_texture2d;
+	backend.l_texture2d_size = l_texture2d_size;
+	backend.l_texture2d_release = l_texture2d_release;
+	backend.l_glyph_atlas = l_glyph_atlas;
+	backend.l_text = l_text;
+	backend.l_text_release = l_m_text_release;
+	backend.l_target = l_target;
+	backend.l_target_texture = l_m_target_texture;
+	backend.l_target_size = l_m_target_size;
+	backend.l_target_clear = l_m_target_clear;
+	backend.l_target_release = l_m_target_release;
+	backend.l_render_to = l_render_to;
+	backend.l_dynamic_resolution = l_dynamic_resolution;
+	backend.l_resolution_scale = l_resolution_scale;
+	backend.l_gpu_begin = l_gpu_begin;
+	backend.l_gpu_end = l_gpu_end;
+	backend.l_gpu_times = l_gpu_times;
+	backend.l_capture = l_capture;
+	backend.l_stats = l_stats;
+	// 内置着色器的源码照常提供，脚本不需要区分后端
+	backend.shaders = fln_gfx_init_backend_ogl().shaders;
+	return backend;
+}
@@ -0,0 +1,14 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include "gfx_interface.h"
+
+// 空后端：接受所有图形调用并做同样的参数检查，但不做任何 GPU 工作
+// 只统计每种调用的次数和耗时，用于单独测量脚本和绑定层的 CPU 开销
+fln_gfx_backend fln_gfx_init_backend_null();
@@ -11,14 +11,22 @@
 #include <cglm/struct.h>
 #include <lauxlib.h>
 #include <lua.h>
+#include <string.h>
 #include <uthash.h>
 
 #include "data.h"
 #include "error.h"
 #include "gfx_interface.h"
+#include "image_codec.h"
+#include "image_ops.h"
+#include "job.h"
 #include "math.h"
 #include "memory.h"
 #include "opengl/glad.h"
+#include "profiler.h"
+#include "render_thread.h"
+#include "stats.h"
+#include "text.h"
 
 // OpenGL 的 Uniform 缓存
 typedef struct gfx_uniform_cache_entry {
@@ -31,6 +39,7 @@ typedef struct gfx_uniform_cache_entry {
 typedef struct gfx_pipeline {
 	GLuint shader_program;
 	gfx_uniform_cache_entry *uniform_cache;
+	bool blend;
 } gfx_pipeline;
 
 // OpenGL 的 Mesh 实现
@@ -46,8 +55,228 @@ typedef struct gfx_texture2d {
 	GLuint id;
 	int width;
 	int height;
+	fln_glyph_atlas *atlas; // 非空时表示这是字形图集的纹理，绑定前需要同步
+	unsigned int atlas_version;
 } gfx_texture2d;
 
+// 文字批次的 GPU 端对象，单独分配，使用渲染线程时只由渲染线程访问
+typedef struct gfx_text_gpu {
+	GLuint vao;
+	GLuint vbo;
+	GLuint ebo;
+	size_t vertices_capacity; // GPU 端缓冲区能容纳的顶点数
+	size_t quads_capacity; // 索引缓冲区能容纳的四边形数
+	size_t quads_count; // 已上传的四边形数
+} gfx_text_gpu;
+
+// OpenGL 的文字批次实现
+typedef struct gfx_text {
+	fln_text_buffer buffer; // 必须是第一个成员，与后端无关的方法会直接把 userdata 当作它使用
+	gfx_text_gpu *gpu; // 释放后为空
+	size_t quads; // 最近一次上传的四边形数（主线程一侧）
+} gfx_text;
+
+// OpenGL 的渲染目标实现
+// 颜色附件是普通的 fln.texture2d，保存在 userdata 的 user value 表中，生命周期由它们自己管理
+typedef struct gfx_target {
+	GLuint fbo;
+	GLuint depth_buffer; // 没有深度附件时为 0
+	int width;
+	int height;
+	int color_count;
+} gfx_target;
+
+// 绘制命令 --------------------------------------------------------------------
+// 帧内的 GL 调用都先整理成命令：直接模式下立即执行，使用渲染线程时录制到命令列表，
+// 由渲染线程在下一帧脚本执行的同时回放。需要返回 GL 对象的函数则在渲染线程上同步执行（RUN_ON_RENDER_THREAD）
+
+#define GFX_COMMAND_NAME_SIZE 32
+
+typedef enum gfx_command_type {
+	GFX_COMMAND_UNIFORM,
+	GFX_COMMAND_UNIFORM_TEXTURE,
+	GFX_COMMAND_ATLAS_UPLOAD,
+	GFX_COMMAND_DRAW,
+	GFX_COMMAND_TEXT_UPLOAD,
+	GFX_COMMAND_DRAW_TEXT,
+	GFX_COMMAND_RENDER_TO,
+	GFX_COMMAND_TARGET_CLEAR,
+	GFX_COMMAND_GPU_BEGIN,
+	GFX_COMMAND_GPU_END,
+	GFX_COMMAND_WINDOW_SIZE,
+	GFX_COMMAND_DELETE_PROGRAM,
+	GFX_COMMAND_DELETE_MESH,
+	GFX_COMMAND_DELETE_TEXTURE,
+	GFX_COMMAND_DELETE_TEXT,
+	GFX_COMMAND_DELETE_TARGET,
+} gfx_command_type;
+
+typedef struct gfx_command {
+	gfx_command_type type;
+	uint32_t size; // 附带数据的字节数
+	const void *data; // 附带的数据（像素、顶点），录制时复制到命令之后，直接执行时指向原数据
+	union {
+		struct {
+			GLuint program;
+			GLint location;
+			int count; // 1 ~ 4 为 float/vec，16 为 mat4
+			GLfloat values[16];
+		} uniform;
+		struct {
+			GLuint program;
+			GLint location;
+			GLuint texture;
+			int unit;
+		} uniform_texture;
+		struct {
+			GLuint texture;
+			int x, y, width, height;
+			int row_length;
+		} atlas_upload;
+		struct {
+			GLuint program;
+			bool blend;
+			GLuint vao;
+			GLsizei count;
+			GLsizei instances; // 0 表示不使用实例化
+		} draw;
+		struct {
+			gfx_text_gpu *gpu;
+			size_t count; // 顶点数
+		} text_upload;
+		struct {
+			GLuint program;
+			bool blend;
+			gfx_text_gpu *gpu;
+		} draw_text;
+		struct {
+			GLuint fbo; // 0 表示恢复到本帧的场景帧缓冲
+			int width, height;
+		} render_to;
+		struct {
+			GLuint fbo;
+			int color_count;
+			bool depth;
+			GLfloat color[4];
+		} target_clear;
+		struct {
+			char name[GFX_COMMAND_NAME_SIZE];
+		} gpu_begin;
+		struct {
+			int width, height;
+		} window_size;
+		struct {
+			GLuint program;
+		} delete_program;
+		struct {
+			GLuint vao, vbo, ebo;
+		} delete_mesh;
+		struct {
+			GLuint texture;
+		} delete_texture;
+		struct {
+			gfx_text_gpu *gpu;
+		} delete_text;
+		struct {
+			GLuint fbo, depth_buffer;
+		} delete_target;
+	};
+} gfx_command;
+
+static bool threaded = false; // 是否使用渲染线程
+static gfx_command immediate_command; // 直接模式下命令构造完就执行，只需要一条
+
+static const char *execute(const gfx_command *cmd);
+
+// data 为空时只预留空间，由调用者填写 cmd->data
+static gfx_command *command_push(gfx_command_type type, const void *data, size_t size) {
+	gfx_command *cmd;
+	if (threaded) {
+		cmd = fln_cmdlist_push(fln_render_thread_list(), sizeof(gfx_command) + size);
+		if (!cmd) {
+			return nullptr;
+		}
+		if (data && size) {
+			memcpy(cmd + 1, data, size);
+		}
+		cmd->data = cmd + 1;
+	} else {
+		cmd = &immediate_command;
+		cmd->data = data;
+	}
+	cmd->type = type;
+	cmd->size = (uint32_t)size;
+	return cmd;
+}
+
+static gfx_command *command_record(lua_State *L, gfx_command_type type, const void *data, size_t size) {
+	gfx_command *cmd = command_push(type, data, size);
+	if (!cmd) {
+		fln_error(L, "failed to record graphics command");
+	}
+	return cmd;
+}
+
+// 直接模式下立即执行并报告错误；录制的命令出错时只能在回放时打印警告
+static int command_submit(lua_State *L, const gfx_command *cmd) {
+	if (threaded) {
+		return 0;
+	}
+	const char *err = execute(cmd);
+	if (err) {
+		return fln_error(L, "%s", err);
+	}
+	return 0;
+}
+
+typedef struct render_call_data {
+	lua_State *L;
+	int status;
+} render_call_data;
+
+static void render_call_work(void *userdata) {
+	render_call_data *data = userdata;
+	data->status = lua_pcall(data->L, lua_gettop(data->L) - 1, LUA_MULTRET, 0);
+}
+
+// 在渲染线程上以原来的参数调用 func，主线程等待期间虚拟机只被渲染线程使用
+static int render_call(lua_State *L, lua_CFunction func) {
+	lua_pushcfunction(L, func);
+	lua_insert(L, 1);
+	render_call_data data = { L, LUA_OK };
+	fln_render_thread_call(render_call_work, &data);
+	if (data.status != LUA_OK) {
+		return lua_error(L);
+	}
+	return lua_gettop(L);
+}
+
+// 创建 GL 对象或读取渲染线程状态的函数在开头使用
+#define RUN_ON_RENDER_THREAD(L, func) \
+	if (threaded && !fln_render_thread_is_current()) { \
+		return render_call(L, func); \
+	}
+
+// 主线程一侧记录的绑定状态，只用于统计，与渲染线程的缓存（current_*）相互独立
+static GLuint emitted_program = 0;
+static const void *emitted_vao = nullptr; // mesh 或文字批次
+static int texture_unit_count = 0; // 用于记录纹理单元，以支持自动传入多个纹理
+static int emitted_scope_depth = 0;
+
+static void emit_program(GLuint program) {
+	if (emitted_program != program) {
+		emitted_program = program;
+		fln_counters.program_binds++;
+	}
+}
+
+static void emit_vao(const void *vao) {
+	if (emitted_vao != vao) {
+		emitted_vao = vao;
+		fln_counters.vao_binds++;
+	}
+}
+
 // tools ---------------------------------------------------------------------
 
 // 获取着色器日志（错误日志）
@@ -106,23 +335,64 @@ static int compile_shader(lua_State *L, GLuint shader, const char *src) {
 	return 1;
 }
 
+static bool add_uniform_cache(gfx_pipeline *pl, const char *name, GLuint location) {
+	gfx_uniform_cache_entry *entry = (gfx_uniform_cache_entry *)fln_alloc(sizeof(gfx_uniform_cache_entry));
+	if (!entry) {
+		return false;
+	}
+	strncpy(entry->name, name, sizeof(entry->name) - 1);
+	entry->name[sizeof(entry->name) - 1] = '\0';
+	entry->location = location;
+	HASH_ADD_STR(pl->uniform_cache, name, entry);
+	return true;
+}
+
+// 链接后把所有活动的 uniform 放进缓存，之后主线程查询位置时不需要调用 GL
+// 数组 uniform 的名字带有 "[0]"，同时以不带后缀的名字以及 "name[i]"（i < size）加入
+static void fill_uniform_cache(gfx_pipeline *pl) {
+	GLint count = 0;
+	glGetProgramiv(pl->shader_program, GL_ACTIVE_UNIFORMS, &count);
+	for (GLint i = 0; i < count; i++) {
+		char name[64];
+		GLsizei length = 0;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(pl->shader_program, i, sizeof(name), &length, &size, &type, name);
+		GLint location = glGetUniformLocation(pl->shader_program, name);
+		if (location < 0) {
+			continue; // uniform block 中的成员
+		}
+		add_uniform_cache(pl, name, location);
+		if (length > 3 && strcmp(name + length - 3, "[0]") == 0) {
+			name[length - 3] = '\0';
+			add_uniform_cache(pl, name, location);
+			// 其余元素的位置不一定连续，逐个查询
+			for (GLint element = 1; element < size; element++) {
+				char element_name[64];
+				if (snprintf(element_name, sizeof(element_name), "%s[%d]", name, (int)element) >= (int)sizeof(element_name)) {
+					break;
+				}
+				GLint element_location = glGetUniformLocation(pl->shader_program, element_name);
+				if (element_location >= 0) {
+					add_uniform_cache(pl, element_name, element_location);
+				}
+			}
+		}
+	}
+}
+
 // 获取 Uniform 位置（带缓存）
 static GLuint get_uniform_location_cache(gfx_pipeline *pl, const char *name) {
 	gfx_uniform_cache_entry *entry = nullptr;
 	HASH_FIND_STR(pl->uniform_cache, name, entry);
 	if (entry) {
 		return entry->location;
+	} else if (threaded) {
+		return -1; // 创建时已经放入了所有 uniform，主线程不能调用 GL
 	} else {
 		GLuint location = glGetUniformLocation(pl->shader_program, name);
-		if (location != -1) {
-			entry = (gfx_uniform_cache_entry *)fln_alloc(sizeof(gfx_uniform_cache_entry));
-			if (!entry) {
-				return -2; // 内存分配失败
-			}
-			strncpy(entry->name, name, sizeof(entry->name) - 1);
-			entry->name[sizeof(entry->name) - 1] = '\0';
-			entry->location = location;
-			HASH_ADD_STR(pl->uniform_cache, name, entry);
+		if (location != -1 && !add_uniform_cache(pl, name, location)) {
+			return -2; // 内存分配失败
 		}
 		return location;
 	}
@@ -137,6 +407,43 @@ static void clear_uniform_cache(gfx_pipeline *pl) {
 	}
 }
 
+// graphics.glyph_atlas() 创建的纹理，由注册表引用，提交文字时用来同步新生成的字形
+static gfx_texture2d *glyph_atlas_texture = nullptr;
+
+// 把字形图集的脏矩形上传到纹理
+// 录制时把脏矩形复制到命令里，图集之后的修改不影响这一帧
+static void sync_atlas_texture(lua_State *L, gfx_texture2d *texture) {
+	fln_glyph_atlas *atlas = texture->atlas;
+	if (texture->atlas_version == atlas->version) {
+		return;
+	}
+	if (atlas->dirty_x0 < atlas->dirty_x1 && atlas->dirty_y0 < atlas->dirty_y1) {
+		int width = atlas->dirty_x1 - atlas->dirty_x0;
+		int height = atlas->dirty_y1 - atlas->dirty_y0;
+		const unsigned char *pixels = atlas->pixels + (size_t)atlas->dirty_y0 * atlas->width + atlas->dirty_x0;
+		gfx_command *cmd;
+		if (threaded) {
+			cmd = command_record(L, GFX_COMMAND_ATLAS_UPLOAD, nullptr, (size_t)width * height);
+			for (int y = 0; y < height; y++) {
+				memcpy((unsigned char *)cmd->data + (size_t)y * width, pixels + (size_t)y * atlas->width, width);
+			}
+			cmd->atlas_upload.row_length = width;
+		} else {
+			cmd = command_record(L, GFX_COMMAND_ATLAS_UPLOAD, pixels, 0);
+			cmd->atlas_upload.row_length = atlas->width;
+		}
+		cmd->atlas_upload.texture = texture->id;
+		cmd->atlas_upload.x = atlas->dirty_x0;
+		cmd->atlas_upload.y = atlas->dirty_y0;
+		cmd->atlas_upload.width = width;
+		cmd->atlas_upload.height = height;
+		fln_counters.texture_upload_bytes += (uint64_t)width * height;
+		command_submit(L, cmd);
+	}
+	fln_font_atlas_clear_dirty(atlas);
+	texture->atlas_version = atlas->version;
+}
+
 // tools (end) ---------------------------------------------------------------------
 
 static int l_pipeline(lua_State *L) {
@@ -149,10 +456,11 @@ static int l_pipeline(lua_State *L) {
 		vsync = `bool`,  (TODO)
 		depth = `bool`,  (TODO)
 		cull = `bool`,  (TODO)
-		blend = `bool`  (TODO)
+		blend = `bool`  (alpha 混合)
 
 	}
 	*/
+	RUN_ON_RENDER_THREAD(L, l_pipeline);
 
 	lua_settop(L, 1);
 	luaL_checktype(L, 1, LUA_TTABLE);
@@ -163,6 +471,7 @@ static int l_pipeline(lua_State *L) {
 	// shaders --------------------------------------------------------
 
 	pl->shader_program = 0;
+	pl->uniform_cache = nullptr; // 一定不要忘了
 
 	const char *vsh_src;
 	const char *fsh_src;
@@ -214,70 +523,204 @@ static int l_pipeline(lua_State *L) {
 	glDeleteShader(vsh);
 	glDeleteShader(fsh);
 	pl->shader_program = program;
-	pl->uniform_cache = nullptr; // 一定不要忘了
+	fill_uniform_cache(pl);
+	lua_getfield(L, 1, "blend");
+	pl->blend = lua_toboolean(L, -1);
+	lua_pop(L, 1);
 	lua_settop(L, 2);
 	return 1;
 }
 
+// 渲染线程一侧（直接模式下即主线程）的 GL 状态缓存
 static GLuint current_shader_program = 0;
 static GLuint current_vao = 0;
-static int texture_unit_count = 0; // 用于记录纹理单元，以支持自动传入多个纹理
+static GLuint window_framebuffer = 0; // 最终显示的帧缓冲，headless 后端会替换成自己的 FBO
+static int window_width = 0;
+static int window_height = 0;
+static GLuint default_framebuffer = 0; // 本帧场景绘制到的帧缓冲，开启动态分辨率时是内部的 FBO
+static int default_width = 0;
+static int default_height = 0;
+static GLuint current_framebuffer = 0; // render_to 当前绑定的帧缓冲
+static bool current_blend = false;
+
+static void use_program(GLuint program) {
+	if (current_shader_program != program) {
+		glUseProgram(program);
+		current_shader_program = program;
+	}
+}
 
-static int l_m_pipeline_submit(lua_State *L) {
-	gfx_pipeline *pl = luaL_checkudata(L, 1, FLN_USERTYPE_PIPELINE);
-	if (pl->shader_program == 0) {
-		return fln_error(L, "invalid pipeline");
+static void bind_vao(GLuint vao) {
+	if (current_vao != vao) {
+		glBindVertexArray(vao);
+		current_vao = vao;
 	}
+}
 
-	if (current_shader_program != pl->shader_program) {
-		glUseProgram(pl->shader_program);
-		current_shader_program = pl->shader_program;
+static void apply_blend(bool blend) {
+	if (current_blend == blend) {
+		return;
+	}
+	if (blend) {
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	} else {
+		glDisable(GL_BLEND);
 	}
+	current_blend = blend;
+}
 
-	gfx_mesh *mesh = luaL_checkudata(L, 2, FLN_USERTYPE_MESH);
-	if (mesh->vertices_count == 0 || mesh->ebo == 0 || mesh->vao == 0 || mesh->vbo == 0) {
-		return fln_error(L, "invalid mesh");
+// 把文字批次的顶点上传到 GPU，容量不足时扩容并重建索引
+static bool upload_text(gfx_text_gpu *text, const fln_text_vertex *vertices, size_t count) {
+	size_t quads = count / 4;
+	if (text->vao == 0) {
+		glGenVertexArrays(1, &text->vao);
+		glGenBuffers(1, &text->vbo);
+		glGenBuffers(1, &text->ebo);
+		bind_vao(text->vao);
+		glBindBuffer(GL_ARRAY_BUFFER, text->vbo);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(fln_text_vertex), (void *)offsetof(fln_text_vertex, x));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(fln_text_vertex), (void *)offsetof(fln_text_vertex, u));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(fln_text_vertex), (void *)offsetof(fln_text_vertex, r));
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, text->ebo);
+	} else {
+		bind_vao(text->vao);
 	}
 
-	if (mesh->vao != current_vao) {
-		glBindVertexArray(mesh->vao);
-		current_vao = mesh->vao;
+	if (quads > text->quads_capacity) {
+		size_t capacity = text->quads_capacity ? text->quads_capacity : 64;
+		while (capacity < quads) {
+			capacity *= 2;
+		}
+		GLuint *indices = fln_alloc(capacity * 6 * sizeof(GLuint));
+		if (!indices) {
+			return false;
+		}
+		for (size_t i = 0; i < capacity; i++) {
+			GLuint base = (GLuint)(i * 4);
+			indices[i * 6 + 0] = base;
+			indices[i * 6 + 1] = base + 1;
+			indices[i * 6 + 2] = base + 2;
+			indices[i * 6 + 3] = base;
+			indices[i * 6 + 4] = base + 2;
+			indices[i * 6 + 5] = base + 3;
+		}
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, capacity * 6 * sizeof(GLuint), indices, GL_STATIC_DRAW);
+		if (!threaded) {
+			fln_counters.buffer_upload_bytes += capacity * 6 * sizeof(GLuint);
+		}
+		fln_free(indices);
+		text->quads_capacity = capacity;
 	}
 
-	glDrawElements(GL_TRIANGLES, mesh->vertices_count, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_ARRAY_BUFFER, text->vbo);
+	if (count > text->vertices_capacity) {
+		text->vertices_capacity = text->quads_capacity * 4;
+	}
+	// 每次都重新分配（orphan），避免等待上一帧对旧数据的绘制完成
+	glBufferData(GL_ARRAY_BUFFER, text->vertices_capacity * sizeof(fln_text_vertex), nullptr, GL_DYNAMIC_DRAW);
+	if (count) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(fln_text_vertex), vertices);
+	}
+	text->quads_count = quads;
+	return true;
+}
 
+static int submit_text(lua_State *L, gfx_pipeline *pl, gfx_text *text) {
+	if (!text->gpu) {
+		return fln_error(L, "invalid text");
+	}
+	if (!fln_text_buffer_prepare(&text->buffer)) {
+		return fln_error(L, "failed to lay out text");
+	}
+	// 排版可能生成了新的字形，在绘制之前上传，否则这一帧会采样到旧的像素
+	if (glyph_atlas_texture && glyph_atlas_texture->id != 0) {
+		sync_atlas_texture(L, glyph_atlas_texture);
+	}
+	if (text->buffer.dirty) {
+		const fln_text_buffer *buffer = &text->buffer;
+		gfx_command *cmd = command_record(L, GFX_COMMAND_TEXT_UPLOAD, buffer->vertices, buffer->count * sizeof(fln_text_vertex));
+		cmd->text_upload.gpu = text->gpu;
+		cmd->text_upload.count = buffer->count;
+		fln_counters.buffer_upload_bytes += buffer->count * sizeof(fln_text_vertex);
+		text->buffer.dirty = false;
+		text->quads = buffer->count / 4;
+		emitted_vao = text->gpu; // 上传时已经绑定
+		command_submit(L, cmd);
+	}
 	texture_unit_count = 0;
+	if (text->quads == 0) {
+		return 0;
+	}
+	emit_program(pl->shader_program);
+	emit_vao(text->gpu);
+	gfx_command *cmd = command_record(L, GFX_COMMAND_DRAW_TEXT, nullptr, 0);
+	cmd->draw_text.program = pl->shader_program;
+	cmd->draw_text.blend = pl->blend;
+	cmd->draw_text.gpu = text->gpu;
+	fln_counters.draw_calls++;
+	fln_counters.triangles += text->quads * 2;
+	return command_submit(L, cmd);
+}
 
-	return 0;
+static int submit_mesh(lua_State *L, gfx_pipeline *pl, gfx_mesh *mesh, lua_Integer instances) {
+	emit_program(pl->shader_program);
+	emit_vao(mesh);
+	gfx_command *cmd = command_record(L, GFX_COMMAND_DRAW, nullptr, 0);
+	cmd->draw.program = pl->shader_program;
+	cmd->draw.blend = pl->blend;
+	cmd->draw.vao = mesh->vao;
+	cmd->draw.count = mesh->vertices_count;
+	cmd->draw.instances = (GLsizei)instances;
+	fln_counters.draw_calls++;
+	if (instances > 0) {
+		fln_counters.triangles += (uint64_t)(mesh->vertices_count / 3) * instances;
+		fln_counters.instances += instances;
+	} else {
+		fln_counters.triangles += mesh->vertices_count / 3;
+	}
+	texture_unit_count = 0;
+	return command_submit(L, cmd);
 }
 
-static int l_m_pipeline_submit_instanced(lua_State *L) {
+static int l_m_pipeline_submit(lua_State *L) {
 	gfx_pipeline *pl = luaL_checkudata(L, 1, FLN_USERTYPE_PIPELINE);
-	lua_Integer num = luaL_checkinteger(L, 2);
 	if (pl->shader_program == 0) {
 		return fln_error(L, "invalid pipeline");
 	}
 
-	if (current_shader_program != pl->shader_program) {
-		glUseProgram(pl->shader_program);
-		current_shader_program = pl->shader_program;
+	// 文字批次：整批一次绘制
+	gfx_text *text = luaL_testudata(L, 2, FLN_USERTYPE_TEXT);
+	if (text) {
+		return submit_text(L, pl, text);
 	}
 
 	gfx_mesh *mesh = luaL_checkudata(L, 2, FLN_USERTYPE_MESH);
 	if (mesh->vertices_count == 0 || mesh->ebo == 0 || mesh->vao == 0 || mesh->vbo == 0) {
 		return fln_error(L, "invalid mesh");
 	}
+	return submit_mesh(L, pl, mesh, 0);
+}
 
-	if (mesh->vao != current_vao) {
-		glBindVertexArray(mesh->vao);
-		current_vao = mesh->vao;
+// pipeline:submit_instanced(mesh, count)
+static int l_m_pipeline_submit_instanced(lua_State *L) {
+	gfx_pipeline *pl = luaL_checkudata(L, 1, FLN_USERTYPE_PIPELINE);
+	if (pl->shader_program == 0) {
+		return fln_error(L, "invalid pipeline");
 	}
 
-	glDrawElementsInstanced(GL_TRIANGLES, mesh->vertices_count, GL_UNSIGNED_INT, nullptr, num);
-
-	texture_unit_count = 0;
-
-	return 0;
+	gfx_mesh *mesh = luaL_checkudata(L, 2, FLN_USERTYPE_MESH);
+	if (mesh->vertices_count == 0 || mesh->ebo == 0 || mesh->vao == 0 || mesh->vbo == 0) {
+		return fln_error(L, "invalid mesh");
+	}
+	lua_Integer num = luaL_checkinteger(L, 3);
+	if (num < 1) {
+		return fln_error(L, "invalid instance count: %d", (int)num);
+	}
+	return submit_mesh(L, pl, mesh, num);
 }
 
 static int l_m_pipeline_release(lua_State *L) {
@@ -285,18 +728,15 @@ static int l_m_pipeline_release(lua_State *L) {
 	if (pl->shader_program == 0) {
 		return 0;
 	}
-	// 缓存处理
-	if (current_shader_program == pl->shader_program) {
-		current_shader_program = 0;
+	if (emitted_program == pl->shader_program) {
+		emitted_program = 0;
 	}
-	if (current_vao == pl->shader_program) {
-		current_vao = 0;
-	}
-	glDeleteProgram(pl->shader_program);
+	gfx_command *cmd = command_record(L, GFX_COMMAND_DELETE_PROGRAM, nullptr, 0);
+	cmd->delete_program.program = pl->shader_program;
 	pl->shader_program = 0;
 	// 清理 Uniform 缓存
 	clear_uniform_cache(pl);
-	return 0;
+	return command_submit(L, cmd);
 }
 
 static int l_m_pipeline_uniform(lua_State *L) {
@@ -304,7 +744,6 @@ static int l_m_pipeline_uniform(lua_State *L) {
 	if (pl->shader_program == 0) {
 		return fln_error(L, "invalid pipeline");
 	}
-	glUseProgram(pl->shader_program);
 	const char *name = luaL_checkstring(L, 2);
 	GLuint location = get_uniform_location_cache(pl, name);
 	if (location == -1) {
@@ -313,7 +752,10 @@ static int l_m_pipeline_uniform(lua_State *L) {
 	else if (location == -2) {
 		return fln_error(L, "failed to allocate memory for uniform cache entry");
 	}
+	emit_program(pl->shader_program);
+	fln_counters.uniform_calls++;
 
+	gfx_command *cmd;
 	int size = lua_gettop(L) - 2; // 除去 self 和 uniform 名称，之后的参数都是要传入 uniform 的
 	if (size == 1 && lua_type(L, 3) == LUA_TUSERDATA) {
 		void *texture2d_test = luaL_testudata(L, 3, FLN_USERTYPE_TEXTURE2D);
@@ -321,83 +763,55 @@ static int l_m_pipeline_uniform(lua_State *L) {
 		if (transform_test) {
 			mat4 **transform = (mat4 **)transform_test;
 
-			if (transform && *transform) {
-				// glms_mat4_print(*transform, stdout);
-				glUniformMatrix4fv(location, 1, GL_FALSE, (const GLfloat *)*transform);
-			} else {
+			if (!transform || !*transform) {
 				return fln_error(L, "invalid transform");
 			}
+			cmd = command_record(L, GFX_COMMAND_UNIFORM, nullptr, 0);
+			cmd->uniform.count = 16;
+			memcpy(cmd->uniform.values, *transform, sizeof(cmd->uniform.values));
 		} else if (texture2d_test) {
 			if (texture_unit_count > 15) {
 				return fln_error(L, "the number of texture units has reached the maximum limit (%d)", texture_unit_count);
 			}
-
-			if (pl->shader_program == 0) {
-				return fln_error(L, "invalid pipeline");
-			}
-
-			if (current_shader_program != pl->shader_program) {
-				glUseProgram(pl->shader_program);
-			}
 			gfx_texture2d *texture = (gfx_texture2d *)texture2d_test;
-
-			GLuint location = get_uniform_location_cache(pl, name);
-			if (location == -1) {
-				return fln_error(L, "uniform '%s' not found", name);
+			if (texture->id == 0) {
+				return fln_error(L, "invalid texture");
 			}
-			else if (location == -2) {
-				return fln_error(L, "failed to allocate memory for uniform cache entry");
+			if (texture->atlas) {
+				sync_atlas_texture(L, texture);
 			}
-
-			glActiveTexture(GL_TEXTURE0 + texture_unit_count);
-			glBindTexture(GL_TEXTURE_2D, texture->id);
-			glUniform1i(location, texture_unit_count);
-			texture_unit_count++;
+			cmd = command_record(L, GFX_COMMAND_UNIFORM_TEXTURE, nullptr, 0);
+			cmd->uniform_texture.program = pl->shader_program;
+			cmd->uniform_texture.location = location;
+			cmd->uniform_texture.texture = texture->id;
+			cmd->uniform_texture.unit = texture_unit_count++;
+			fln_counters.texture_binds++;
+			return command_submit(L, cmd);
 		} else {
 			return fln_error(L, "invalid userdata");
 		}
-	} else if (size == 1 && lua_type(L, 3) == LUA_TNUMBER) {
-		glUniform1f(location, luaL_checknumber(L, 3));
-	}
-	else if (size == 2 && lua_type(L, 3) == LUA_TNUMBER && lua_type(L, 4) == LUA_TNUMBER) {
-		glUniform2f(location, luaL_checknumber(L, 3), luaL_checknumber(L, 4));
-	} else if (size == 3 && lua_type(L, 3) == LUA_TNUMBER && lua_type(L, 4) == LUA_TNUMBER && lua_type(L, 5) == LUA_TNUMBER) {
-		glUniform3f(location, luaL_checknumber(L, 3), luaL_checknumber(L, 4), luaL_checknumber(L, 5));
-	} else if (size == 4 && lua_type(L, 3) == LUA_TNUMBER && lua_type(L, 4) == LUA_TNUMBER && lua_type(L, 5) == LUA_TNUMBER && lua_type(L, 6) == LUA_TNUMBER) {
-		glUniform4f(location, luaL_checknumber(L, 3), luaL_checknumber(L, 4), luaL_checknumber(L, 5), luaL_checknumber(L, 6));
+	} else if (size >= 1 && size <= 4) {
+		GLfloat values[4];
+		for (int i = 0; i < size; i++) {
+			if (lua_type(L, 3 + i) != LUA_TNUMBER) {
+				return fln_error(L, "unsupported uniform arguments (invalid size or type)");
+			}
+			values[i] = (GLfloat)lua_tonumber(L, 3 + i);
+		}
+		cmd = command_record(L, GFX_COMMAND_UNIFORM, nullptr, 0);
+		cmd->uniform.count = size;
+		memcpy(cmd->uniform.values, values, size * sizeof(GLfloat));
 	} else {
 		return fln_error(L, "unsupported uniform arguments (invalid size or type)");
 	}
-	return 0;
+	cmd->uniform.program = pl->shader_program;
+	cmd->uniform.location = location;
+	return command_submit(L, cmd);
 }
 
-// 可能只会用在创建四边形三角形上（
-// data 能加载模型的说
-static int l_mesh(lua_State *L) {
-	lua_settop(L, 3);
-	const float *vertices = (const float *)luaL_checkstring(L, 1);
-	const size_t vertices_size = luaL_len(L, 1);
-	// const size_t vertices_count = vertices_size / sizeof(float);
-
-	const unsigned int *indices = (const unsigned int *)luaL_checkstring(L, 2);
-	const size_t indices_size = luaL_len(L, 2);
-	const size_t indices_count = indices_size / sizeof(unsigned int);
-
-	const unsigned int *attributes = (const unsigned int *)luaL_checkstring(L, 3);
-	const size_t attributes_size = luaL_len(L, 3);
-	const size_t attributes_count = attributes_size / sizeof(unsigned int);
-
-	const unsigned int *divisors = (const unsigned int *)luaL_optstring(L, 4, nullptr);
-	size_t divisors_size = 0;
-	size_t divisors_count = 0;
-	if (divisors) {
-		divisors_size = luaL_len(L, 4);
-		divisors_count = divisors_size / sizeof(unsigned int);
-		if (attributes_count != divisors_count) {
-			return fln_error(L, "attributes count must equal to divisors count");
-		}
-	}
-
+// 创建 VAO/VBO/EBO 并压入 mesh userdata
+// vertices 为交错的 float 数组，attributes 为每个属性的 float 数量
+static int create_mesh(lua_State *L, const void *vertices, size_t vertices_size, const void *indices, size_t indices_size, const unsigned int *attributes, size_t attributes_count, const unsigned int *divisors) {
 	GLuint vao, vbo, ebo;
 	glGenVertexArrays(1, &vao);
 	glGenBuffers(1, &vbo);
@@ -408,6 +822,7 @@ static int l_mesh(lua_State *L) {
 
 	glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, indices, GL_STATIC_DRAW);
+	fln_counters.buffer_upload_bytes += vertices_size + indices_size;
 
 	size_t stride = 0;
 	for (size_t i = 0; i < attributes_count; i++) {
@@ -429,44 +844,118 @@ static int l_mesh(lua_State *L) {
 	mesh->vao = vao;
 	mesh->vbo = vbo;
 	mesh->ebo = ebo;
-	mesh->vertices_count = indices_count;
+	mesh->vertices_count = indices_size / sizeof(unsigned int);
 	glBindVertexArray(0);
+	// 缓存处理
+	current_vao = 0;
+	emitted_vao = nullptr;
 	return 1;
 }
 
+// 从预处理好的 .flm 网格创建，数据直接从映射区域上传
+static int create_mesh_from_model(lua_State *L, const fln_model *model) {
+	const fln_mesh_blob_header *header = model->header;
+	if (!header) {
+		return fln_error(L, "invalid model");
+	}
+	const unsigned char *base = model->file.data;
+	return create_mesh(L, base + header->vertices_offset, header->vertices_size,
+			base + header->indices_offset, header->indices_size,
+			header->attributes, header->attributes_count,
+			fln_mesh_blob_has_divisors(header) ? header->divisors : nullptr);
+}
+
+// 可能只会用在创建四边形三角形上（
+// data 能加载模型的说
+static int l_mesh(lua_State *L) {
+	RUN_ON_RENDER_THREAD(L, l_mesh);
+	fln_model *model = luaL_testudata(L, 1, FLN_USERTYPE_MODEL);
+	if (model) {
+		return create_mesh_from_model(L, model);
+	}
+
+	lua_settop(L, 4);
+	const float *vertices = (const float *)luaL_checkstring(L, 1);
+	const size_t vertices_size = luaL_len(L, 1);
+	// const size_t vertices_count = vertices_size / sizeof(float);
+
+	const unsigned int *indices = (const unsigned int *)luaL_checkstring(L, 2);
+	const size_t indices_size = luaL_len(L, 2);
+
+	const unsigned int *attributes = (const unsigned int *)luaL_checkstring(L, 3);
+	const size_t attributes_size = luaL_len(L, 3);
+	const size_t attributes_count = attributes_size / sizeof(unsigned int);
+
+	const unsigned int *divisors = (const unsigned int *)luaL_optstring(L, 4, nullptr);
+	size_t divisors_size = 0;
+	size_t divisors_count = 0;
+	if (divisors) {
+		divisors_size = luaL_len(L, 4);
+		divisors_count = divisors_size / sizeof(unsigned int);
+		if (attributes_count != divisors_count) {
+			return fln_error(L, "attributes count must equal to divisors count");
+		}
+	}
+
+	return create_mesh(L, vertices, vertices_size, indices, indices_size, attributes, attributes_count, divisors);
+}
+
 static int l_m_mesh_release(lua_State *L) {
 	gfx_mesh *mesh = luaL_checkudata(L, -1, FLN_USERTYPE_MESH);
 	if (mesh->vertices_count == 0 || mesh->ebo == 0 || mesh->vao == 0 || mesh->vbo == 0) {
 		return 0;
 	}
-	glDeleteBuffers(1, &mesh->vbo);
+	if (emitted_vao == mesh) {
+		emitted_vao = nullptr;
+	}
+	gfx_command *cmd = command_record(L, GFX_COMMAND_DELETE_MESH, nullptr, 0);
+	cmd->delete_mesh.vao = mesh->vao;
+	cmd->delete_mesh.vbo = mesh->vbo;
+	cmd->delete_mesh.ebo = mesh->ebo;
 	mesh->vbo = 0;
-	glDeleteBuffers(1, &mesh->ebo);
 	mesh->ebo = 0;
-	glDeleteVertexArrays(1, &mesh->vao);
 	mesh->vao = 0;
 	mesh->vertices_count = 0;
-	return 0;
+	return command_submit(L, cmd);
 }
 
 static int l_texture2d(lua_State *L) {
+	RUN_ON_RENDER_THREAD(L, l_texture2d);
 	fln_image *image = luaL_checkudata(L, 1, FLN_USERTYPE_IMAGE);
 	if (!image->data) {
 		return fln_error(L, "invalid image data");
 	}
-	GLint format;
-	if (image->format == FLN_IMAGE_FORMAT_RGBA8) {
-		format = GL_RGBA;
-	}
-	else if (image->format == FLN_IMAGE_FORMAT_RGB8) {
-		format = GL_RGB;
-	}
-	else {
-		return fln_error(L, "invalid image format: %d", image->format);
-	}
 	if (image->width <= 0 || image->height <= 0) {
 		return fln_error(L, "invalid image size: %dx%d", image->width, image->height);
 	}
+	GLint internal_format;
+	GLenum format;
+	// 单通道和双通道通过 swizzle 在着色器中表现为灰度和灰度 + alpha
+	const GLint *swizzle = nullptr;
+	static const GLint swizzle_r[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+	static const GLint swizzle_rg[] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+	switch (image->format) {
+		case FLN_IMAGE_FORMAT_R8:
+			internal_format = GL_R8;
+			format = GL_RED;
+			swizzle = swizzle_r;
+			break;
+		case FLN_IMAGE_FORMAT_RG8:
+			internal_format = GL_RG8;
+			format = GL_RG;
+			swizzle = swizzle_rg;
+			break;
+		case FLN_IMAGE_FORMAT_RGB8:
+			internal_format = GL_RGB8;
+			format = GL_RGB;
+			break;
+		case FLN_IMAGE_FORMAT_RGBA8:
+			internal_format = GL_RGBA8;
+			format = GL_RGBA;
+			break;
+		default:
+			return fln_error(L, "invalid image format: %d", image->format);
+	}
 
 	GLuint texture;
 	glGenTextures(1, &texture);
@@ -477,17 +966,21 @@ static int l_texture2d(lua_State *L) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (swizzle) {
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
 
-	if (image->width % 4 != 0) {
-		if (image->width % 2 != 0) {
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-		} else {
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
-		}
-	} else {
+	// 行是紧密排列的，对齐取决于每行的字节数而不是宽度
+	size_t row_size = fln_image_row_size(image);
+	if (row_size % 4 == 0) {
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	} else if (row_size % 2 == 0) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	} else {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	}
-	glTexImage2D(GL_TEXTURE_2D, 0, format, image->width, image->height, 0, format, GL_UNSIGNED_BYTE, image->data);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image->width, image->height, 0, format, GL_UNSIGNED_BYTE, image->data);
+	fln_counters.texture_upload_bytes += row_size * image->height;
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -496,10 +989,56 @@ static int l_texture2d(lua_State *L) {
 	texture_data->id = texture;
 	texture_data->width = image->width;
 	texture_data->height = image->height;
+	texture_data->atlas = nullptr;
+	texture_data->atlas_version = 0;
 
 	return 1;
 }
 
+static int KEY_GLYPH_ATLAS = 0;
+
+// 字形图集只有一个，对应的纹理也只创建一次并保存在注册表里
+static int l_glyph_atlas(lua_State *L) {
+	if (lua_rawgetp(L, LUA_REGISTRYINDEX, &KEY_GLYPH_ATLAS) == LUA_TUSERDATA) {
+		return 1;
+	}
+	lua_pop(L, 1);
+	RUN_ON_RENDER_THREAD(L, l_glyph_atlas);
+	fln_glyph_atlas *atlas = fln_font_atlas();
+	if (!atlas) {
+		return fln_error(L, "failed to allocate glyph atlas");
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// 采样结果为 (1, 1, 1, coverage)，着色器里直接乘上颜色即可
+	const GLint swizzle[] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlas->width, atlas->height, 0, GL_RED, GL_UNSIGNED_BYTE, atlas->pixels);
+	fln_counters.texture_upload_bytes += (uint64_t)atlas->width * atlas->height;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	fln_font_atlas_clear_dirty(atlas);
+
+	gfx_texture2d *texture_data = lua_newuserdata(L, sizeof(gfx_texture2d));
+	luaL_setmetatable(L, FLN_USERTYPE_TEXTURE2D);
+	texture_data->id = texture;
+	texture_data->width = atlas->width;
+	texture_data->height = atlas->height;
+	texture_data->atlas = atlas;
+	texture_data->atlas_version = atlas->version;
+	glyph_atlas_texture = texture_data;
+	lua_pushvalue(L, -1);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &KEY_GLYPH_ATLAS);
+	return 1;
+}
+
 static int l_texture2d_size(lua_State *L) {
 	gfx_texture2d *texture = luaL_checkudata(L, 1, FLN_USERTYPE_TEXTURE2D);
 	lua_pushinteger(L, texture->width);
@@ -509,13 +1048,1138 @@ static int l_texture2d_size(lua_State *L) {
 
 static int l_texture2d_release(lua_State *L) {
 	gfx_texture2d *texture = luaL_checkudata(L, 1, FLN_USERTYPE_TEXTURE2D);
-	if (texture->id) {
-		glDeleteTextures(1, &texture->id);
-		texture->id = 0;
+	// 图集纹理缓存在注册表中，所有文字共用，释放后之后的文字都无法绘制
+	if (texture->atlas) {
+		return fln_error(L, "the glyph atlas texture cannot be released");
+	}
+	if (texture->id == 0) {
+		return 0;
+	}
+	gfx_command *cmd = command_record(L, GFX_COMMAND_DELETE_TEXTURE, nullptr, 0);
+	cmd->delete_texture.texture = texture->id;
+	texture->id = 0;
+	return command_submit(L, cmd);
+}
+
+static int l_text(lua_State *L) {
+	gfx_text *text = lua_newuserdata(L, sizeof(gfx_text));
+	fln_text_buffer_init(&text->buffer);
+	text->gpu = nullptr;
+	text->quads = 0;
+	luaL_setmetatable(L, FLN_USERTYPE_TEXT);
+	// GL 对象在第一次上传时创建
+	text->gpu = fln_calloc(1, sizeof(gfx_text_gpu));
+	if (!text->gpu) {
+		return fln_error(L, "bad alloc");
+	}
+	return 1;
+}
+
+static int l_m_text_release(lua_State *L) {
+	gfx_text *text = luaL_checkudata(L, 1, FLN_USERTYPE_TEXT);
+	fln_text_buffer_free(&text->buffer);
+	if (!text->gpu) {
+		return 0;
+	}
+	if (emitted_vao == text->gpu) {
+		emitted_vao = nullptr;
+	}
+	gfx_command *cmd = command_record(L, GFX_COMMAND_DELETE_TEXT, nullptr, 0);
+	cmd->delete_text.gpu = text->gpu;
+	text->gpu = nullptr;
+	text->quads = 0;
+	return command_submit(L, cmd);
+}
+
+// 渲染目标 --------------------------------------------------------------------
+
+static void bind_framebuffer(GLuint fbo, int width, int height) {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, width, height);
+	current_framebuffer = fbo;
+}
+
+static void bind_default_framebuffer(void) {
+	bind_framebuffer(default_framebuffer, default_width, default_height);
+}
+
+static const struct {
+	GLenum internal_format;
+	GLenum format;
+	GLenum type;
+} target_formats[] = {
+	[FLN_GFX_TARGET_RGBA8] = { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+	[FLN_GFX_TARGET_RGBA16F] = { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT },
+	[FLN_GFX_TARGET_RGBA32F] = { GL_RGBA32F, GL_RGBA, GL_FLOAT },
+	[FLN_GFX_TARGET_R8] = { GL_R8, GL_RED, GL_UNSIGNED_BYTE },
+	[FLN_GFX_TARGET_RG8] = { GL_RG8, GL_RG, GL_UNSIGNED_BYTE },
+	[FLN_GFX_TARGET_R16F] = { GL_R16F, GL_RED, GL_HALF_FLOAT },
+	[FLN_GFX_TARGET_R32F] = { GL_R32F, GL_RED, GL_FLOAT },
+};
+
+static int l_target(lua_State *L) {
+	RUN_ON_RENDER_THREAD(L, l_target);
+	fln_gfx_target_desc desc;
+	fln_gfx_check_target_desc(L, 1, &desc);
+
+	gfx_target *target = lua_newuserdata(L, sizeof(gfx_target));
+	target->fbo = 0;
+	target->depth_buffer = 0;
+	target->width = desc.width;
+	target->height = desc.height;
+	target->color_count = desc.color_count;
+	luaL_setmetatable(L, FLN_USERTYPE_TARGET);
+	int target_index = lua_gettop(L);
+
+	glGenFramebuffers(1, &target->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+
+	lua_createtable(L, desc.color_count, 0);
+	GLenum draw_buffers[FLN_GFX_TARGET_MAX_COLORS];
+	for (int i = 0; i < desc.color_count; i++) {
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, target_formats[desc.formats[i]].internal_format, desc.width, desc.height, 0, target_formats[desc.formats[i]].format, target_formats[desc.formats[i]].type, nullptr);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, id, 0);
+		draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+
+		gfx_texture2d *texture = lua_newuserdata(L, sizeof(gfx_texture2d));
+		luaL_setmetatable(L, FLN_USERTYPE_TEXTURE2D);
+		texture->id = id;
+		texture->width = desc.width;
+		texture->height = desc.height;
+		texture->atlas = nullptr;
+		texture->atlas_version = 0;
+		lua_rawseti(L, -2, i + 1);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	lua_setiuservalue(L, target_index, 1);
+	glDrawBuffers(desc.color_count, draw_buffers);
+
+	if (desc.depth) {
+		glGenRenderbuffers(1, &target->depth_buffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, target->depth_buffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, desc.width, desc.height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depth_buffer);
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, current_framebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		return fln_error(L, "incomplete framebuffer (0x%x)", status);
+	}
+	return 1;
+}
+
+static int l_m_target_texture(lua_State *L) {
+	gfx_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+	lua_Integer index = luaL_optinteger(L, 2, 1);
+	if (index < 1 || index > target->color_count) {
+		return fln_error(L, "invalid color attachment index: %d (1 - %d)", (int)index, target->color_count);
+	}
+	lua_getiuservalue(L, 1, 1);
+	lua_rawgeti(L, -1, index);
+	return 1;
+}
+
+static int l_m_target_size(lua_State *L) {
+	gfx_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+	lua_pushinteger(L, target->width);
+	lua_pushinteger(L, target->height);
+	return 2;
+}
+
+static int l_m_target_clear(lua_State *L) {
+	gfx_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+	if (target->fbo == 0) {
+		return fln_error(L, "invalid target");
+	}
+	gfx_command *cmd = command_record(L, GFX_COMMAND_TARGET_CLEAR, nullptr, 0);
+	cmd->target_clear.fbo = target->fbo;
+	cmd->target_clear.color_count = target->color_count;
+	cmd->target_clear.depth = target->depth_buffer != 0;
+	for (int i = 0; i < 4; i++) {
+		cmd->target_clear.color[i] = (GLfloat)luaL_optnumber(L, 2 + i, 0.0);
+	}
+	return command_submit(L, cmd);
+}
+
+static int l_m_target_release(lua_State *L) {
+	gfx_target *target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+	if (target->fbo == 0) {
+		return 0;
+	}
+	gfx_command *cmd = command_record(L, GFX_COMMAND_DELETE_TARGET, nullptr, 0);
+	cmd->delete_target.fbo = target->fbo;
+	cmd->delete_target.depth_buffer = target->depth_buffer;
+	target->fbo = 0;
+	target->depth_buffer = 0;
+	return command_submit(L, cmd);
+}
+
+// 之后的 submit 都绘制到 target 上，传入 nil 则恢复到窗口
+// 每帧开始时会自动恢复到窗口
+static int l_render_to(lua_State *L) {
+	gfx_target *target = nullptr;
+	if (!lua_isnoneornil(L, 1)) {
+		target = luaL_checkudata(L, 1, FLN_USERTYPE_TARGET);
+		if (target->fbo == 0) {
+			return fln_error(L, "invalid target");
+		}
+	}
+	gfx_command *cmd = command_record(L, GFX_COMMAND_RENDER_TO, nullptr, 0);
+	cmd->render_to.fbo = target ? target->fbo : 0;
+	cmd->render_to.width = target ? target->width : 0;
+	cmd->render_to.height = target ? target->height : 0;
+	return command_submit(L, cmd);
+}
+
+// 动态分辨率 ------------------------------------------------------------------
+// 场景先画到按 max 分配的内部 FBO 的左下角 scale 大小的区域，帧结束时再拉伸 blit 到窗口
+// scale 根据 GPU 帧时间（GL_TIME_ELAPSED 查询，非阻塞地读取几帧前的结果）调整
+
+#define FRAME_TIMER_QUERIES 4
+#define DYNRES_SETTLE_FRAMES 8 // 每次调整后至少等这么多帧，等新的尺寸反映到测量结果上
+
+static GLuint frame_queries[FRAME_TIMER_QUERIES];
+static bool frame_query_pending[FRAME_TIMER_QUERIES];
+static int frame_query_index = 0;
+static bool frame_query_active = false;
+static double gpu_frame_ms = 0.0; // 平滑后的 GPU 帧时间
+
+static struct {
+	bool enabled;
+	float budget_ms;
+	float min_scale;
+	float max_scale;
+	float scale;
+	int settle_frames;
+	GLuint fbo;
+	GLuint color_buffer;
+	GLuint depth_buffer;
+	int width; // 内部 FBO 的实际尺寸
+	int height;
+} dynres = {
+	.budget_ms = 1000.0f / 60.0f,
+	.min_scale = 0.5f,
+	.max_scale = 1.0f,
+	.scale = 1.0f,
+};
+
+static void dynres_release(void) {
+	if (dynres.fbo == 0) {
+		return;
+	}
+	glDeleteFramebuffers(1, &dynres.fbo);
+	glDeleteRenderbuffers(1, &dynres.color_buffer);
+	glDeleteRenderbuffers(1, &dynres.depth_buffer);
+	dynres.fbo = 0;
+	dynres.color_buffer = 0;
+	dynres.depth_buffer = 0;
+	dynres.width = 0;
+	dynres.height = 0;
+}
+
+static bool dynres_allocate(int width, int height) {
+	if (dynres.fbo && dynres.width == width && dynres.height == height) {
+		return true;
+	}
+	if (dynres.fbo == 0) {
+		glGenFramebuffers(1, &dynres.fbo);
+		glGenRenderbuffers(1, &dynres.color_buffer);
+		glGenRenderbuffers(1, &dynres.depth_buffer);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, dynres.color_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, dynres.depth_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, dynres.fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, dynres.color_buffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, dynres.depth_buffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, current_framebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		fln_warning("dynamic resolution: incomplete framebuffer %dx%d (0x%x)\n", width, height, status);
+		dynres_release();
+		return false;
+	}
+	dynres.width = width;
+	dynres.height = height;
+	return true;
+}
+
+static int scaled_size(int size, float scale) {
+	int result = (int)(size * scale + 0.5f);
+	return result > 0 ? result : 1;
+}
+
+// 帧开始时决定本帧的场景帧缓冲
+static void dynres_begin(void) {
+	default_framebuffer = window_framebuffer;
+	default_width = window_width;
+	default_height = window_height;
+	if (!dynres.enabled || window_width <= 0 || window_height <= 0) {
+		return;
+	}
+	if (!dynres_allocate(scaled_size(window_width, dynres.max_scale), scaled_size(window_height, dynres.max_scale))) {
+		dynres.enabled = false;
+		return;
+	}
+	default_framebuffer = dynres.fbo;
+	default_width = scaled_size(window_width, dynres.scale);
+	default_height = scaled_size(window_height, dynres.scale);
+}
+
+// 帧结束时拉伸到窗口
+static void dynres_resolve(void) {
+	if (default_framebuffer != window_framebuffer) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, default_framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, window_framebuffer);
+		GLenum filter = default_width == window_width && default_height == window_height ? GL_NEAREST : GL_LINEAR;
+		glBlitFramebuffer(0, 0, default_width, default_height, 0, 0, window_width, window_height, GL_COLOR_BUFFER_BIT, filter);
+	}
+	default_framebuffer = window_framebuffer;
+	default_width = window_width;
+	default_height = window_height;
+}
+
+// GPU 时间大致和像素数，也就是 scale 的平方成正比
+// 超出预算时直接按比例缩小，有余量时每次最多放大 10%，两个阈值之间不动以免来回抖动
+static void dynres_update(void) {
+	if (!dynres.enabled || gpu_frame_ms <= 0.0) {
+		return;
+	}
+	if (dynres.settle_frames > 0) {
+		dynres.settle_frames--;
+		return;
+	}
+	float scale = dynres.scale;
+	if (gpu_frame_ms > dynres.budget_ms * 0.95f) {
+		scale *= SDL_sqrtf(dynres.budget_ms * 0.9f / (float)gpu_frame_ms);
+	} else if (gpu_frame_ms < dynres.budget_ms * 0.75f) {
+		scale *= SDL_min(SDL_sqrtf(dynres.budget_ms * 0.85f / (float)gpu_frame_ms), 1.1f);
 	}
+	scale = SDL_clamp(scale, dynres.min_scale, dynres.max_scale);
+	if (SDL_fabsf(scale - dynres.scale) >= 0.01f) {
+		dynres.scale = scale;
+		dynres.settle_frames = DYNRES_SETTLE_FRAMES;
+	}
+}
+
+static void frame_timer_collect(int index) {
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(frame_queries[index], GL_QUERY_RESULT, &elapsed);
+	frame_query_pending[index] = false;
+	double ms = (double)elapsed / 1e6;
+	gpu_frame_ms = gpu_frame_ms > 0.0 ? gpu_frame_ms * 0.9 + ms * 0.1 : ms;
+	dynres_update();
+}
+
+static void frame_timer_begin(void) {
+	if (frame_queries[0] == 0) {
+		glGenQueries(FRAME_TIMER_QUERIES, frame_queries);
+	}
+	frame_query_active = false;
+	int index = frame_query_index;
+	if (frame_query_pending[index]) {
+		// GPU 落后太多，这一帧不计时也不等待
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(frame_queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return;
+		}
+		frame_timer_collect(index);
+	}
+	glBeginQuery(GL_TIME_ELAPSED, frame_queries[index]);
+	frame_query_active = true;
+}
+
+static void frame_timer_end(void) {
+	if (frame_query_active) {
+		glEndQuery(GL_TIME_ELAPSED);
+		frame_query_pending[frame_query_index] = true;
+		frame_query_index = (frame_query_index + 1) % FRAME_TIMER_QUERIES;
+		frame_query_active = false;
+	}
+	// 从最早发出的开始按顺序读取已完成的结果
+	for (int i = 0; i < FRAME_TIMER_QUERIES; i++) {
+		int index = (frame_query_index + i) % FRAME_TIMER_QUERIES;
+		if (!frame_query_pending[index]) {
+			continue;
+		}
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(frame_queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			break;
+		}
+		frame_timer_collect(index);
+	}
+}
+
+static void frame_timer_destroy(void) {
+	if (frame_query_active) {
+		glEndQuery(GL_TIME_ELAPSED);
+		frame_query_active = false;
+	}
+	if (frame_queries[0]) {
+		glDeleteQueries(FRAME_TIMER_QUERIES, frame_queries);
+		memset(frame_queries, 0, sizeof(frame_queries));
+	}
+	memset(frame_query_pending, 0, sizeof(frame_query_pending));
+}
+
+// graphics.dynamic_resolution(false | true | { enabled, budget, min, max })
+// budget 为每帧的 GPU 时间预算（毫秒），min 与 max 为缩放比例的范围
+static int l_dynamic_resolution(lua_State *L) {
+	RUN_ON_RENDER_THREAD(L, l_dynamic_resolution);
+	if (lua_isboolean(L, 1)) {
+		dynres.enabled = lua_toboolean(L, 1);
+	} else {
+		luaL_checktype(L, 1, LUA_TTABLE);
+		lua_getfield(L, 1, "enabled");
+		lua_getfield(L, 1, "budget");
+		lua_getfield(L, 1, "min");
+		lua_getfield(L, 1, "max");
+		bool enabled = lua_isnil(L, -4) ? true : lua_toboolean(L, -4);
+		float budget = (float)luaL_optnumber(L, -3, dynres.budget_ms);
+		float min_scale = (float)luaL_optnumber(L, -2, dynres.min_scale);
+		float max_scale = (float)luaL_optnumber(L, -1, dynres.max_scale);
+		lua_pop(L, 4);
+		if (budget <= 0.0f) {
+			return fln_error(L, "invalid frame budget: %f", budget);
+		}
+		if (min_scale < 0.1f || max_scale > 2.0f || min_scale > max_scale) {
+			return fln_error(L, "invalid scale range: [%f, %f] (must be within [0.1, 2])", min_scale, max_scale);
+		}
+		dynres.enabled = enabled;
+		dynres.budget_ms = budget;
+		dynres.min_scale = min_scale;
+		dynres.max_scale = max_scale;
+	}
+	dynres.scale = SDL_clamp(dynres.scale, dynres.min_scale, dynres.max_scale);
+	dynres.settle_frames = DYNRES_SETTLE_FRAMES; // 关闭后内部 FBO 在帧结束时释放
 	return 0;
 }
 
+// 返回当前的缩放比例和平滑后的 GPU 帧时间（毫秒）
+static int l_resolution_scale(lua_State *L) {
+	RUN_ON_RENDER_THREAD(L, l_resolution_scale);
+	lua_pushnumber(L, dynres.enabled ? dynres.scale : 1.0);
+	lua_pushnumber(L, gpu_frame_ms);
+	return 2;
+}
+
+// GPU 计时 --------------------------------------------------------------------
+// 脚本用 gpu_begin(name)/gpu_end() 包住若干 pass 或 submit，两端各插入一个 GL_TIMESTAMP 查询
+// （时间戳可以嵌套，也不和上面的 GL_TIME_ELAPSED 冲突）。每帧一组查询，共 GPU_SCOPE_FRAMES 组轮流使用，
+// 几帧之后结果可用时才读取；如果轮到的那组还没完成，这一帧的计时直接丢弃，不会等待 GPU
+
+#define GPU_SCOPE_FRAMES 4
+#define GPU_SCOPE_MAX_RECORDS 64 // 每帧最多的 scope 数
+#define GPU_SCOPE_MAX_NAMES 64
+#define GPU_SCOPE_MAX_DEPTH 16
+#define GPU_SCOPE_NAME_SIZE 32
+
+typedef struct gpu_scope_record {
+	int name;
+	int depth;
+	bool closed;
+} gpu_scope_record;
+
+typedef struct gpu_scope_frame {
+	GLuint queries[GPU_SCOPE_MAX_RECORDS * 2]; // 第 i 个 scope 的开始与结束分别是 2i 与 2i + 1
+	gpu_scope_record records[GPU_SCOPE_MAX_RECORDS];
+	int count;
+	GLuint last_query; // 本帧最后发出的时间戳查询，嵌套时外层的结束晚于最后一个 scope 的结束
+	bool pending;
+} gpu_scope_frame;
+
+typedef struct gpu_scope_stats {
+	char name[GPU_SCOPE_NAME_SIZE];
+	int depth;
+	double frame_ms; // 收集时累加，同名的 scope 在一帧内出现多次时合计
+	double last_ms;
+	double mean_ms;
+	double max_ms;
+	uint64_t frames;
+} gpu_scope_stats;
+
+static gpu_scope_frame scope_frames[GPU_SCOPE_FRAMES];
+static int scope_frame_index = 0;
+static bool scope_frame_active = false; // 本帧是否记录 scope
+static int scope_stack[GPU_SCOPE_MAX_DEPTH];
+static int scope_depth = 0;
+static gpu_scope_stats scope_stats[GPU_SCOPE_MAX_NAMES];
+static int scope_stats_count = 0;
+
+static int scope_name_index(const char *name) {
+	for (int i = 0; i < scope_stats_count; i++) {
+		if (strncmp(scope_stats[i].name, name, GPU_SCOPE_NAME_SIZE - 1) == 0) {
+			return i;
+		}
+	}
+	if (scope_stats_count == GPU_SCOPE_MAX_NAMES) {
+		return -1;
+	}
+	gpu_scope_stats *stats = &scope_stats[scope_stats_count];
+	memset(stats, 0, sizeof(*stats));
+	strncpy(stats->name, name, GPU_SCOPE_NAME_SIZE - 1);
+	stats->frame_ms = -1.0; // 负数表示收集的那一帧中没有出现
+	return scope_stats_count++;
+}
+
+static bool scope_frame_ready(gpu_scope_frame *frame) {
+	if (frame->count == 0) {
+		return true;
+	}
+	// 时间戳按提交顺序完成，最后发出的一个可用时整组都可用
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuiv(frame->last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+	return available;
+}
+
+static void scope_frame_collect(gpu_scope_frame *frame) {
+	for (int i = 0; i < frame->count; i++) {
+		gpu_scope_record *record = &frame->records[i];
+		if (!record->closed) {
+			continue;
+		}
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame->queries[i * 2], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame->queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+		gpu_scope_stats *stats = &scope_stats[record->name];
+		if (stats->frame_ms < 0.0) {
+			stats->frame_ms = 0.0;
+		}
+		stats->frame_ms += end > begin ? (double)(end - begin) / 1e6 : 0.0;
+		stats->depth = record->depth;
+	}
+	for (int i = 0; i < scope_stats_count; i++) {
+		gpu_scope_stats *stats = &scope_stats[i];
+		if (stats->frame_ms < 0.0) {
+			continue;
+		}
+		stats->last_ms = stats->frame_ms;
+		stats->mean_ms = stats->frames > 0 ? stats->mean_ms * 0.9 + stats->last_ms * 0.1 : stats->last_ms;
+		stats->max_ms = stats->last_ms > stats->max_ms ? stats->last_ms : stats->max_ms;
+		stats->frames++;
+		stats->frame_ms = -1.0;
+	}
+	frame->count = 0;
+	frame->pending = false;
+}
+
+static void scope_frame_begin(void) {
+	gpu_scope_frame *frame = &scope_frames[scope_frame_index];
+	if (frame->queries[0] == 0) {
+		glGenQueries(GPU_SCOPE_MAX_RECORDS * 2, frame->queries);
+	}
+	scope_depth = 0;
+	scope_frame_active = !frame->pending || scope_frame_ready(frame);
+	if (scope_frame_active && frame->pending) {
+		scope_frame_collect(frame);
+	}
+}
+
+static void scope_end(void) {
+	gpu_scope_frame *frame = &scope_frames[scope_frame_index];
+	int index = scope_stack[--scope_depth];
+	glQueryCounter(frame->queries[index * 2 + 1], GL_TIMESTAMP);
+	frame->last_query = frame->queries[index * 2 + 1];
+	frame->records[index].closed = true;
+}
+
+static void scope_frame_end(void) {
+	if (!scope_frame_active) {
+		return;
+	}
+	// 没有配对的 scope 在帧结束时关闭
+	while (scope_depth > 0) {
+		if (scope_stack[scope_depth - 1] < 0) {
+			scope_depth--;
+		} else {
+			scope_end();
+		}
+	}
+	gpu_scope_frame *frame = &scope_frames[scope_frame_index];
+	frame->pending = frame->count > 0;
+	scope_frame_index = (scope_frame_index + 1) % GPU_SCOPE_FRAMES;
+	scope_frame_active = false;
+	// 非阻塞地收集更早的帧
+	for (int i = 0; i < GPU_SCOPE_FRAMES; i++) {
+		gpu_scope_frame *oldest = &scope_frames[(scope_frame_index + i) % GPU_SCOPE_FRAMES];
+		if (!oldest->pending) {
+			continue;
+		}
+		if (!scope_frame_ready(oldest)) {
+			break;
+		}
+		scope_frame_collect(oldest);
+	}
+}
+
+static void scope_destroy(void) {
+	for (int i = 0; i < GPU_SCOPE_FRAMES; i++) {
+		gpu_scope_frame *frame = &scope_frames[i];
+		if (frame->queries[0]) {
+			glDeleteQueries(GPU_SCOPE_MAX_RECORDS * 2, frame->queries);
+		}
+		memset(frame, 0, sizeof(*frame));
+	}
+	scope_frame_active = false;
+	scope_depth = 0;
+}
+
+static void scope_push(const char *name) {
+	if (scope_depth == GPU_SCOPE_MAX_DEPTH) {
+		return;
+	}
+	gpu_scope_frame *frame = &scope_frames[scope_frame_index];
+	int name_index = scope_name_index(name);
+	if (!scope_frame_active || frame->count == GPU_SCOPE_MAX_RECORDS || name_index < 0) {
+		// 超出容量或本帧不记录时仍然入栈，保证 gpu_end 能配对
+		scope_stack[scope_depth++] = -1;
+		return;
+	}
+	int index = frame->count++;
+	frame->records[index].name = name_index;
+	frame->records[index].depth = scope_depth;
+	frame->records[index].closed = false;
+	glQueryCounter(frame->queries[index * 2], GL_TIMESTAMP);
+	frame->last_query = frame->queries[index * 2];
+	scope_stack[scope_depth++] = index;
+}
+
+static void scope_pop(void) {
+	if (scope_depth == 0) {
+		return;
+	}
+	if (scope_stack[scope_depth - 1] < 0) {
+		scope_depth--;
+		return;
+	}
+	scope_end();
+}
+
+// 只在 draw 回调中（begin_drawing 与 end_drawing 之间）记录
+// 配对在录制时检查，执行时的栈总是与之一致
+static int l_gpu_begin(lua_State *L) {
+	const char *name = luaL_checkstring(L, 1);
+	if (emitted_scope_depth == GPU_SCOPE_MAX_DEPTH) {
+		return fln_error(L, "gpu scopes nested too deeply (max %d)", GPU_SCOPE_MAX_DEPTH);
+	}
+	emitted_scope_depth++;
+	gfx_command *cmd = command_record(L, GFX_COMMAND_GPU_BEGIN, nullptr, 0);
+	strncpy(cmd->gpu_begin.name, name, GFX_COMMAND_NAME_SIZE - 1);
+	cmd->gpu_begin.name[GFX_COMMAND_NAME_SIZE - 1] = '\0';
+	return command_submit(L, cmd);
+}
+
+static int l_gpu_end(lua_State *L) {
+	if (emitted_scope_depth == 0) {
+		return fln_error(L, "gpu_end() without matching gpu_begin()");
+	}
+	emitted_scope_depth--;
+	return command_submit(L, command_record(L, GFX_COMMAND_GPU_END, nullptr, 0));
+}
+
+// 返回 { [name] = { time, mean, max, depth } } 以及整帧的 GPU 时间，单位为毫秒
+// time 是最近一次收集到的那一帧中的合计
+static int l_gpu_times(lua_State *L) {
+	RUN_ON_RENDER_THREAD(L, l_gpu_times);
+	lua_createtable(L, 0, scope_stats_count);
+	for (int i = 0; i < scope_stats_count; i++) {
+		const gpu_scope_stats *stats = &scope_stats[i];
+		if (stats->frames == 0) {
+			continue;
+		}
+		lua_createtable(L, 0, 4);
+		lua_pushnumber(L, stats->last_ms);
+		lua_setfield(L, -2, "time");
+		lua_pushnumber(L, stats->mean_ms);
+		lua_setfield(L, -2, "mean");
+		lua_pushnumber(L, stats->max_ms);
+		lua_setfield(L, -2, "max");
+		lua_pushinteger(L, stats->depth);
+		lua_setfield(L, -2, "depth");
+		lua_setfield(L, -2, stats->name);
+	}
+	lua_pushnumber(L, gpu_frame_ms);
+	return 2;
+}
+
+// 截图 ------------------------------------------------------------------------
+// 帧结束时 glReadPixels 到持久映射的 PBO 并插入 fence，之后每帧非阻塞地检查 fence；
+// 完成后由工作线程直接从映射内存中复制（同时上下翻转）并编码，主线程不做逐像素的工作
+
+#define CAPTURE_MAX_IN_FLIGHT 4
+
+typedef enum capture_state {
+	CAPTURE_IDLE,
+	CAPTURE_REQUESTED, // 等待本帧结束时读取
+	CAPTURE_IN_FLIGHT, // 已发出读取，等待 fence
+	CAPTURE_COPYING, // 工作线程正在读取映射内存
+} capture_state;
+
+typedef struct gfx_capture {
+	capture_state state;
+	GLuint pbo;
+	GLsizeiptr pbo_size;
+	const unsigned char *mapped;
+	GLsync fence;
+	int width;
+	int height;
+	char *path; // 写入 PNG 文件，或者
+	int callback_ref; // 以 fln.image 的形式回调
+	lua_State *L; // 虚拟机关闭后为空
+	fln_job *job;
+	fln_image image;
+	const char *err;
+	bool ok;
+} gfx_capture;
+
+static gfx_capture captures[CAPTURE_MAX_IN_FLIGHT];
+
+static void capture_reset(gfx_capture *capture) {
+	if (capture->L && capture->callback_ref != LUA_NOREF) {
+		luaL_unref(capture->L, LUA_REGISTRYINDEX, capture->callback_ref);
+	}
+	capture->callback_ref = LUA_NOREF;
+	fln_free(capture->path);
+	capture->path = nullptr;
+	capture->job = nullptr;
+	capture->state = CAPTURE_IDLE;
+}
+
+static void capture_work(void *userdata) {
+	gfx_capture *capture = userdata;
+	size_t row = (size_t)capture->width * 4;
+	unsigned char *pixels = fln_alloc(row * capture->height);
+	capture->image.width = capture->width;
+	capture->image.height = capture->height;
+	capture->image.format = FLN_IMAGE_FORMAT_RGBA8;
+	capture->image.data = pixels;
+	if (!pixels) {
+		capture->ok = false;
+		capture->err = "bad alloc";
+		return;
+	}
+	// OpenGL 的原点在左下角
+	for (int y = 0; y < capture->height; y++) {
+		memcpy(pixels + row * y, capture->mapped + row * (capture->height - 1 - y), row);
+	}
+	capture->ok = true;
+	if (capture->path) {
+		capture->ok = fln_image_write_png(&capture->image, capture->path, &capture->err);
+	}
+}
+
+// 失败时回调收到 nil 和错误信息
+static void capture_done(void *userdata) {
+	gfx_capture *capture = userdata;
+	lua_State *L = capture->L;
+	if (!capture->ok && L && capture->callback_ref != LUA_NOREF) {
+		lua_rawgeti(L, LUA_REGISTRYINDEX, capture->callback_ref);
+		lua_pushnil(L);
+		lua_pushstring(L, capture->err);
+		fln_free(capture->image.data);
+		capture->image.data = nullptr;
+		capture_reset(capture);
+		if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+			printf("(in capture callback) lua: %s\n", lua_tostring(L, -1));
+			lua_pop(L, 1);
+		}
+		return;
+	}
+	if (capture->path || !L || !capture->ok) {
+		if (!capture->ok) {
+			fln_warning("failed to capture frame: %s\n", capture->err);
+		}
+		fln_free(capture->image.data);
+		capture->image.data = nullptr;
+		capture_reset(capture);
+		return;
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, capture->callback_ref);
+	fln_image *image = lua_newuserdata(L, sizeof(fln_image));
+	luaL_setmetatable(L, FLN_USERTYPE_IMAGE);
+	*image = capture->image; // 所有权交给 Lua
+	capture->image.data = nullptr;
+	capture_reset(capture);
+	if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+		printf("(in capture callback) lua: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
+static void capture_skip(void *userdata) {
+}
+
+// 还没有读取就失败了：同样经过任务系统，在下一帧开始时的 fln_job_poll 中报告，不在帧结束的 GL 工作中间调用 Lua
+static void capture_fail(gfx_capture *capture, const char *err) {
+	capture->state = CAPTURE_COPYING;
+	capture->image.data = nullptr;
+	capture->err = err;
+	capture->ok = false;
+	capture->job = fln_job_submit(capture_skip, capture_done, capture);
+	if (!capture->job) {
+		fln_warning("failed to capture frame: %s\n", err);
+		capture_reset(capture);
+	}
+}
+
+// graphics.capture(path | function(image, err) end) -> bool
+// 返回 false 表示同时进行的截图太多
+static int l_capture(lua_State *L) {
+	if (threaded) {
+		// 完成回调需要在主线程上轮询 fence，目前只支持直接模式
+		fln_warning("graphics.capture() is not supported with --render-thread\n");
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	gfx_capture *capture = nullptr;
+	for (int i = 0; i < CAPTURE_MAX_IN_FLIGHT; i++) {
+		if (captures[i].state == CAPTURE_IDLE) {
+			capture = &captures[i];
+			break;
+		}
+	}
+	if (!capture) {
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	capture->callback_ref = LUA_NOREF;
+	capture->path = nullptr;
+	if (lua_type(L, 1) == LUA_TFUNCTION) {
+		lua_pushvalue(L, 1);
+		capture->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	} else {
+		size_t len;
+		const char *path = luaL_checklstring(L, 1, &len);
+		capture->path = fln_alloc(len + 1);
+		if (!capture->path) {
+			return fln_error(L, "bad alloc");
+		}
+		memcpy(capture->path, path, len + 1);
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	capture->L = lua_tothread(L, -1);
+	lua_pop(L, 1);
+	capture->state = CAPTURE_REQUESTED;
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+static void capture_read(gfx_capture *capture, int width, int height) {
+	GLsizeiptr size = (GLsizeiptr)width * height * 4;
+	if (capture->pbo_size != size) {
+		// 不可变存储，大小变化时只能重建
+		if (capture->pbo) {
+			glDeleteBuffers(1, &capture->pbo);
+		}
+		glGenBuffers(1, &capture->pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo);
+		const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, flags);
+		capture->mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+		capture->pbo_size = size;
+	} else {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo);
+	}
+	if (!capture->mapped) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		capture_fail(capture, "failed to map capture buffer");
+		return;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	capture->width = width;
+	capture->height = height;
+	capture->state = CAPTURE_IN_FLIGHT;
+}
+
+// 非阻塞地检查已发出的读取
+static void capture_poll(void) {
+	for (int i = 0; i < CAPTURE_MAX_IN_FLIGHT; i++) {
+		gfx_capture *capture = &captures[i];
+		if (capture->state != CAPTURE_IN_FLIGHT) {
+			continue;
+		}
+		GLenum status = glClientWaitSync(capture->fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			continue;
+		}
+		glDeleteSync(capture->fence);
+		capture->fence = nullptr;
+		capture->state = CAPTURE_COPYING;
+		capture->image.data = nullptr;
+		capture->err = nullptr;
+		capture->ok = false;
+		capture->job = fln_job_submit(capture_work, capture_done, capture);
+		if (!capture->job) {
+			capture_reset(capture);
+		}
+	}
+}
+
+// 帧结束、交换缓冲之前调用
+static void capture_issue(fln_app_state *appstate) {
+	int width = 0, height = 0;
+	for (int i = 0; i < CAPTURE_MAX_IN_FLIGHT; i++) {
+		gfx_capture *capture = &captures[i];
+		if (capture->state != CAPTURE_REQUESTED) {
+			continue;
+		}
+		if (width == 0) {
+			SDL_GetWindowSizeInPixels(appstate->window, &width, &height);
+		}
+		if (width <= 0 || height <= 0) {
+			capture_fail(capture, "window has no pixels");
+			continue;
+		}
+		capture_read(capture, width, height);
+	}
+}
+
+// 退出时 Lua 虚拟机已经关闭：不再回调，等工作线程用完映射内存后释放 GL 对象
+static void capture_destroy(void) {
+	for (int i = 0; i < CAPTURE_MAX_IN_FLIGHT; i++) {
+		gfx_capture *capture = &captures[i];
+		capture->L = nullptr;
+		if (capture->state == CAPTURE_COPYING && capture->job) {
+			fln_job_wait(capture->job);
+		}
+		if (capture->fence) {
+			glDeleteSync(capture->fence);
+			capture->fence = nullptr;
+		}
+		if (capture->pbo) {
+			glDeleteBuffers(1, &capture->pbo); // 删除时会自动解除映射
+			capture->pbo = 0;
+			capture->pbo_size = 0;
+			capture->mapped = nullptr;
+		}
+		capture_reset(capture);
+	}
+}
+
+// 命令执行 --------------------------------------------------------------------
+
+static const char *execute(const gfx_command *cmd) {
+	switch (cmd->type) {
+		case GFX_COMMAND_UNIFORM: {
+			const GLfloat *v = cmd->uniform.values;
+			use_program(cmd->uniform.program);
+			switch (cmd->uniform.count) {
+				case 1:
+					glUniform1f(cmd->uniform.location, v[0]);
+					break;
+				case 2:
+					glUniform2f(cmd->uniform.location, v[0], v[1]);
+					break;
+				case 3:
+					glUniform3f(cmd->uniform.location, v[0], v[1], v[2]);
+					break;
+				case 4:
+					glUniform4f(cmd->uniform.location, v[0], v[1], v[2], v[3]);
+					break;
+				case 16:
+					glUniformMatrix4fv(cmd->uniform.location, 1, GL_FALSE, v);
+					break;
+			}
+			break;
+		}
+		case GFX_COMMAND_UNIFORM_TEXTURE:
+			use_program(cmd->uniform_texture.program);
+			glActiveTexture(GL_TEXTURE0 + cmd->uniform_texture.unit);
+			glBindTexture(GL_TEXTURE_2D, cmd->uniform_texture.texture);
+			glUniform1i(cmd->uniform_texture.location, cmd->uniform_texture.unit);
+			break;
+		case GFX_COMMAND_ATLAS_UPLOAD:
+			glBindTexture(GL_TEXTURE_2D, cmd->atlas_upload.texture);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, cmd->atlas_upload.row_length);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, cmd->atlas_upload.x, cmd->atlas_upload.y, cmd->atlas_upload.width, cmd->atlas_upload.height,
+					GL_RED, GL_UNSIGNED_BYTE, cmd->data);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			break;
+		case GFX_COMMAND_DRAW:
+			use_program(cmd->draw.program);
+			apply_blend(cmd->draw.blend);
+			bind_vao(cmd->draw.vao);
+			if (cmd->draw.instances > 0) {
+				glDrawElementsInstanced(GL_TRIANGLES, cmd->draw.count, GL_UNSIGNED_INT, nullptr, cmd->draw.instances);
+			} else {
+				glDrawElements(GL_TRIANGLES, cmd->draw.count, GL_UNSIGNED_INT, nullptr);
+			}
+			break;
+		case GFX_COMMAND_TEXT_UPLOAD:
+			if (!upload_text(cmd->text_upload.gpu, cmd->data, cmd->text_upload.count)) {
+				return "failed to upload text vertices";
+			}
+			break;
+		case GFX_COMMAND_DRAW_TEXT: {
+			const gfx_text_gpu *gpu = cmd->draw_text.gpu;
+			if (gpu->quads_count == 0) {
+				break;
+			}
+			use_program(cmd->draw_text.program);
+			apply_blend(cmd->draw_text.blend);
+			bind_vao(gpu->vao);
+			glDrawElements(GL_TRIANGLES, (GLsizei)(gpu->quads_count * 6), GL_UNSIGNED_INT, nullptr);
+			break;
+		}
+		case GFX_COMMAND_RENDER_TO:
+			if (cmd->render_to.fbo) {
+				bind_framebuffer(cmd->render_to.fbo, cmd->render_to.width, cmd->render_to.height);
+			} else {
+				bind_default_framebuffer();
+			}
+			break;
+		case GFX_COMMAND_TARGET_CLEAR:
+			// 直接清除指定的帧缓冲，不影响当前绑定
+			glBindFramebuffer(GL_FRAMEBUFFER, cmd->target_clear.fbo);
+			for (int i = 0; i < cmd->target_clear.color_count; i++) {
+				glClearBufferfv(GL_COLOR, i, cmd->target_clear.color);
+			}
+			if (cmd->target_clear.depth) {
+				glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, current_framebuffer);
+			break;
+		case GFX_COMMAND_GPU_BEGIN:
+			scope_push(cmd->gpu_begin.name);
+			break;
+		case GFX_COMMAND_GPU_END:
+			scope_pop();
+			break;
+		case GFX_COMMAND_WINDOW_SIZE:
+			fln_gfx_ogl_set_window_framebuffer(window_framebuffer, cmd->window_size.width, cmd->window_size.height);
+			break;
+		case GFX_COMMAND_DELETE_PROGRAM:
+			if (current_shader_program == cmd->delete_program.program) {
+				current_shader_program = 0;
+			}
+			glDeleteProgram(cmd->delete_program.program);
+			break;
+		case GFX_COMMAND_DELETE_MESH:
+			if (current_vao == cmd->delete_mesh.vao) {
+				current_vao = 0;
+			}
+			glDeleteBuffers(1, &cmd->delete_mesh.vbo);
+			glDeleteBuffers(1, &cmd->delete_mesh.ebo);
+			glDeleteVertexArrays(1, &cmd->delete_mesh.vao);
+			break;
+		case GFX_COMMAND_DELETE_TEXTURE:
+			glDeleteTextures(1, &cmd->delete_texture.texture);
+			break;
+		case GFX_COMMAND_DELETE_TEXT: {
+			gfx_text_gpu *gpu = cmd->delete_text.gpu;
+			if (gpu->vao) {
+				if (current_vao == gpu->vao) {
+					current_vao = 0;
+				}
+				glDeleteBuffers(1, &gpu->vbo);
+				glDeleteBuffers(1, &gpu->ebo);
+				glDeleteVertexArrays(1, &gpu->vao);
+			}
+			fln_free(gpu);
+			break;
+		}
+		case GFX_COMMAND_DELETE_TARGET:
+			if (current_framebuffer == cmd->delete_target.fbo) {
+				bind_default_framebuffer();
+			}
+			glDeleteFramebuffers(1, &cmd->delete_target.fbo);
+			if (cmd->delete_target.depth_buffer) {
+				glDeleteRenderbuffers(1, &cmd->delete_target.depth_buffer);
+			}
+			break;
+	}
+	return nullptr;
+}
+
+// 回放录制的命令，window_size 为 true 时只执行窗口尺寸的变化，否则执行其余的命令
+static void replay(const fln_cmdlist *list, bool window_size) {
+	size_t offset = 0;
+	while (offset < list->size) {
+		const gfx_command *cmd = (const gfx_command *)(list->data + offset);
+		offset += FLN_CMDLIST_ALIGN(sizeof(gfx_command) + cmd->size);
+		if ((cmd->type == GFX_COMMAND_WINDOW_SIZE) != window_size) {
+			continue;
+		}
+		const char *err = execute(cmd);
+		if (err) {
+			fln_warning("(in render thread) %s\n", err);
+		}
+	}
+}
+
+// 内置着色器 ------------------------------------------------------------------
+
+// 文字顶点格式：position(vec2) uv(vec2) color(vec4)
+static const char text_vertex_shader[] =
+		"#version 460 core\n"
+		"layout(location = 0) in vec2 a_position;\n"
+		"layout(location = 1) in vec2 a_uv;\n"
+		"layout(location = 2) in vec4 a_color;\n"
+		"uniform mat4 u_transform;\n"
+		"out vec2 v_uv;\n"
+		"out vec4 v_color;\n"
+		"void main() {\n"
+		"	v_uv = a_uv;\n"
+		"	v_color = a_color;\n"
+		"	gl_Position = u_transform * vec4(a_position, 0.0, 1.0);\n"
+		"}\n";
+
+// SDF 文字：边缘在 0.5，u_outline_width 为距离场单位的描边宽度（0 ~ 0.5）
+// 用 fwidth 做抗锯齿，所以任意缩放、旋转都能保持清晰
+static const char sdf_text_fragment_shader[] =
+		"#version 460 core\n"
+		"in vec2 v_uv;\n"
+		"in vec4 v_color;\n"
+		"uniform sampler2D u_atlas;\n"
+		"uniform float u_outline_width;\n"
+		"uniform vec4 u_outline_color;\n"
+		"out vec4 frag_color;\n"
+		"void main() {\n"
+		"	float d = texture(u_atlas, v_uv).a;\n"
+		"	float w = max(fwidth(d), 1e-4);\n"
+		"	float fill = smoothstep(0.5 - w, 0.5 + w, d);\n"
+		"	float edge = 0.5 - u_outline_width;\n"
+		"	float shape = smoothstep(edge - w, edge + w, d);\n"
+		"	vec4 color = mix(u_outline_color, v_color, fill);\n"
+		"	frag_color = vec4(color.rgb, color.a * shape);\n"
+		"}\n";
+
+// 普通位图文字：图集的 alpha 即覆盖率
+static const char text_fragment_shader[] =
+		"#version 460 core\n"
+		"in vec2 v_uv;\n"
+		"in vec4 v_color;\n"
+		"uniform sampler2D u_atlas;\n"
+		"out vec4 frag_color;\n"
+		"void main() {\n"
+		"	frag_color = vec4(v_color.rgb, v_color.a * texture(u_atlas, v_uv).a);\n"
+		"}\n";
+
+static const fln_gfx_shader_source builtin_shaders[] = {
+	{ "text", text_vertex_shader, text_fragment_shader },
+	{ "sdf_text", text_vertex_shader, sdf_text_fragment_shader },
+	{ nullptr, nullptr, nullptr }
+};
+
 static SDL_WindowFlags sdl_configure(fln_app_state *appstate) {
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
@@ -524,6 +2188,23 @@ static SDL_WindowFlags sdl_configure(fln_app_state *appstate) {
 	return SDL_WINDOW_OPENGL;
 }
 
+static void render_frame(const fln_cmdlist *list, void *userdata);
+
+// GL 上下文同一时间只能在一个线程上生效，使用渲染线程时交给它
+static bool render_init(void *userdata) {
+	fln_app_state *appstate = userdata;
+	if (!SDL_GL_MakeCurrent(appstate->window, appstate->ogl_context)) {
+		printf("failed to call SDL_GL_MakeCurrent() on render thread: %s\n", SDL_GetError());
+		return false;
+	}
+	return true;
+}
+
+static void render_quit(void *userdata) {
+	fln_app_state *appstate = userdata;
+	SDL_GL_MakeCurrent(appstate->window, nullptr);
+}
+
 static bool init(fln_app_state *appstate) {
 	appstate->ogl_context = SDL_GL_CreateContext(appstate->window);
 	if (!appstate->ogl_context) {
@@ -538,17 +2219,42 @@ static bool init(fln_app_state *appstate) {
 		printf("failed to call gladLoadGLLoader()\n");
 		return false;
 	}
+	SDL_GetWindowSizeInPixels(appstate->window, &window_width, &window_height);
+	default_width = window_width;
+	default_height = window_height;
 	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+	if (appstate->render_thread) {
+		SDL_GL_MakeCurrent(appstate->window, nullptr);
+		const fln_render_thread_desc desc = { render_init, render_frame, render_quit, appstate };
+		threaded = fln_render_thread_start(&desc);
+		if (!threaded) {
+			printf("render thread is not available, rendering on the main thread\n");
+			SDL_GL_MakeCurrent(appstate->window, appstate->ogl_context);
+		}
+	}
 	return true;
 }
 
+// 帧开始时的 GL 工作，使用渲染线程时在回放之前执行
+static void begin_frame(void) {
+	capture_poll();
+	dynres_begin();
+	bind_default_framebuffer();
+	glClear(GL_COLOR_BUFFER_BIT | (default_framebuffer == dynres.fbo ? GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT : 0));
+	frame_timer_begin();
+	scope_frame_begin();
+}
+
 static bool begin_drawing(fln_app_state *appstate) {
-	glClear(GL_COLOR_BUFFER_BIT);
+	texture_unit_count = 0;
+	emitted_scope_depth = 0;
+	if (!threaded) {
+		begin_frame();
+	}
 	return true;
 }
 
-static bool end_drawing(fln_app_state *appstate) {
-	SDL_GL_SwapWindow(appstate->window);
+static bool check_error(void) {
 	int err = glGetError();
 	if (err != GL_NO_ERROR) {
 		printf("OpenGL error: %d\n", err);
@@ -557,29 +2263,148 @@ static bool end_drawing(fln_app_state *appstate) {
 	return true;
 }
 
+// 场景画完后的共同处理，之后窗口的帧缓冲保持绑定
+static void finish_frame(fln_app_state *appstate) {
+	scope_frame_end();
+	frame_timer_end();
+	dynres_resolve();
+	bind_default_framebuffer();
+	if (!dynres.enabled) {
+		dynres_release();
+	}
+	capture_issue(appstate);
+}
+
+static bool swap_window(fln_app_state *appstate) {
+	finish_frame(appstate);
+	FLN_ZONE_BEGIN("swap");
+	SDL_GL_SwapWindow(appstate->window);
+	FLN_ZONE_END();
+	return check_error();
+}
+
+// 在渲染线程上回放一帧，与主线程的下一帧并行
+static void render_frame(const fln_cmdlist *list, void *userdata) {
+	fln_app_state *appstate = userdata;
+	// 窗口尺寸的变化在帧开始之前生效
+	replay(list, true);
+	begin_frame();
+	replay(list, false);
+	swap_window(appstate);
+}
+
+static bool end_drawing(fln_app_state *appstate) {
+	if (threaded) {
+		// 等待上一帧回放完成后交出本帧，交换缓冲也在渲染线程上进行
+		fln_render_thread_submit();
+		return true;
+	}
+	return swap_window(appstate);
+}
+
+bool fln_gfx_ogl_end_offscreen_frame(fln_app_state *appstate) {
+	finish_frame(appstate);
+	return check_error();
+}
+
+void fln_gfx_ogl_set_window_framebuffer(unsigned int fbo, int width, int height) {
+	bool is_window = default_framebuffer == window_framebuffer;
+	window_framebuffer = fbo;
+	window_width = width;
+	window_height = height;
+	if (is_window) {
+		bool bound = current_framebuffer == default_framebuffer;
+		default_framebuffer = window_framebuffer;
+		default_width = window_width;
+		default_height = window_height;
+		if (bound) {
+			bind_default_framebuffer();
+		}
+	}
+}
+
+void fln_gfx_ogl_destroy_objects(void) {
+	capture_destroy();
+	frame_timer_destroy();
+	scope_destroy();
+	dynres_release();
+}
+
+// 虚拟机关闭时释放的资源还在录制中的列表里，先执行掉再清理
+static void render_flush_work(void *userdata) {
+	replay(fln_render_thread_list(), false);
+	fln_gfx_ogl_destroy_objects();
+}
+
 static bool destroy_resource(fln_app_state *appstate) {
+	if (threaded) {
+		fln_render_thread_call(render_flush_work, nullptr);
+		fln_render_thread_stop();
+		threaded = false;
+		SDL_GL_MakeCurrent(appstate->window, appstate->ogl_context);
+	} else {
+		fln_gfx_ogl_destroy_objects();
+	}
 	if (!SDL_GL_DestroyContext(appstate->ogl_context)) {
 		printf("failed to call SDL_GL_DestroyContext()\n");
 	}
 	return true;
 }
 
+typedef struct vsync_call {
+	int interval;
+	bool ok;
+} vsync_call;
+
+// 交换间隔属于当前线程上生效的上下文
+static void set_vsync_work(void *userdata) {
+	vsync_call *call = userdata;
+	call->ok = SDL_GL_SetSwapInterval(call->interval);
+}
+
+static bool set_vsync(fln_app_state *appstate, int interval) {
+	vsync_call call = { interval, false };
+	if (threaded) {
+		fln_render_thread_call(set_vsync_work, &call);
+	} else {
+		set_vsync_work(&call);
+	}
+	if (!call.ok) {
+		printf("failed to call SDL_GL_SetSwapInterval(%d): %s\n", interval, SDL_GetError());
+		return false;
+	}
+	return true;
+}
+
 static void receive_window_events(fln_app_state *appstate, const SDL_Event *event) {
 	if (event->type == SDL_EVENT_WINDOW_RESIZED) {
 		int w, h;
-		SDL_GetWindowSize(appstate->window, &w, &h);
-		glViewport(0, 0, w, h); // TODO: 不能直接更改 viewport，因为 SDL 的事件接收回调可能会在别的线程被调用
+		SDL_GetWindowSizeInPixels(appstate->window, &w, &h);
+		if (threaded) {
+			// 事件在帧开始之前处理，命令位于这一帧的开头，回放时在帧开始之前生效
+			gfx_command *cmd = command_push(GFX_COMMAND_WINDOW_SIZE, nullptr, 0);
+			if (cmd) {
+				cmd->window_size.width = w;
+				cmd->window_size.height = h;
+			}
+			return;
+		}
+		// 事件在主线程上、帧开始之前处理（见 event.c），只在直接绘制到窗口时才会改 viewport
+		fln_gfx_ogl_set_window_framebuffer(window_framebuffer, w, h);
 	}
 }
 
 fln_gfx_backend fln_gfx_init_backend_ogl() {
 	fln_gfx_backend backend;
+	memset(&backend, 0, sizeof(backend));
+	backend.name = "opengl";
 	backend.sdl_configure = sdl_configure;
 	backend.init = init;
 	backend.begin_drawing = begin_drawing;
 	backend.end_drawing = end_drawing;
 	backend.destroy_resource = destroy_resource;
 	backend.receive_window_events = receive_window_events;
+	backend.set_vsync = set_vsync;
 	backend.l_pipeline = l_pipeline;
 	backend.l_pipeline_release = l_m_pipeline_release;
 	backend.l_pipeline_uniform = l_m_pipeline_uniform;
@@ -590,5 +2415,21 @@ fln_gfx_backend fln_gfx_init_backend_ogl() {
 	backend.l_texture2d = l_texture2d;
 	backend.l_texture2d_size = l_texture2d_size;
 	backend.l_texture2d_release = l_texture2d_release;
+	backend.l_glyph_atlas = l_glyph_atlas;
+	backend.l_text = l_text;
+	backend.l_text_release = l_m_text_release;
+	backend.l_target = l_target;
+	backend.l_target_texture = l_m_target_texture;
+	backend.l_target_size = l_m_target_size;
+	backend.l_target_clear = l_m_target_clear;
+	backend.l_target_release = l_m_target_release;
+	backend.l_render_to = l_render_to;
+	backend.l_dynamic_resolution = l_dynamic_resolution;
+	backend.l_resolution_scale = l_resolution_scale;
+	backend.l_gpu_begin = l_gpu_begin;
+	backend.l_gpu_end = l_gpu_end;
+	backend.l_gpu_times = l_gpu_times;
+	backend.l_capture = l_capture;
+	backend.shaders = builtin_shaders;
 	return backend;
 }
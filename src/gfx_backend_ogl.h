@@ -9,4 +9,14 @@
 
 #include "gfx_interface.h"
 
-fln_gfx_backend fln_gfx_init_backend_ogl();
\ No newline at end of file
+fln_gfx_backend fln_gfx_init_backend_ogl();
+
+// 以下供同样基于 OpenGL、但不使用 SDL 窗口上下文的后端（例如 headless）复用
+
+// 帧结束时的处理（截图、错误检查），不交换缓冲
+bool fln_gfx_ogl_end_offscreen_frame(fln_app_state *appstate);
+
+// 释放后端内部持有的 GL 对象，需要在销毁上下文之前调用
+void fln_gfx_ogl_destroy_objects(void);
+// 替换最终显示用的帧缓冲及其尺寸（未开启动态分辨率时也就是每帧开始、render_to(nil) 时绑定的帧缓冲）
+void fln_gfx_ogl_set_window_framebuffer(unsigned int fbo, int width, int height);
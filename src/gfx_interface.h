@@ -16,14 +16,50 @@
 #define FLN_USERTYPE_PIPELINE "fln.pipeline"
 #define FLN_USERTYPE_MESH "fln.mesh"
 #define FLN_USERTYPE_TEXTURE2D "fln.texture2d"
+#define FLN_USERTYPE_TEXT "fln.text"
+#define FLN_USERTYPE_TARGET "fln.target"
+
+#define FLN_GFX_TARGET_MAX_COLORS 8
+
+// 渲染目标颜色附件的格式
+typedef enum fln_gfx_target_format {
+	FLN_GFX_TARGET_RGBA8,
+	FLN_GFX_TARGET_RGBA16F,
+	FLN_GFX_TARGET_RGBA32F,
+	FLN_GFX_TARGET_R8,
+	FLN_GFX_TARGET_RG8,
+	FLN_GFX_TARGET_R16F,
+	FLN_GFX_TARGET_R32F,
+} fln_gfx_target_format;
+
+// `flandre.graphics.target{...}` 的参数，由 fln_gfx_check_target_desc 从 Lua 表中读取
+typedef struct fln_gfx_target_desc {
+	int width;
+	int height;
+	int color_count;
+	fln_gfx_target_format formats[FLN_GFX_TARGET_MAX_COLORS];
+	bool depth; // 附带 24 位深度 + 8 位模板
+} fln_gfx_target_desc;
+
+// 检查 index 处的参数表，出错时抛出 Lua 错误
+void fln_gfx_check_target_desc(lua_State *L, int index, fln_gfx_target_desc *desc);
+
+// 后端自带的着色器源码，会以 `flandre.graphics.shaders[name]` 的形式提供给脚本
+typedef struct fln_gfx_shader_source {
+	const char *name;
+	const char *vertex;
+	const char *fragment;
+} fln_gfx_shader_source;
 
 typedef struct fln_gfx_backend {
+	const char *name;
 	SDL_WindowFlags (*sdl_configure)(fln_app_state *appstate);
 	bool (*init)(fln_app_state *appstate);
 	bool (*begin_drawing)(fln_app_state *appstate);
 	bool (*end_drawing)(fln_app_state *appstate);
 	bool (*destroy_resource)(fln_app_state *appstate);
 	void (*receive_window_events)(fln_app_state *appstate, const SDL_Event *event);
+	bool (*set_vsync)(fln_app_state *appstate, int interval); // 0 关闭，1 开启，-1 adaptive；可以为空
 	lua_CFunction l_pipeline;
 	lua_CFunction l_pipeline_release;
 	lua_CFunction l_pipeline_uniform;
@@ -34,4 +70,21 @@ typedef struct fln_gfx_backend {
 	lua_CFunction l_texture2d;
 	lua_CFunction l_texture2d_size;
 	lua_CFunction l_texture2d_release;
+	lua_CFunction l_glyph_atlas;
+	lua_CFunction l_text;
+	lua_CFunction l_text_release;
+	lua_CFunction l_target;
+	lua_CFunction l_target_texture;
+	lua_CFunction l_target_size;
+	lua_CFunction l_target_clear;
+	lua_CFunction l_target_release;
+	lua_CFunction l_render_to;
+	lua_CFunction l_dynamic_resolution;
+	lua_CFunction l_resolution_scale;
+	lua_CFunction l_gpu_begin;
+	lua_CFunction l_gpu_end;
+	lua_CFunction l_gpu_times;
+	lua_CFunction l_capture;
+	lua_CFunction l_stats; // 可以为空
+	const fln_gfx_shader_source *shaders; // 以 name 为 nullptr 的元素结尾
 } fln_gfx_backend;
@@ -10,14 +10,46 @@
 #include <SDL3/SDL_video.h>
 #include <lauxlib.h>
 #include <lua.h>
+#include <string.h>
 
+#include "gfx_backend_headless.h"
+#include "gfx_backend_null.h"
 #include "gfx_backend_ogl.h"
+#include "error.h"
 #include "gfx_interface.h"
 #include "opengl/glad.h"
+#include "text.h"
 
 static fln_gfx_backend backend;
+static fln_gfx_backend (*backend_init)(void) = fln_gfx_init_backend_ogl;
+static bool backend_loaded = false;
+
+bool fln_gfx_select_backend(const char *name) {
+	if (strcmp(name, "opengl") == 0) {
+		backend_init = fln_gfx_init_backend_ogl;
+		return true;
+	}
+	if (strcmp(name, "null") == 0) {
+		backend_init = fln_gfx_init_backend_null;
+		return true;
+	}
+	if (strcmp(name, "headless") == 0 && fln_gfx_headless_available()) {
+		backend_init = fln_gfx_init_backend_headless;
+		return true;
+	}
+	return false;
+}
+
+// 后端在创建窗口之前（fln_gfx_sdl_configure）或者脚本第一次访问 graphics 模块时初始化，以先到者为准
+static void load_backend(void) {
+	if (!backend_loaded) {
+		backend = backend_init();
+		backend_loaded = true;
+	}
+}
 
 SDL_WindowFlags fln_gfx_sdl_configure(fln_app_state *appstate) {
+	load_backend();
 	if (backend.sdl_configure) {
 		return backend.sdl_configure(appstate);
 	} else {
@@ -67,11 +99,85 @@ void fln_gfx_receive_window_events(fln_app_state *appstate, const SDL_Event *eve
 	}
 }
 
+static const char *const target_format_names[] = {
+	"rgba8", "rgba16f", "rgba32f", "r8", "rg8", "r16f", "r32f", nullptr
+};
+
+// 栈顶的格式名，element 为 0 时 formats 是单个字符串，否则是数组中的第 element 个
+static int check_target_format(lua_State *L, lua_Integer element) {
+	const char *name = lua_tostring(L, -1);
+	for (int i = 0; name && target_format_names[i]; i++) {
+		if (strcmp(name, target_format_names[i]) == 0) {
+			return i;
+		}
+	}
+	const char *shown = name ? name : luaL_typename(L, -1);
+	if (element == 0) {
+		return fln_error(L, "invalid target format '%s' in 'formats'", shown);
+	}
+	return fln_error(L, "invalid target format '%s' in 'formats[%d]'", shown, (int)element);
+}
+
+void fln_gfx_check_target_desc(lua_State *L, int index, fln_gfx_target_desc *desc) {
+	luaL_checktype(L, index, LUA_TTABLE);
+	lua_getfield(L, index, "width");
+	lua_getfield(L, index, "height");
+	desc->width = (int)luaL_checkinteger(L, -2);
+	desc->height = (int)luaL_checkinteger(L, -1);
+	lua_pop(L, 2);
+	if (desc->width <= 0 || desc->height <= 0) {
+		fln_error(L, "invalid target size: %dx%d", desc->width, desc->height);
+	}
+
+	// formats 可以是单个格式名，也可以是格式名数组，每个元素对应一个颜色附件
+	desc->color_count = 0;
+	int type = lua_getfield(L, index, "formats");
+	if (type == LUA_TNIL) {
+		desc->formats[desc->color_count++] = FLN_GFX_TARGET_RGBA8;
+	} else if (type == LUA_TSTRING) {
+		desc->formats[desc->color_count++] = check_target_format(L, 0);
+	} else if (type == LUA_TTABLE) {
+		lua_Integer count = luaL_len(L, -1);
+		if (count < 1 || count > FLN_GFX_TARGET_MAX_COLORS) {
+			fln_error(L, "invalid number of color attachments: %d (1 - %d)", (int)count, FLN_GFX_TARGET_MAX_COLORS);
+		}
+		for (lua_Integer i = 1; i <= count; i++) {
+			lua_rawgeti(L, -1, i);
+			desc->formats[desc->color_count++] = check_target_format(L, i);
+			lua_pop(L, 1);
+		}
+	} else {
+		fln_error(L, "'formats' must be a string or an array of strings");
+	}
+	lua_pop(L, 1);
+
+	lua_getfield(L, index, "depth");
+	desc->depth = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+}
+
+bool fln_gfx_set_vsync(fln_app_state *appstate, int interval) {
+	if (backend.set_vsync) {
+		return backend.set_vsync(appstate, interval);
+	}
+	return true; // 没有交换链的后端不需要处理
+}
+
 int fln_luaopen_graphics(lua_State *L) {
-	backend = fln_gfx_init_backend_ogl();
+	load_backend();
 	const luaL_Reg funcs[] = { { "pipeline", backend.l_pipeline },
 		{ "mesh", backend.l_mesh },
 		{ "texture2d", backend.l_texture2d },
+		{ "glyph_atlas", backend.l_glyph_atlas },
+		{ "text", backend.l_text },
+		{ "target", backend.l_target },
+		{ "render_to", backend.l_render_to },
+		{ "dynamic_resolution", backend.l_dynamic_resolution },
+		{ "resolution_scale", backend.l_resolution_scale },
+		{ "gpu_begin", backend.l_gpu_begin },
+		{ "gpu_end", backend.l_gpu_end },
+		{ "gpu_times", backend.l_gpu_times },
+		{ "capture", backend.l_capture },
 		{ nullptr, nullptr } };
 	const luaL_Reg meths_pipeline[] = { { "uniform", backend.l_pipeline_uniform },
 		{ "submit", backend.l_pipeline_submit },
@@ -85,6 +191,19 @@ int fln_luaopen_graphics(lua_State *L) {
 		{ "__gc", backend.l_mesh_release },
 		{ nullptr, nullptr }
 	};
+	const luaL_Reg meths_text[] = {
+		{ "release", backend.l_text_release },
+		{ "__gc", backend.l_text_release },
+		{ nullptr, nullptr }
+	};
+	const luaL_Reg meths_target[] = {
+		{ "texture", backend.l_target_texture },
+		{ "size", backend.l_target_size },
+		{ "clear", backend.l_target_clear },
+		{ "release", backend.l_target_release },
+		{ "__gc", backend.l_target_release },
+		{ nullptr, nullptr }
+	};
 	const luaL_Reg methsexture[] = {
 		{ "size", backend.l_texture2d_size },
 		{ "release", backend.l_texture2d_release },
@@ -107,6 +226,34 @@ int fln_luaopen_graphics(lua_State *L) {
 	lua_setfield(L, -2, "__index");
 	luaL_setfuncs(L, meths_mesh, 0);
 
+	luaL_newmetatable(L, FLN_USERTYPE_TEXT);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, meths_text, 0);
+	fln_text_setfuncs(L);
+
+	luaL_newmetatable(L, FLN_USERTYPE_TARGET);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, meths_target, 0);
+
 	luaL_newlib(L, funcs);
+
+	lua_newtable(L);
+	for (const fln_gfx_shader_source *shader = backend.shaders; shader && shader->name; shader++) {
+		lua_createtable(L, 0, 2);
+		lua_pushstring(L, shader->vertex);
+		lua_setfield(L, -2, "vertex");
+		lua_pushstring(L, shader->fragment);
+		lua_setfield(L, -2, "fragment");
+		lua_setfield(L, -2, shader->name);
+	}
+	lua_setfield(L, -2, "shaders");
+	lua_pushstring(L, backend.name);
+	lua_setfield(L, -2, "backend");
+	if (backend.l_stats) {
+		lua_pushcfunction(L, backend.l_stats);
+		lua_setfield(L, -2, "stats");
+	}
 	return 1;
 }
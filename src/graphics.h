@@ -15,6 +15,9 @@
 #include "appstate.h"
 #include "opengl/glad.h"
 
+// 需要在打开 flandre 模块之前调用，name 为 "opengl"（默认）、"headless" 或 "null"
+bool fln_gfx_select_backend(const char *name);
+
 int fln_luaopen_graphics(lua_State *L);
 
 SDL_WindowFlags fln_gfx_sdl_configure(fln_app_state *appstate);
@@ -27,4 +30,7 @@ void fln_gfx_end_drawing(fln_app_state *appstate);
 
 void fln_gfx_destroy_resource(fln_app_state *appstate);
 
-void fln_gfx_receive_window_events(fln_app_state *appstate, const SDL_Event *event);
\ No newline at end of file
+void fln_gfx_receive_window_events(fln_app_state *appstate, const SDL_Event *event);
+
+// interval 同 SDL_GL_SetSwapInterval，后端不支持该值时返回 false
+bool fln_gfx_set_vsync(fln_app_state *appstate, int interval);
\ No newline at end of file
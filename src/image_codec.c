@@ -0,0 +1,390 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "image_codec.h"
+
+#include <png.h>
+#include <pngconf.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "image_ops.h"
+#include "memory.h"
+
+// png -----------------------------------------------------------------------
+
+static thread_local char png_message[64];
+
+static bool png_failed(png_image *context, const char **err) {
+	if (PNG_IMAGE_FAILED(*context) & PNG_IMAGE_ERROR) {
+		snprintf(png_message, sizeof(png_message), "PNG error: %s", context->message);
+		*err = png_message;
+		return true;
+	}
+	return false;
+}
+
+bool fln_image_decode_png(const void *data, size_t size, fln_image *out, const char **err) {
+	png_image context;
+	memset(&context, 0, sizeof(context));
+	context.version = PNG_IMAGE_VERSION;
+	context.opaque = nullptr;
+
+	png_image_begin_read_from_memory(&context, data, size);
+	if (png_failed(&context, err)) {
+		png_image_free(&context);
+		return false;
+	}
+	context.format &= ~(PNG_FORMAT_FLAG_BGR | PNG_FORMAT_FLAG_AFIRST | PNG_FORMAT_FLAG_LINEAR | PNG_FORMAT_FLAG_COLORMAP);
+	fln_image_format format;
+	switch (context.format) {
+		case PNG_FORMAT_GRAY:
+			format = FLN_IMAGE_FORMAT_R8;
+			break;
+		case PNG_FORMAT_GA:
+			format = FLN_IMAGE_FORMAT_RG8;
+			break;
+		case PNG_FORMAT_RGB:
+			format = FLN_IMAGE_FORMAT_RGB8;
+			break;
+		case PNG_FORMAT_RGBA:
+			format = FLN_IMAGE_FORMAT_RGBA8;
+			break;
+		default:
+			png_image_free(&context);
+			*err = "unsupported image format";
+			return false;
+	}
+	unsigned int stride = PNG_IMAGE_ROW_STRIDE(context);
+	unsigned char *pixels = fln_alloc(PNG_IMAGE_BUFFER_SIZE(context, stride));
+	if (!pixels) {
+		png_image_free(&context);
+		*err = "bad alloc";
+		return false;
+	}
+	png_image_finish_read(&context, nullptr, pixels, stride, nullptr);
+	if (png_failed(&context, err)) {
+		png_image_free(&context);
+		fln_free(pixels);
+		return false;
+	}
+	out->width = context.width;
+	out->height = context.height;
+	out->format = format;
+	out->data = pixels;
+	return true;
+}
+
+bool fln_image_write_png(const fln_image *image, const char *path, const char **err) {
+	static const png_uint_32 formats[] = { PNG_FORMAT_GRAY, PNG_FORMAT_GA, PNG_FORMAT_RGB, PNG_FORMAT_RGBA };
+	png_image context;
+	memset(&context, 0, sizeof(context));
+	context.version = PNG_IMAGE_VERSION;
+	context.width = image->width;
+	context.height = image->height;
+	context.format = formats[image->format];
+	png_image_write_to_file(&context, path, 0, image->data, (png_int_32)fln_image_row_size(image), nullptr);
+	if (png_failed(&context, err)) {
+		png_image_free(&context);
+		return false;
+	}
+	return true;
+}
+
+// qoi -----------------------------------------------------------------------
+// https://qoiformat.org/qoi-specification.pdf
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_MASK_2 0xc0
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING_SIZE 8
+#define QOI_PIXELS_MAX 400000000u
+
+typedef union qoi_rgba {
+	struct {
+		uint8_t r, g, b, a;
+	} rgba;
+	uint32_t v;
+} qoi_rgba;
+
+static const uint8_t qoi_padding[QOI_PADDING_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+static inline uint32_t qoi_hash(qoi_rgba px) {
+	return (px.rgba.r * 3 + px.rgba.g * 5 + px.rgba.b * 7 + px.rgba.a * 11) & 63;
+}
+
+static inline uint32_t read_be32(const uint8_t *p) {
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void write_be32(uint8_t *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+bool fln_image_decode_qoi(const void *data, size_t size, fln_image *out, const char **err) {
+	const uint8_t *bytes = data;
+	if (size < QOI_HEADER_SIZE + QOI_PADDING_SIZE || memcmp(bytes, "qoif", 4) != 0) {
+		*err = "invalid QOI header";
+		return false;
+	}
+	uint32_t width = read_be32(bytes + 4);
+	uint32_t height = read_be32(bytes + 8);
+	uint8_t channels = bytes[12];
+	if (width == 0 || height == 0 || (channels != 3 && channels != 4) || height >= QOI_PIXELS_MAX / width) {
+		*err = "invalid QOI header";
+		return false;
+	}
+
+	size_t pixels_count = (size_t)width * height;
+	uint8_t *pixels = fln_alloc(pixels_count * channels);
+	if (!pixels) {
+		*err = "bad alloc";
+		return false;
+	}
+
+	qoi_rgba index[64];
+	memset(index, 0, sizeof(index));
+	qoi_rgba px = { .rgba = { 0, 0, 0, 255 } };
+	const uint8_t *p = bytes + QOI_HEADER_SIZE;
+	const uint8_t *end = bytes + size - QOI_PADDING_SIZE;
+	uint8_t *dst = pixels;
+	uint8_t *dst_end = pixels + pixels_count * channels;
+	// 通道数在循环外分开处理，让编译器去掉每个像素上的分支
+	while (dst < dst_end) {
+		if (p >= end) {
+			// 数据提前结束，剩余像素保持最后一个颜色（与参考实现一致）
+			break;
+		}
+		uint8_t b1 = *p++;
+		size_t run = 1;
+		if (b1 == QOI_OP_RGB) {
+			if (end - p < 3) {
+				break;
+			}
+			px.rgba.r = p[0];
+			px.rgba.g = p[1];
+			px.rgba.b = p[2];
+			p += 3;
+		} else if (b1 == QOI_OP_RGBA) {
+			if (end - p < 4) {
+				break;
+			}
+			px.rgba.r = p[0];
+			px.rgba.g = p[1];
+			px.rgba.b = p[2];
+			px.rgba.a = p[3];
+			p += 4;
+		} else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+			px = index[b1];
+		} else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+			px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+			px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+			px.rgba.b += (b1 & 0x03) - 2;
+		} else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+			if (p >= end) {
+				break;
+			}
+			uint8_t b2 = *p++;
+			int vg = (b1 & 0x3f) - 32;
+			px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+			px.rgba.g += vg;
+			px.rgba.b += vg - 8 + (b2 & 0x0f);
+		} else {
+			run = (b1 & 0x3f) + 1;
+		}
+		index[qoi_hash(px)] = px;
+
+		size_t left = (size_t)(dst_end - dst) / channels;
+		if (run > left) {
+			run = left;
+		}
+		if (channels == 4) {
+			for (size_t i = 0; i < run; i++, dst += 4) {
+				memcpy(dst, &px.v, 4);
+			}
+		} else {
+			for (size_t i = 0; i < run; i++, dst += 3) {
+				dst[0] = px.rgba.r;
+				dst[1] = px.rgba.g;
+				dst[2] = px.rgba.b;
+			}
+		}
+	}
+	for (; dst < dst_end; dst += channels) {
+		memcpy(dst, &px.v, channels);
+	}
+
+	out->width = (int)width;
+	out->height = (int)height;
+	out->format = channels == 4 ? FLN_IMAGE_FORMAT_RGBA8 : FLN_IMAGE_FORMAT_RGB8;
+	out->data = pixels;
+	return true;
+}
+
+void *fln_image_encode_qoi(const fln_image *image, size_t *size) {
+	if (!image->data || (image->format != FLN_IMAGE_FORMAT_RGB8 && image->format != FLN_IMAGE_FORMAT_RGBA8)) {
+		return nullptr;
+	}
+	int channels = fln_image_channels(image->format);
+	size_t pixels_count = (size_t)image->width * image->height;
+	size_t max_size = pixels_count * (channels + 1) + QOI_HEADER_SIZE + QOI_PADDING_SIZE;
+	uint8_t *bytes = fln_alloc(max_size);
+	if (!bytes) {
+		return nullptr;
+	}
+	uint8_t *p = bytes;
+	memcpy(p, "qoif", 4);
+	write_be32(p + 4, image->width);
+	write_be32(p + 8, image->height);
+	p[12] = (uint8_t)channels;
+	p[13] = 0; // sRGB + 线性 alpha
+	p += QOI_HEADER_SIZE;
+
+	qoi_rgba index[64];
+	memset(index, 0, sizeof(index));
+	qoi_rgba previous = { .rgba = { 0, 0, 0, 255 } };
+	qoi_rgba px = previous;
+	int run = 0;
+	const uint8_t *src = image->data;
+	for (size_t i = 0; i < pixels_count; i++, src += channels) {
+		px.rgba.r = src[0];
+		px.rgba.g = src[1];
+		px.rgba.b = src[2];
+		if (channels == 4) {
+			px.rgba.a = src[3];
+		}
+		if (px.v == previous.v) {
+			run++;
+			if (run == 62 || i == pixels_count - 1) {
+				*p++ = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0) {
+			*p++ = QOI_OP_RUN | (run - 1);
+			run = 0;
+		}
+		uint32_t hash = qoi_hash(px);
+		if (index[hash].v == px.v) {
+			*p++ = QOI_OP_INDEX | hash;
+		} else {
+			index[hash] = px;
+			if (px.rgba.a == previous.rgba.a) {
+				int8_t vr = px.rgba.r - previous.rgba.r;
+				int8_t vg = px.rgba.g - previous.rgba.g;
+				int8_t vb = px.rgba.b - previous.rgba.b;
+				int8_t vg_r = vr - vg;
+				int8_t vg_b = vb - vg;
+				if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+					*p++ = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+				} else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+					*p++ = QOI_OP_LUMA | (vg + 32);
+					*p++ = (vg_r + 8) << 4 | (vg_b + 8);
+				} else {
+					*p++ = QOI_OP_RGB;
+					*p++ = px.rgba.r;
+					*p++ = px.rgba.g;
+					*p++ = px.rgba.b;
+				}
+			} else {
+				*p++ = QOI_OP_RGBA;
+				*p++ = px.rgba.r;
+				*p++ = px.rgba.g;
+				*p++ = px.rgba.b;
+				*p++ = px.rgba.a;
+			}
+		}
+		previous = px;
+	}
+	memcpy(p, qoi_padding, QOI_PADDING_SIZE);
+	p += QOI_PADDING_SIZE;
+	*size = p - bytes;
+	return bytes;
+}
+
+// raw -----------------------------------------------------------------------
+
+bool fln_image_decode_raw(const void *data, size_t size, fln_image *out, const char **err) {
+	fln_image_blob_header header;
+	if (size < sizeof(header)) {
+		*err = "invalid raw image header";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, FLN_IMAGE_BLOB_MAGIC, 4) != 0 || header.version != FLN_IMAGE_BLOB_VERSION) {
+		*err = "invalid raw image header";
+		return false;
+	}
+	if (header.format > FLN_IMAGE_FORMAT_RGBA8 || header.width == 0 || header.height == 0 || header.width > INT32_MAX || header.height > INT32_MAX) {
+		*err = "invalid raw image header";
+		return false;
+	}
+	size_t pixels_size = (size_t)header.width * header.height * fln_image_channels(header.format);
+	if (size - sizeof(header) < pixels_size) {
+		*err = "truncated raw image";
+		return false;
+	}
+	unsigned char *pixels = fln_alloc(pixels_size);
+	if (!pixels) {
+		*err = "bad alloc";
+		return false;
+	}
+	memcpy(pixels, (const unsigned char *)data + sizeof(header), pixels_size);
+	out->width = (int)header.width;
+	out->height = (int)header.height;
+	out->format = header.format;
+	out->data = pixels;
+	return true;
+}
+
+void *fln_image_encode_raw(const fln_image *image, size_t *size) {
+	if (!image->data) {
+		return nullptr;
+	}
+	size_t pixels_size = fln_image_row_size(image) * image->height;
+	unsigned char *bytes = fln_alloc(sizeof(fln_image_blob_header) + pixels_size);
+	if (!bytes) {
+		return nullptr;
+	}
+	fln_image_blob_header header;
+	memcpy(header.magic, FLN_IMAGE_BLOB_MAGIC, 4);
+	header.version = FLN_IMAGE_BLOB_VERSION;
+	header.width = image->width;
+	header.height = image->height;
+	header.format = image->format;
+	header.reserved = 0;
+	memcpy(bytes, &header, sizeof(header));
+	memcpy(bytes + sizeof(header), image->data, pixels_size);
+	*size = sizeof(header) + pixels_size;
+	return bytes;
+}
+
+// auto ----------------------------------------------------------------------
+
+bool fln_image_decode(const void *data, size_t size, fln_image *out, const char **err) {
+	static const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (size >= 8 && memcmp(data, png_signature, 8) == 0) {
+		return fln_image_decode_png(data, size, out, err);
+	}
+	if (size >= 4 && memcmp(data, "qoif", 4) == 0) {
+		return fln_image_decode_qoi(data, size, out, err);
+	}
+	if (size >= 4 && memcmp(data, FLN_IMAGE_BLOB_MAGIC, 4) == 0) {
+		return fln_image_decode_raw(data, size, out, err);
+	}
+	*err = "unknown image format";
+	return false;
+}
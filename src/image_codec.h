@@ -0,0 +1,46 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "data.h"
+
+// 图像的解码与编码，不依赖 Lua，可以在工作线程上调用
+// 解码成功时 out->data 由 fln_alloc 分配；失败时 err 指向一个静态（线程局部）字符串
+
+#define FLN_IMAGE_BLOB_MAGIC "FLNI"
+#define FLN_IMAGE_BLOB_VERSION 1
+
+// 原始像素容器（.flni）：头部之后紧跟着紧密排列、可以直接上传的像素
+typedef struct fln_image_blob_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format; // fln_image_format
+	uint32_t reserved;
+} fln_image_blob_header;
+
+bool fln_image_decode_png(const void *data, size_t size, fln_image *out, const char **err);
+
+bool fln_image_decode_qoi(const void *data, size_t size, fln_image *out, const char **err);
+
+bool fln_image_decode_raw(const void *data, size_t size, fln_image *out, const char **err);
+
+// 根据文件头判断格式（PNG / QOI / FLNI）
+bool fln_image_decode(const void *data, size_t size, fln_image *out, const char **err);
+
+// QOI 只支持 RGB8 和 RGBA8，返回的内存由 fln_alloc 分配
+void *fln_image_encode_qoi(const fln_image *image, size_t *size);
+
+void *fln_image_encode_raw(const fln_image *image, size_t *size);
+
+// 编码为 PNG 并写入文件，支持所有格式
+bool fln_image_write_png(const fln_image *image, const char *path, const char **err);
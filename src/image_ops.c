@@ -0,0 +1,480 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "image_ops.h"
+
+#include <SDL3/SDL_cpuinfo.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "memory.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FLN_IMAGE_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define FLN_IMAGE_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC/Clang 需要按函数打开指令集，MSVC 直接可以使用所有 intrinsics
+#if defined(__GNUC__) || defined(__clang__)
+#define FLN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FLN_TARGET(isa)
+#endif
+
+typedef enum isa_level {
+	ISA_UNKNOWN,
+	ISA_SCALAR,
+	ISA_SSE2,
+	ISA_SSE41,
+	ISA_AVX2,
+	ISA_NEON,
+} isa_level;
+
+static isa_level isa = ISA_UNKNOWN; // 只在第一次使用时检测，多线程下重复检测的结果也相同
+
+static isa_level get_isa(void) {
+	if (isa == ISA_UNKNOWN) {
+#if defined(FLN_IMAGE_X86)
+		if (SDL_HasAVX2()) {
+			isa = ISA_AVX2;
+		} else if (SDL_HasSSE41()) {
+			isa = ISA_SSE41;
+		} else if (SDL_HasSSE2()) {
+			isa = ISA_SSE2;
+		} else {
+			isa = ISA_SCALAR;
+		}
+#elif defined(FLN_IMAGE_NEON)
+		isa = ISA_NEON;
+#else
+		isa = ISA_SCALAR;
+#endif
+	}
+	return isa;
+}
+
+int fln_image_channels(fln_image_format format) {
+	switch (format) {
+		case FLN_IMAGE_FORMAT_R8:
+			return 1;
+		case FLN_IMAGE_FORMAT_RG8:
+			return 2;
+		case FLN_IMAGE_FORMAT_RGB8:
+			return 3;
+		case FLN_IMAGE_FORMAT_RGBA8:
+			return 4;
+	}
+	return 0;
+}
+
+size_t fln_image_row_size(const fln_image *image) {
+	return (size_t)image->width * fln_image_channels(image->format);
+}
+
+static size_t pixel_count(const fln_image *image) {
+	return (size_t)image->width * image->height;
+}
+
+// premultiply ---------------------------------------------------------------
+
+// round(c * a / 255)，与 SIMD 版本的结果完全一致
+static inline uint8_t mul_div255(unsigned int c, unsigned int a) {
+	unsigned int t = c * a + 128;
+	return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+static void premultiply_scalar(uint8_t *p, size_t count) {
+	for (size_t i = 0; i < count; i++, p += 4) {
+		p[0] = mul_div255(p[0], p[3]);
+		p[1] = mul_div255(p[1], p[3]);
+		p[2] = mul_div255(p[2], p[3]);
+	}
+}
+
+#if defined(FLN_IMAGE_X86)
+FLN_TARGET("sse4.1")
+static inline __m128i mul_div255_epi16(__m128i c, __m128i a) {
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+FLN_TARGET("sse4.1")
+static size_t premultiply_sse41(uint8_t *p, size_t count) {
+	// alpha 广播到 rgb，alpha 自身的系数为 255
+	const __m128i shuffle = _mm_setr_epi8(3, 3, 3, -1, 7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4, p += 16) {
+		__m128i px = _mm_loadu_si128((const __m128i *)p);
+		__m128i a = _mm_or_si128(_mm_shuffle_epi8(px, shuffle), alpha);
+		__m128i lo = mul_div255_epi16(_mm_unpacklo_epi8(px, zero), _mm_unpacklo_epi8(a, zero));
+		__m128i hi = mul_div255_epi16(_mm_unpackhi_epi8(px, zero), _mm_unpackhi_epi8(a, zero));
+		_mm_storeu_si128((__m128i *)p, _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+FLN_TARGET("avx2")
+static inline __m256i mul_div255_epi16_avx2(__m256i c, __m256i a) {
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(c, a), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+FLN_TARGET("avx2")
+static size_t premultiply_avx2(uint8_t *p, size_t count) {
+	// vpshufb、unpack 和 packus 都在 128 位内进行，像素不会跨越两半
+	const __m256i shuffle = _mm256_setr_epi8(3, 3, 3, -1, 7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1,
+			3, 3, 3, -1, 7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1);
+	const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8, p += 32) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)p);
+		__m256i a = _mm256_or_si256(_mm256_shuffle_epi8(px, shuffle), alpha);
+		__m256i lo = mul_div255_epi16_avx2(_mm256_unpacklo_epi8(px, zero), _mm256_unpacklo_epi8(a, zero));
+		__m256i hi = mul_div255_epi16_avx2(_mm256_unpackhi_epi8(px, zero), _mm256_unpackhi_epi8(a, zero));
+		_mm256_storeu_si256((__m256i *)p, _mm256_packus_epi16(lo, hi));
+	}
+	return i;
+}
+#endif
+
+#if defined(FLN_IMAGE_NEON)
+static inline uint8x16_t mul_div255_neon(uint8x16_t c, uint8x16_t a) {
+	uint16x8_t lo = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+	uint16x8_t hi = vmull_high_u8(c, a);
+	// vraddhn(t, (t + 128) >> 8) = (t + 128 + ((t + 128) >> 8)) >> 8
+	return vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)), vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+}
+
+static size_t premultiply_neon(uint8_t *p, size_t count) {
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16, p += 64) {
+		uint8x16x4_t px = vld4q_u8(p);
+		px.val[0] = mul_div255_neon(px.val[0], px.val[3]);
+		px.val[1] = mul_div255_neon(px.val[1], px.val[3]);
+		px.val[2] = mul_div255_neon(px.val[2], px.val[3]);
+		vst4q_u8(p, px);
+	}
+	return i;
+}
+#endif
+
+bool fln_image_premultiply(fln_image *image) {
+	if (!image->data) {
+		return false;
+	}
+	size_t count = pixel_count(image);
+	uint8_t *p = image->data;
+	if (image->format == FLN_IMAGE_FORMAT_RG8) {
+		// 灰度 + alpha 不常用，只有标量实现
+		for (size_t i = 0; i < count; i++, p += 2) {
+			p[0] = mul_div255(p[0], p[1]);
+		}
+		return true;
+	}
+	if (image->format != FLN_IMAGE_FORMAT_RGBA8) {
+		return false;
+	}
+	size_t done = 0;
+	switch (get_isa()) {
+#if defined(FLN_IMAGE_X86)
+		case ISA_AVX2:
+			done = premultiply_avx2(p, count);
+			break;
+		case ISA_SSE41:
+			done = premultiply_sse41(p, count);
+			break;
+#elif defined(FLN_IMAGE_NEON)
+		case ISA_NEON:
+			done = premultiply_neon(p, count);
+			break;
+#endif
+		default:
+			break;
+	}
+	premultiply_scalar(p + done * 4, count - done);
+	return true;
+}
+
+// swizzle -------------------------------------------------------------------
+
+static void swizzle_scalar(uint8_t *p, size_t count, const uint8_t *order) {
+	for (size_t i = 0; i < count; i++, p += 4) {
+		uint8_t px[4] = { p[0], p[1], p[2], p[3] };
+		p[0] = px[order[0]];
+		p[1] = px[order[1]];
+		p[2] = px[order[2]];
+		p[3] = px[order[3]];
+	}
+}
+
+#if defined(FLN_IMAGE_X86)
+FLN_TARGET("sse4.1")
+static size_t swizzle_sse41(uint8_t *p, size_t count, const uint8_t *order) {
+	int8_t mask[16];
+	for (int i = 0; i < 16; i++) {
+		mask[i] = (int8_t)((i & ~3) + order[i & 3]);
+	}
+	const __m128i shuffle = _mm_loadu_si128((const __m128i *)mask);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4, p += 16) {
+		__m128i px = _mm_loadu_si128((const __m128i *)p);
+		_mm_storeu_si128((__m128i *)p, _mm_shuffle_epi8(px, shuffle));
+	}
+	return i;
+}
+
+FLN_TARGET("avx2")
+static size_t swizzle_avx2(uint8_t *p, size_t count, const uint8_t *order) {
+	int8_t mask[16];
+	for (int i = 0; i < 16; i++) {
+		mask[i] = (int8_t)((i & ~3) + order[i & 3]);
+	}
+	const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)mask));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8, p += 32) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)p);
+		_mm256_storeu_si256((__m256i *)p, _mm256_shuffle_epi8(px, shuffle));
+	}
+	return i;
+}
+#endif
+
+#if defined(FLN_IMAGE_NEON)
+static size_t swizzle_neon(uint8_t *p, size_t count, const uint8_t *order) {
+	uint8_t mask[16];
+	for (int i = 0; i < 16; i++) {
+		mask[i] = (uint8_t)((i & ~3) + order[i & 3]);
+	}
+	const uint8x16_t shuffle = vld1q_u8(mask);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4, p += 16) {
+		vst1q_u8(p, vqtbl1q_u8(vld1q_u8(p), shuffle));
+	}
+	return i;
+}
+#endif
+
+bool fln_image_swizzle(fln_image *image, const char *pattern) {
+	if (!image->data || image->format != FLN_IMAGE_FORMAT_RGBA8 || strlen(pattern) != 4) {
+		return false;
+	}
+	uint8_t order[4];
+	for (int i = 0; i < 4; i++) {
+		const char *channel = strchr("rgba", pattern[i]);
+		if (!channel || pattern[i] == '\0') {
+			return false;
+		}
+		order[i] = (uint8_t)(channel - "rgba");
+	}
+	size_t count = pixel_count(image);
+	uint8_t *p = image->data;
+	size_t done = 0;
+	switch (get_isa()) {
+#if defined(FLN_IMAGE_X86)
+		case ISA_AVX2:
+			done = swizzle_avx2(p, count, order);
+			break;
+		case ISA_SSE41:
+			done = swizzle_sse41(p, count, order);
+			break;
+#elif defined(FLN_IMAGE_NEON)
+		case ISA_NEON:
+			done = swizzle_neon(p, count, order);
+			break;
+#endif
+		default:
+			break;
+	}
+	swizzle_scalar(p + done * 4, count - done, order);
+	return true;
+}
+
+// flip ----------------------------------------------------------------------
+
+bool fln_image_flip(fln_image *image) {
+	if (!image->data) {
+		return false;
+	}
+	// 行交换本身就是内存拷贝，libc 的 memcpy 已经是向量化的
+	size_t row = fln_image_row_size(image);
+	unsigned char *tmp = fln_alloc(row);
+	if (!tmp) {
+		return false;
+	}
+	unsigned char *top = image->data;
+	unsigned char *bottom = image->data + row * (image->height - 1);
+	for (; top < bottom; top += row, bottom -= row) {
+		memcpy(tmp, top, row);
+		memcpy(top, bottom, row);
+		memcpy(bottom, tmp, row);
+	}
+	fln_free(tmp);
+	return true;
+}
+
+// expand --------------------------------------------------------------------
+// 扩大后在同一块内存中从后往前展开：写入位置 4i 总在尚未读取的源数据 3i 之后
+
+#if defined(FLN_IMAGE_X86)
+FLN_TARGET("sse4.1")
+static void expand_sse41(uint8_t *p, size_t blocks) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	// 每次读 16 字节、只用其中 12 字节，多读的部分已被写过也没有关系
+	for (size_t i = blocks; i-- > 0;) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(p + i * 12));
+		_mm_storeu_si128((__m128i *)(p + i * 16), _mm_or_si128(_mm_shuffle_epi8(px, shuffle), alpha));
+	}
+}
+#endif
+
+#if defined(FLN_IMAGE_NEON)
+static void expand_neon(uint8_t *p, size_t blocks) {
+	for (size_t i = blocks; i-- > 0;) {
+		uint8x16x3_t rgb = vld3q_u8(p + i * 48);
+		uint8x16x4_t rgba = { { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(255) } };
+		vst4q_u8(p + i * 64, rgba);
+	}
+}
+#endif
+
+bool fln_image_expand_rgba(fln_image *image) {
+	if (!image->data || image->format != FLN_IMAGE_FORMAT_RGB8) {
+		return false;
+	}
+	size_t count = pixel_count(image);
+	uint8_t *p = fln_realloc(image->data, count * 4);
+	if (!p) {
+		return false;
+	}
+	image->data = p;
+	image->format = FLN_IMAGE_FORMAT_RGBA8;
+
+	size_t block = 1;
+	switch (get_isa()) {
+#if defined(FLN_IMAGE_X86)
+		case ISA_AVX2:
+		case ISA_SSE41:
+			block = 4;
+			break;
+#elif defined(FLN_IMAGE_NEON)
+		case ISA_NEON:
+			block = 16;
+			break;
+#endif
+		default:
+			break;
+	}
+	size_t blocks = block > 1 ? count / block : 0;
+	// 先处理末尾不足一组的像素（标量实现时是全部像素）
+	for (size_t i = count; i-- > blocks * block;) {
+		p[i * 4 + 3] = 255;
+		p[i * 4 + 2] = p[i * 3 + 2];
+		p[i * 4 + 1] = p[i * 3 + 1];
+		p[i * 4 + 0] = p[i * 3 + 0];
+	}
+	if (blocks == 0) {
+		return true;
+	}
+#if defined(FLN_IMAGE_X86)
+	expand_sse41(p, blocks);
+#elif defined(FLN_IMAGE_NEON)
+	expand_neon(p, blocks);
+#endif
+	return true;
+}
+
+// downscale -----------------------------------------------------------------
+// 舍入方式：avg(avg(上左, 下左), avg(上右, 下右))，与 pavgb / vrhadd 一致
+
+static inline uint8_t avg_u8(unsigned int a, unsigned int b) {
+	return (uint8_t)((a + b + 1) >> 1);
+}
+
+static void downscale_row_scalar(uint8_t *dst, const uint8_t *r0, const uint8_t *r1, size_t begin, size_t count, int channels) {
+	for (size_t x = begin; x < count; x++) {
+		for (int c = 0; c < channels; c++) {
+			size_t s = x * 2 * channels + c;
+			dst[x * channels + c] = avg_u8(avg_u8(r0[s], r1[s]), avg_u8(r0[s + channels], r1[s + channels]));
+		}
+	}
+}
+
+#if defined(FLN_IMAGE_X86)
+FLN_TARGET("sse2")
+static size_t downscale_row_sse2(uint8_t *dst, const uint8_t *r0, const uint8_t *r1, size_t count) {
+	size_t x = 0;
+	for (; x + 4 <= count; x += 4) {
+		__m128i v0 = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(r0 + x * 8)), _mm_loadu_si128((const __m128i *)(r1 + x * 8)));
+		__m128i v1 = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(r0 + x * 8 + 16)), _mm_loadu_si128((const __m128i *)(r1 + x * 8 + 16)));
+		// [p0 p1 p2 p3] -> [p0 p2 p1 p3]
+		v0 = _mm_shuffle_epi32(v0, _MM_SHUFFLE(3, 1, 2, 0));
+		v1 = _mm_shuffle_epi32(v1, _MM_SHUFFLE(3, 1, 2, 0));
+		__m128i even = _mm_unpacklo_epi64(v0, v1);
+		__m128i odd = _mm_unpackhi_epi64(v0, v1);
+		_mm_storeu_si128((__m128i *)(dst + x * 4), _mm_avg_epu8(even, odd));
+	}
+	return x;
+}
+#endif
+
+#if defined(FLN_IMAGE_NEON)
+static size_t downscale_row_neon(uint8_t *dst, const uint8_t *r0, const uint8_t *r1, size_t count) {
+	size_t x = 0;
+	for (; x + 4 <= count; x += 4) {
+		uint32x4_t v0 = vreinterpretq_u32_u8(vrhaddq_u8(vld1q_u8(r0 + x * 8), vld1q_u8(r1 + x * 8)));
+		uint32x4_t v1 = vreinterpretq_u32_u8(vrhaddq_u8(vld1q_u8(r0 + x * 8 + 16), vld1q_u8(r1 + x * 8 + 16)));
+		uint8x16_t even = vreinterpretq_u8_u32(vuzp1q_u32(v0, v1));
+		uint8x16_t odd = vreinterpretq_u8_u32(vuzp2q_u32(v0, v1));
+		vst1q_u8(dst + x * 4, vrhaddq_u8(even, odd));
+	}
+	return x;
+}
+#endif
+
+bool fln_image_downscale(fln_image *image) {
+	if (!image->data || image->width < 2 || image->height < 2) {
+		return false;
+	}
+	int channels = fln_image_channels(image->format);
+	size_t row = fln_image_row_size(image);
+	size_t width = image->width / 2;
+	int height = image->height / 2;
+	isa_level level = image->format == FLN_IMAGE_FORMAT_RGBA8 ? get_isa() : ISA_SCALAR;
+	// 目标行总在对应的源行之前，读取先于写入，可以原地进行
+	for (int y = 0; y < height; y++) {
+		uint8_t *dst = image->data + y * width * channels;
+		const uint8_t *r0 = image->data + (size_t)y * 2 * row;
+		const uint8_t *r1 = r0 + row;
+		size_t done = 0;
+		switch (level) {
+#if defined(FLN_IMAGE_X86)
+			case ISA_AVX2:
+			case ISA_SSE41:
+			case ISA_SSE2:
+				done = downscale_row_sse2(dst, r0, r1, width);
+				break;
+#elif defined(FLN_IMAGE_NEON)
+			case ISA_NEON:
+				done = downscale_row_neon(dst, r0, r1, width);
+				break;
+#endif
+			default:
+				break;
+		}
+		downscale_row_scalar(dst, r0, r1, done, width, channels);
+	}
+	image->width = (int)width;
+	image->height = height;
+	return true;
+}
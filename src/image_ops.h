@@ -0,0 +1,35 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stddef.h>
+
+#include "data.h"
+
+// fln_image 的原地处理，x86 上按运行时检测选择 AVX2 / SSE4.1 / SSE2，aarch64 上使用 NEON，其余平台走标量实现
+// 所有函数都假定数据紧密排列（行跨度 = width * 通道数）
+
+int fln_image_channels(fln_image_format format);
+
+// 每行字节数
+size_t fln_image_row_size(const fln_image *image);
+
+// RGBA8 和 RG8（灰度 + alpha）：颜色乘以 alpha
+bool fln_image_premultiply(fln_image *image);
+
+// RGBA8：按 pattern 重排通道，pattern 是由 r/g/b/a 组成的 4 个字符，例如 "bgra"
+bool fln_image_swizzle(fln_image *image, const char *pattern);
+
+// 上下翻转，任意格式
+bool fln_image_flip(fln_image *image);
+
+// RGB8 扩展为 RGBA8（alpha = 255），会重新分配 data
+bool fln_image_expand_rgba(fln_image *image);
+
+// 长宽减半（2x2 盒式滤波），奇数边长会丢弃最后一行/列，data 不会重新分配
+bool fln_image_downscale(fln_image *image);
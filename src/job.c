@@ -0,0 +1,263 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "job.h"
+
+#include <SDL3/SDL_cpuinfo.h>
+#include <SDL3/SDL_mutex.h>
+#include <SDL3/SDL_thread.h>
+
+#include "memory.h"
+#include "profiler.h"
+
+#define MAX_WORKERS 4
+
+typedef enum job_state {
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_FINISHED,
+} job_state;
+
+struct fln_job {
+	fln_job_func work;
+	fln_job_func done;
+	void *userdata;
+	job_state state;
+	struct fln_job *next;
+};
+
+static SDL_Mutex *mutex = nullptr;
+static SDL_Condition *queued_cond = nullptr; // 有新任务
+static SDL_Condition *finished_cond = nullptr; // 有任务完成
+static SDL_Condition *drained_cond = nullptr; // 排队的任务都已被取走
+static SDL_Thread *workers[MAX_WORKERS];
+static int workers_count = 0;
+static bool quitting = false;
+
+// 两个单链表：等待执行的任务（FIFO）和已完成待 poll 的任务
+static fln_job *queue_head = nullptr;
+static fln_job *queue_tail = nullptr;
+static fln_job *finished = nullptr;
+
+static int worker_main(void *data) {
+	fln_profiler_thread_name("job worker");
+	SDL_LockMutex(mutex);
+	while (true) {
+		while (!queue_head && !quitting) {
+			SDL_WaitCondition(queued_cond, mutex);
+		}
+		if (quitting) {
+			break;
+		}
+		fln_job *job = queue_head;
+		queue_head = job->next;
+		if (!queue_head) {
+			queue_tail = nullptr;
+			SDL_BroadcastCondition(drained_cond);
+		}
+		job->state = JOB_RUNNING;
+		SDL_UnlockMutex(mutex);
+
+		FLN_ZONE_BEGIN("job");
+		job->work(job->userdata);
+		FLN_ZONE_END();
+
+		SDL_LockMutex(mutex);
+		job->state = JOB_FINISHED;
+		job->next = finished;
+		finished = job;
+		SDL_BroadcastCondition(finished_cond);
+	}
+	SDL_UnlockMutex(mutex);
+	return 0;
+}
+
+static bool start_workers(void) {
+	if (mutex) {
+		return workers_count > 0;
+	}
+	mutex = SDL_CreateMutex();
+	queued_cond = SDL_CreateCondition();
+	finished_cond = SDL_CreateCondition();
+	drained_cond = SDL_CreateCondition();
+	if (!mutex || !queued_cond || !finished_cond || !drained_cond) {
+		printf("failed to create job system primitives: %s\n", SDL_GetError());
+		SDL_DestroyCondition(queued_cond);
+		SDL_DestroyCondition(finished_cond);
+		SDL_DestroyCondition(drained_cond);
+		SDL_DestroyMutex(mutex);
+		queued_cond = nullptr;
+		finished_cond = nullptr;
+		drained_cond = nullptr;
+		mutex = nullptr;
+		return false;
+	}
+	int count = SDL_GetNumLogicalCPUCores() - 1;
+	if (count < 1) {
+		count = 1;
+	} else if (count > MAX_WORKERS) {
+		count = MAX_WORKERS;
+	}
+	for (int i = 0; i < count; i++) {
+		workers[workers_count] = SDL_CreateThread(worker_main, "flandre-job", nullptr);
+		if (workers[workers_count]) {
+			workers_count++;
+		}
+	}
+	if (workers_count == 0) {
+		printf("failed to create job worker threads: %s\n", SDL_GetError());
+		return false;
+	}
+	return true;
+}
+
+fln_job *fln_job_submit(fln_job_func work, fln_job_func done, void *userdata) {
+	fln_job *job = fln_alloc(sizeof(fln_job));
+	if (!job) {
+		return nullptr;
+	}
+	job->work = work;
+	job->done = done;
+	job->userdata = userdata;
+	job->state = JOB_QUEUED;
+	job->next = nullptr;
+	if (!start_workers()) {
+		// 没有工作线程时退化为同步执行，done 仍然在下一次 poll 时调用
+		job->work(job->userdata);
+		if (mutex) {
+			SDL_LockMutex(mutex);
+		}
+		job->state = JOB_FINISHED;
+		job->next = finished;
+		finished = job;
+		if (mutex) {
+			SDL_UnlockMutex(mutex);
+		}
+		return job;
+	}
+	SDL_LockMutex(mutex);
+	if (queue_tail) {
+		queue_tail->next = job;
+	} else {
+		queue_head = job;
+	}
+	queue_tail = job;
+	SDL_SignalCondition(queued_cond);
+	SDL_UnlockMutex(mutex);
+	return job;
+}
+
+static void unlink_job(fln_job **head, fln_job *job) {
+	for (fln_job **link = head; *link; link = &(*link)->next) {
+		if (*link == job) {
+			*link = job->next;
+			return;
+		}
+	}
+}
+
+// 取走一个任务：还在排队时从队列中摘下并返回 true（work 尚未执行），否则等待它结束
+static bool take_job(fln_job *job) {
+	if (mutex) {
+		SDL_LockMutex(mutex);
+	}
+	bool queued = job->state == JOB_QUEUED;
+	if (queued) {
+		unlink_job(&queue_head, job);
+		queue_tail = nullptr;
+		for (fln_job *it = queue_head; it; it = it->next) {
+			queue_tail = it;
+		}
+		if (mutex && !queue_head) {
+			SDL_BroadcastCondition(drained_cond);
+		}
+	} else {
+		while (job->state != JOB_FINISHED) {
+			SDL_WaitCondition(finished_cond, mutex);
+		}
+		unlink_job(&finished, job);
+	}
+	if (mutex) {
+		SDL_UnlockMutex(mutex);
+	}
+	return queued;
+}
+
+void fln_job_wait(fln_job *job) {
+	if (take_job(job)) {
+		// 还没开始就直接抢过来执行
+		job->work(job->userdata);
+	}
+	if (job->done) {
+		job->done(job->userdata);
+	}
+	fln_free(job);
+}
+
+void fln_job_cancel(fln_job *job, fln_job_func cancelled) {
+	take_job(job);
+	if (cancelled) {
+		cancelled(job->userdata);
+	}
+	fln_free(job);
+}
+
+void fln_job_poll(void) {
+	if (mutex) {
+		SDL_LockMutex(mutex);
+	}
+	fln_job *list = finished;
+	finished = nullptr;
+	if (mutex) {
+		SDL_UnlockMutex(mutex);
+	}
+	// 链表是倒序的，先反转一下保证按完成顺序回调
+	fln_job *ordered = nullptr;
+	while (list) {
+		fln_job *next = list->next;
+		list->next = ordered;
+		ordered = list;
+		list = next;
+	}
+	while (ordered) {
+		fln_job *next = ordered->next;
+		if (ordered->done) {
+			ordered->done(ordered->userdata);
+		}
+		fln_free(ordered);
+		ordered = next;
+	}
+}
+
+void fln_job_quit(void) {
+	if (!mutex) {
+		fln_job_poll();
+		return;
+	}
+	// 先把排队中的任务做完，避免 done 里持有的资源泄漏
+	SDL_LockMutex(mutex);
+	while (queue_head) {
+		SDL_WaitCondition(drained_cond, mutex);
+	}
+	quitting = true;
+	SDL_BroadcastCondition(queued_cond);
+	SDL_UnlockMutex(mutex);
+	for (int i = 0; i < workers_count; i++) {
+		SDL_WaitThread(workers[i], nullptr);
+	}
+	workers_count = 0;
+	fln_job_poll();
+	SDL_DestroyCondition(queued_cond);
+	SDL_DestroyCondition(finished_cond);
+	SDL_DestroyCondition(drained_cond);
+	SDL_DestroyMutex(mutex);
+	queued_cond = nullptr;
+	finished_cond = nullptr;
+	drained_cond = nullptr;
+	mutex = nullptr;
+	quitting = false;
+}
@@ -0,0 +1,27 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+// 简单的后台任务：work 在工作线程上执行，done 在主线程的 fln_job_poll 中执行
+typedef void (*fln_job_func)(void *userdata);
+
+typedef struct fln_job fln_job;
+
+fln_job *fln_job_submit(fln_job_func work, fln_job_func done, void *userdata);
+
+// 阻塞直到任务完成并立即执行 done，之后 job 不再有效
+// 如果任务还在排队，会直接在当前线程上执行
+void fln_job_wait(fln_job *job);
+
+// 取消任务：还在排队时不再执行 work，已经开始时等待它结束；之后调用 cancelled 而不是 done，job 不再有效
+void fln_job_cancel(fln_job *job, fln_job_func cancelled);
+
+// 主线程每帧调用，执行已完成任务的 done
+void fln_job_poll(void);
+
+void fln_job_quit(void);
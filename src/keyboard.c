@@ -11,58 +11,223 @@
 #include <SDL3/SDL_keycode.h>
 #include <SDL3/SDL_mouse.h>
 #include <lauxlib.h>
+#include <string.h>
 #include <uthash.h>
 
-#include "memory.h"
+#include "error.h"
 
-typedef struct key_state_entry_s {
-	int key;
-	bool state;
+// 按 scancode 索引的位集合（SDL_SCANCODE_COUNT 个，见 scancode.txt）
+#define KEY_WORDS ((SDL_SCANCODE_COUNT + 63) / 64)
+
+typedef struct key_bits {
+	uint64_t bits[KEY_WORDS];
+} key_bits;
+
+static key_bits key_down; // 当前按住的键
+static key_bits key_pressed; // 上一次 iterate 之后按下过的键（按下又松开也算）
+static key_bits key_released; // 上一次 iterate 之后松开过的键
+
+static inline bool test_key(const key_bits *keys, int key) {
+	return (keys->bits[key >> 6] >> (key & 63)) & 1;
+}
+
+static inline void set_key(key_bits *keys, int key, bool value) {
+	uint64_t mask = (uint64_t)1 << (key & 63);
+	if (value) {
+		keys->bits[key >> 6] |= mask;
+	} else {
+		keys->bits[key >> 6] &= ~mask;
+	}
+}
+
+// 动作映射：一个动作绑定若干个键，任意一个按住即为按住，每帧在 C 中统一求值一次
+
+#define MAX_ACTIONS 256
+#define MAX_ACTION_KEYS 8
+#define ACTION_NAME_SIZE 32
+
+typedef struct key_action {
+	char name[ACTION_NAME_SIZE];
+	uint16_t keys[MAX_ACTION_KEYS];
+	int key_count;
+	bool down;
+	bool pressed;
+	bool released;
 	UT_hash_handle hh;
-} key_state_entry;
+} key_action;
 
-static key_state_entry *key_states = nullptr;
+static key_action actions[MAX_ACTIONS];
+static int actions_count = 0;
+static key_action *actions_by_name = nullptr;
+
+static int check_scancode(lua_State *L, int index) {
+	lua_Integer key = luaL_checkinteger(L, index);
+	if (key < 0 || key >= SDL_SCANCODE_COUNT) {
+		return fln_error(L, "invalid scancode: %d", (int)key);
+	}
+	return (int)key;
+}
+
+// 查询多个键时返回同样数量的结果
+static int query_keys(lua_State *L, const key_bits *keys) {
+	int n = lua_gettop(L);
+	luaL_checkinteger(L, 1);
+	for (int i = 1; i <= n; i++) {
+		lua_pushboolean(L, test_key(keys, check_scancode(L, i)));
+	}
+	return n;
+}
 
 static int l_pressed(lua_State *L) {
-	int key = luaL_checkinteger(L, 1);
-	key_state_entry *entry;
-	HASH_FIND_INT(key_states, &key, entry);
-	lua_pushboolean(L, entry ? entry->state : false);
+	return query_keys(L, &key_down);
+}
+
+static int l_just_pressed(lua_State *L) {
+	return query_keys(L, &key_pressed);
+}
+
+static int l_just_released(lua_State *L) {
+	return query_keys(L, &key_released);
+}
+
+// keyboard.bind(name, key | { keys }) -> id
+// 已有的动作会替换绑定的键，传入空表则清除绑定；之后可以用 id 或者名字查询
+static int l_bind(lua_State *L) {
+	size_t len;
+	const char *name = luaL_checklstring(L, 1, &len);
+	if (len >= ACTION_NAME_SIZE) {
+		return fln_error(L, "action name too long (max %d)", ACTION_NAME_SIZE - 1);
+	}
+	uint16_t keys[MAX_ACTION_KEYS];
+	int key_count = 0;
+	if (lua_istable(L, 2)) {
+		int n = (int)luaL_len(L, 2);
+		if (n > MAX_ACTION_KEYS) {
+			return fln_error(L, "too many keys for action '%s' (max %d)", name, MAX_ACTION_KEYS);
+		}
+		for (int i = 1; i <= n; i++) {
+			lua_rawgeti(L, 2, i);
+			keys[key_count++] = (uint16_t)check_scancode(L, -1);
+			lua_pop(L, 1);
+		}
+	} else {
+		keys[key_count++] = (uint16_t)check_scancode(L, 2);
+	}
+
+	key_action *action;
+	HASH_FIND_STR(actions_by_name, name, action);
+	if (!action) {
+		if (actions_count == MAX_ACTIONS) {
+			return fln_error(L, "too many actions (max %d)", MAX_ACTIONS);
+		}
+		action = &actions[actions_count++];
+		memset(action, 0, sizeof(*action));
+		memcpy(action->name, name, len + 1);
+		HASH_ADD_STR(actions_by_name, name, action);
+	}
+	memcpy(action->keys, keys, key_count * sizeof(uint16_t));
+	action->key_count = key_count;
+	lua_pushinteger(L, action - actions + 1);
+	return 1;
+}
+
+static key_action *check_action(lua_State *L, int index) {
+	if (lua_type(L, index) == LUA_TNUMBER) {
+		lua_Integer id = luaL_checkinteger(L, index);
+		if (id < 1 || id > actions_count) {
+			fln_error(L, "invalid action id: %d", (int)id);
+		}
+		return &actions[id - 1];
+	}
+	const char *name = luaL_checkstring(L, index);
+	key_action *action;
+	HASH_FIND_STR(actions_by_name, name, action);
+	if (!action) {
+		fln_error(L, "action '%s' not found", name);
+	}
+	return action;
+}
+
+// keyboard.action(id | name) -> down, just_pressed, just_released
+static int l_action(lua_State *L) {
+	key_action *action = check_action(L, 1);
+	lua_pushboolean(L, action->down);
+	lua_pushboolean(L, action->pressed);
+	lua_pushboolean(L, action->released);
+	return 3;
+}
+
+// keyboard.actions([t]) -> t
+// 一次取出所有动作：t[name] = down，传入的表会被复用
+static int l_actions(lua_State *L) {
+	if (lua_istable(L, 1)) {
+		lua_settop(L, 1);
+	} else {
+		lua_createtable(L, 0, actions_count);
+	}
+	for (int i = 0; i < actions_count; i++) {
+		lua_pushboolean(L, actions[i].down);
+		lua_setfield(L, -2, actions[i].name);
+	}
 	return 1;
 }
 
+void fln_keyboard_consume_edges(void) {
+	memset(&key_pressed, 0, sizeof(key_pressed));
+	memset(&key_released, 0, sizeof(key_released));
+	for (int i = 0; i < actions_count; i++) {
+		actions[i].pressed = false;
+		actions[i].released = false;
+	}
+}
+
 void fln_receive_keyboard_events(const SDL_Event *event) {
 	if (event->type == SDL_EVENT_KEY_DOWN || event->type == SDL_EVENT_KEY_UP) {
 		int key = event->key.scancode;
+		if (key < 0 || key >= SDL_SCANCODE_COUNT) {
+			return;
+		}
 		bool is_down = (event->type == SDL_EVENT_KEY_DOWN);
+		if (is_down && !event->key.repeat) {
+			set_key(&key_pressed, key, true);
+		} else if (!is_down) {
+			set_key(&key_released, key, true);
+		}
+		set_key(&key_down, key, is_down);
+	}
+}
 
-		key_state_entry *entry;
-		HASH_FIND_INT(key_states, &key, entry);
-
-		if (entry) {
-			entry->state = is_down;
-		} else {
-			entry = fln_alloc(sizeof(key_state_entry));
-			if (entry) {
-				entry->key = key;
-				entry->state = is_down;
-				HASH_ADD_INT(key_states, key, entry);
-			}
+void fln_keyboard_update(void) {
+	for (int i = 0; i < actions_count; i++) {
+		key_action *action = &actions[i];
+		bool down = false;
+		bool tapped = false;
+		for (int k = 0; k < action->key_count; k++) {
+			down |= test_key(&key_down, action->keys[k]);
+			tapped |= test_key(&key_pressed, action->keys[k]);
 		}
+		// 按下又松开时 pressed 与 released 同时为真；边沿保留到被 iterate 消费为止
+		action->pressed |= !action->down && (down || tapped);
+		action->released |= (action->down || tapped) && !down;
+		action->down = down;
 	}
 }
 
 void fln_clear_key_states() {
-	key_state_entry *entry, *tmp;
-	HASH_ITER(hh, key_states, entry, tmp) {
-		HASH_DEL(key_states, entry);
-		fln_free(entry);
-	}
+	memset(&key_down, 0, sizeof(key_down));
+	fln_keyboard_consume_edges();
+	HASH_CLEAR(hh, actions_by_name);
+	actions_count = 0;
 }
 
 int fln_luaopen_keyboard(lua_State *L) {
 	const luaL_Reg funcs[] = {
 		{ "pressed", l_pressed },
+		{ "just_pressed", l_just_pressed },
+		{ "just_released", l_just_released },
+		{ "bind", l_bind },
+		{ "action", l_action },
+		{ "actions", l_actions },
 		{ nullptr, nullptr }
 	};
 	luaL_newlib(L, funcs);
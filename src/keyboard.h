@@ -9,8 +9,15 @@
 #include <SDL3/SDL_events.h>
 #include <lua.h>
 
+// 按下/松开的边沿一直保留到被 iterate 消费：每次调用 iterate 回调之后清除
+// 固定步长下一帧没有 iterate 时边沿留到下一帧，一帧有多次 iterate 时只有第一次能看到
+void fln_keyboard_consume_edges(void);
+
 void fln_receive_keyboard_events(const SDL_Event *event);
 
+// 每帧处理完事件之后调用，对所有动作求值
+void fln_keyboard_update(void);
+
 void fln_clear_key_states(void);
 
 int fln_luaopen_keyboard(lua_State *L);
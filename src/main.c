@@ -9,6 +9,7 @@
 #include <cglm/cglm.h>
 #include <cglm/mat4.h>
 #include <cglm/types.h>
+#include <stdlib.h>
 #include <string.h>
 #define SDL_MAIN_USE_CALLBACKS 1
 #include <SDL3/SDL.h>
@@ -18,30 +19,135 @@
 #include <lualib.h>
 
 #include "appstate.h"
+#include "bytecode.h"
+#include "event.h"
 #include "flandre.h"
+#include "font.h"
+#include "gc.h"
 #include "graphics.h"
+#include "job.h"
 #include "keyboard.h"
 #include "memory.h"
 #include "mouse.h"
 #include "opengl/glad.h"
+#include "pacing.h"
+#include "profiler.h"
+#include "replay.h"
+#include "stats.h"
 #include "system.h"
+#include "text.h"
+#include "timer.h"
+
+static uint64_t frame_limit = 0; // --frames=N：运行 N 帧后退出，0 表示不限制
+static uint64_t frame_count = 0;
+static const char *trace_path = nullptr; // --trace=path：从启动开始记录区段，退出时导出
+static bool render_thread = false;
+static const char *record_path = nullptr; // --record=path：录制输入
+static const char *replay_path = nullptr; // --replay=path：回放录制的输入，结束后退出
+static const char *bytecode_cache = nullptr; // --bytecode-cache=dir|off：字节码缓存目录，默认在用户数据目录下
+static const char *archive_path = nullptr; // --archive=path：从 flandre-luac 生成的归档加载脚本
+static bool startup_times = false; // --startup-times：初始化结束后打印各阶段的耗时
+
+// 启动阶段：--trace 时同时作为区段记录
+#define MAX_STARTUP_PHASES 16
+
+typedef struct startup_phase {
+	const char *name;
+	uint64_t begin;
+	uint64_t end;
+} startup_phase;
+
+static startup_phase startup_phases[MAX_STARTUP_PHASES];
+static int startup_phases_count = 0;
+
+static void startup_begin(const char *name) {
+	FLN_ZONE_BEGIN(name);
+	if (startup_phases_count < MAX_STARTUP_PHASES) {
+		startup_phases[startup_phases_count++] = (startup_phase){ name, SDL_GetTicksNS(), 0 };
+	}
+}
+
+static void startup_end(void) {
+	FLN_ZONE_END();
+	startup_phases[startup_phases_count - 1].end = SDL_GetTicksNS();
+}
+
+static void startup_report(void) {
+	if (!startup_times || startup_phases_count == 0) {
+		return;
+	}
+	printf("startup:\n");
+	for (int i = 0; i < startup_phases_count; i++) {
+		const startup_phase *phase = &startup_phases[i];
+		printf("  %-10s %8.2f ms\n", phase->name, (double)(phase->end - phase->begin) / 1e6);
+	}
+	double total = (double)(startup_phases[startup_phases_count - 1].end - startup_phases[0].begin) / 1e6;
+	printf("  %-10s %8.2f ms\n", "total", total);
+}
 
 int SDL_AppInit(void **appstate_, int argc, char *argv[]) {
 	if (!SDL_SetAppMetadata("Flandre", "0.1.0 dev", "flandre")) {
 		return SDL_APP_FAILURE;
 	}
+	const char *gfx = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			gfx = "headless";
+		} else if (strncmp(argv[i], "--gfx=", 6) == 0) {
+			gfx = argv[i] + 6;
+		} else if (strncmp(argv[i], "--frames=", 9) == 0) {
+			frame_limit = strtoull(argv[i] + 9, nullptr, 10);
+		} else if (strncmp(argv[i], "--trace=", 8) == 0) {
+			trace_path = argv[i] + 8;
+		} else if (strcmp(argv[i], "--render-thread") == 0) {
+			render_thread = true;
+		} else if (strncmp(argv[i], "--record=", 9) == 0) {
+			record_path = argv[i] + 9;
+		} else if (strncmp(argv[i], "--replay=", 9) == 0) {
+			replay_path = argv[i] + 9;
+		} else if (strncmp(argv[i], "--bytecode-cache=", 17) == 0) {
+			bytecode_cache = argv[i] + 17;
+		} else if (strncmp(argv[i], "--archive=", 10) == 0) {
+			archive_path = argv[i] + 10;
+		} else if (strcmp(argv[i], "--startup-times") == 0) {
+			startup_times = true;
+		}
+	}
+	fln_profiler_thread_name("main");
+	if (trace_path) {
+		fln_profiler_enable(true);
+	}
+	if (gfx) {
+		if (!fln_gfx_select_backend(gfx)) {
+			printf("graphics backend '%s' is not available in this build\n", gfx);
+			return SDL_APP_FAILURE;
+		}
+		// 不需要显示器
+		if (strcmp(gfx, "opengl") != 0) {
+			SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+		}
+	}
+	startup_begin("lua");
 	*appstate_ = fln_alloc(sizeof(fln_app_state));
 	fln_app_state *appstate = (fln_app_state *)*appstate_;
 	if (!appstate) {
 		printf("cannot allocate memory for fln_app_state\n");
 	}
 	memset(appstate, 0, sizeof(fln_app_state));
+	appstate->render_thread = render_thread;
 	appstate->L = luaL_newstate();
 	if (!appstate) {
 		printf("cannot allocate memory for lua_State\n");
 	}
 	luaL_openlibs(appstate->L);
 	luaL_requiref(appstate->L, "flandre", fln_luaopen, false);
+	if (!fln_bytecode_init(appstate->L, bytecode_cache, archive_path)) {
+		return SDL_APP_FAILURE;
+	}
+	// 根脚本在工作线程上编译，同时主线程创建窗口和图形上下文
+	fln_bytecode_prefetch("root.lua");
+	startup_end();
+	startup_begin("window");
 	if (!SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_EVENTS)) {
 		printf("failed to call SDL_InitSubSystem()\n");
 		return SDL_APP_FAILURE;
@@ -52,43 +158,69 @@ int SDL_AppInit(void **appstate_, int argc, char *argv[]) {
 		printf("failed to call SDL_CreateWindow()\n");
 		return SDL_APP_FAILURE;
 	}
+	startup_end();
+	startup_begin("graphics");
 	fln_system_init(appstate);
+	fln_event_init();
 	if (!fln_gfx_init(appstate)) {
 		return SDL_APP_FAILURE;
 	}
-	if (luaL_dofile(appstate->L, "root.lua")) {
+	startup_end();
+	startup_begin("input");
+	fln_pacing_init(appstate);
+	if (!fln_replay_init(appstate, record_path, replay_path)) {
+		return SDL_APP_FAILURE;
+	}
+	fln_mouse_init(appstate);
+	startup_end();
+	startup_begin("root.lua");
+	if (fln_bytecode_dofile(appstate->L, "root.lua")) {
 		printf("(in script) (root) %s\n", lua_tostring(appstate->L, -1));
 	}
+	fln_timer_end_script_zones();
+	startup_end();
+	startup_report();
+	// 根脚本的初始化按默认方式回收，之后由引擎每帧调度
+	fln_gc_init(appstate->L);
 	return SDL_APP_CONTINUE;
 }
 
 int SDL_AppIterate(void *appstate_) {
 	fln_app_state *appstate = (fln_app_state *)appstate_;
-	if (fln_shoulderminte()) {
+	if (fln_shoulderminte() || fln_replay_finished()) {
 		return SDL_APP_SUCCESS;
 	}
-	// uint64 frame_start = SDL_GetTicks();
+	fln_timer_new_frame();
+	fln_stats_begin_frame();
+	fln_font_new_frame();
+	fln_text_new_frame();
+	fln_job_poll();
+	fln_event_dispatch(appstate);
+	FLN_ZONE_BEGIN("iterate");
 	fln_iterate(appstate->L);
+	FLN_ZONE_END();
 	fln_gfx_begin_drawing(appstate);
+	FLN_ZONE_BEGIN("draw");
 	fln_draw(appstate->L);
+	FLN_ZONE_END();
+	FLN_ZONE_BEGIN("end_drawing");
 	fln_gfx_end_drawing(appstate);
-	/*
-	uint64 frameime = SDL_GetTicks() - frame_start;
-	if (frameime <= 15)
-	{
-		SDL_Delay(15 - frameime);
-	}*/
+	FLN_ZONE_END();
+	fln_gc_frame(appstate->L);
+	fln_stats_end_frame(appstate->L);
+	if (frame_limit && ++frame_count >= frame_limit) {
+		return SDL_APP_SUCCESS;
+	}
+	fln_pacing_wait();
 	return SDL_APP_CONTINUE;
 }
 
 int SDL_AppEvent(void *appstate_, const SDL_Event *event) {
-	fln_app_state *appstate = (fln_app_state *)appstate_;
 	if (event->type == SDL_EVENT_QUIT) {
 		return SDL_APP_SUCCESS;
 	} else {
-		fln_receive_keyboard_events(event);
-		fln_receive_mouse_events(event);
-		fln_gfx_receive_window_events(appstate, event);
+		// 可能不在主线程上，留到下一帧开始时处理
+		fln_event_push(event);
 	}
 	return SDL_APP_CONTINUE;
 }
@@ -97,9 +229,23 @@ void SDL_AppQuit(void *appstate_) {
 	fln_app_state *appstate = (fln_app_state *)appstate_;
 	fln_exit(appstate->L);
 	lua_close(appstate->L);
+	fln_bytecode_quit();
+	fln_text_quit();
 	// lua虚拟机一定要最先关闭，否则一些资源会丢失上下文（例如OpenGL资源会在上下文已经释放过后再释放）
 	fln_gfx_destroy_resource(appstate);
+	fln_job_quit();
+	if (trace_path) {
+		const char *err = nullptr;
+		if (!fln_profiler_write_trace(trace_path, &err)) {
+			printf("failed to write trace '%s': %s\n", trace_path, err);
+		}
+	}
+	fln_profiler_quit();
+	fln_font_quit();
 	fln_clear_key_states();
+	fln_event_quit();
+	fln_mouse_quit();
+	fln_replay_quit();
 	SDL_DestroyWindow(appstate->window);
 	fln_free(appstate);
 }
@@ -0,0 +1,90 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool fln_map_file(fln_mapped_file *file, const char *path) {
+	file->data = nullptr;
+	file->size = 0;
+	file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file->file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file->file, &size) || size.QuadPart == 0) {
+		CloseHandle(file->file);
+		return false;
+	}
+	file->mapping = CreateFileMappingA(file->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!file->mapping) {
+		CloseHandle(file->file);
+		return false;
+	}
+	file->data = MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!file->data) {
+		CloseHandle(file->mapping);
+		CloseHandle(file->file);
+		return false;
+	}
+	file->size = (size_t)size.QuadPart;
+	return true;
+}
+
+void fln_unmap_file(fln_mapped_file *file) {
+	if (file->data) {
+		UnmapViewOfFile(file->data);
+		CloseHandle(file->mapping);
+		CloseHandle(file->file);
+		file->data = nullptr;
+		file->size = 0;
+	}
+}
+
+#else
+
+bool fln_map_file(fln_mapped_file *file, const char *path) {
+	file->data = nullptr;
+	file->size = 0;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // 映射建立后就不再需要文件描述符了
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	file->data = data;
+	file->size = st.st_size;
+	return true;
+}
+
+void fln_unmap_file(fln_mapped_file *file) {
+	if (file->data) {
+		munmap((void *)file->data, file->size);
+		file->data = nullptr;
+		file->size = 0;
+	}
+}
+
+#endif
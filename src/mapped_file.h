@@ -0,0 +1,24 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stddef.h>
+
+// 只读的文件映射
+typedef struct fln_mapped_file {
+	const void *data;
+	size_t size;
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+} fln_mapped_file;
+
+bool fln_map_file(fln_mapped_file *file, const char *path);
+
+void fln_unmap_file(fln_mapped_file *file);
@@ -10,6 +10,7 @@
 #include <cglm/cglm.h>
 #include <lauxlib.h>
 #include <lua.h>
+#include <string.h>
 
 #include "error.h"
 #include "memory.h"
@@ -186,6 +187,163 @@ static int l_mransform_release(lua_State *L) {
 	return 0;
 }
 
+// 批量变换：输入输出都是打包的 float 字符串（string.pack 或者 data 模块的结果），与 graphics.mesh 的顶点数据格式相同
+// 矩阵按列主序写入，每个矩阵 16 个 float，可以作为 4 个 vec4、除数为 1 的实例属性交给 submit_instanced
+
+typedef struct batch_layout {
+	mat4 parent; // 左乘的父变换
+	bool has_parent;
+	size_t stride; // 每条记录的 float 数量
+	size_t offset; // 矩阵在记录中的位置（float）
+	const char *base; // 复制到输出中的原有数据（例如交错的逐实例属性），矩阵之外的部分保持不变
+	size_t base_size;
+} batch_layout;
+
+// options: { parent = transform, stride = 16, offset = 0, base = string }
+static void check_batch_layout(lua_State *L, int index, batch_layout *layout) {
+	layout->has_parent = false;
+	layout->stride = 16;
+	layout->offset = 0;
+	layout->base = nullptr;
+	layout->base_size = 0;
+	if (lua_isnoneornil(L, index)) {
+		return;
+	}
+	luaL_checktype(L, index, LUA_TTABLE);
+	if (lua_getfield(L, index, "parent") != LUA_TNIL) {
+		mat4 **parent = luaL_checkudata(L, -1, FLN_USERTYPE_TRANSFORM);
+		if (!*parent) {
+			fln_error(L, "invalid transform (parent)");
+		}
+		glm_mat4_copy(**parent, layout->parent);
+		layout->has_parent = true;
+	}
+	lua_getfield(L, index, "stride");
+	lua_Integer stride = luaL_optinteger(L, -1, 16);
+	lua_getfield(L, index, "offset");
+	lua_Integer offset = luaL_optinteger(L, -1, 0);
+	if (stride < 16 || offset < 0 || offset > stride - 16) {
+		fln_error(L, "invalid layout (stride %d, offset %d)", (int)stride, (int)offset);
+	}
+	layout->stride = (size_t)stride;
+	layout->offset = (size_t)offset;
+	// base 留在栈上，保证在写入输出之前一直有效
+	if (lua_getfield(L, index, "base") != LUA_TNIL) {
+		layout->base = luaL_checklstring(L, -1, &layout->base_size);
+	}
+}
+
+// 准备 count 条记录的输出缓冲区
+static char *batch_output(lua_State *L, luaL_Buffer *buffer, const batch_layout *layout, size_t count, size_t *size) {
+	*size = count * layout->stride * sizeof(float);
+	if (layout->base) {
+		if (layout->base_size < *size) {
+			fln_error(L, "base is too small (%d bytes, %d needed)", (int)layout->base_size, (int)*size);
+		}
+		*size = layout->base_size;
+	}
+	char *out = luaL_buffinitsize(L, buffer, *size);
+	if (layout->base) {
+		memcpy(out, layout->base, *size);
+	} else {
+		memset(out, 0, *size);
+	}
+	return out;
+}
+
+static inline void batch_store(char *out, const batch_layout *layout, size_t i, mat4 m) {
+	if (layout->has_parent) {
+		mat4 result;
+		glm_mat4_mul((vec4 *)layout->parent, m, result);
+		memcpy(out + (i * layout->stride + layout->offset) * sizeof(float), result, sizeof(mat4));
+	} else {
+		memcpy(out + (i * layout->stride + layout->offset) * sizeof(float), m, sizeof(mat4));
+	}
+}
+
+// math.compose(positions, [rotations], [scales], [options]) -> string
+// positions 每项 3 个 float，rotations 是四元数（x, y, z, w），scales 每项 3 个 float，省略时为单位旋转/缩放
+// 结果为 parent * T * R * S
+static int l_compose(lua_State *L) {
+	size_t positions_size, rotations_size = 0, scales_size = 0;
+	const char *positions = luaL_checklstring(L, 1, &positions_size);
+	const char *rotations = luaL_optlstring(L, 2, nullptr, &rotations_size);
+	const char *scales = luaL_optlstring(L, 3, nullptr, &scales_size);
+	if (positions_size % (3 * sizeof(float)) != 0) {
+		return fln_error(L, "positions size must be a multiple of 12 bytes");
+	}
+	size_t count = positions_size / (3 * sizeof(float));
+	if (rotations && rotations_size != count * 4 * sizeof(float)) {
+		return fln_error(L, "rotations must contain %d quaternions", (int)count);
+	}
+	if (scales && scales_size != count * 3 * sizeof(float)) {
+		return fln_error(L, "scales must contain %d vectors", (int)count);
+	}
+	batch_layout layout;
+	check_batch_layout(L, 4, &layout);
+
+	luaL_Buffer buffer;
+	size_t size;
+	char *out = batch_output(L, &buffer, &layout, count, &size);
+	for (size_t i = 0; i < count; i++) {
+		mat4 m;
+		if (rotations) {
+			versor q;
+			memcpy(q, rotations + i * sizeof(versor), sizeof(versor));
+			glm_quat_mat4(q, m);
+		} else {
+			glm_mat4_identity(m);
+		}
+		if (scales) {
+			vec3 s;
+			memcpy(s, scales + i * sizeof(vec3), sizeof(vec3));
+			for (int c = 0; c < 3; c++) {
+				m[c][0] *= s[c];
+				m[c][1] *= s[c];
+				m[c][2] *= s[c];
+			}
+		}
+		memcpy(m[3], positions + i * sizeof(vec3), sizeof(vec3));
+		m[3][3] = 1.0f;
+		batch_store(out, &layout, i, m);
+	}
+	luaL_pushresultsize(&buffer, size);
+	return 1;
+}
+
+// math.multiply(parent, matrices, [options]) -> string
+// 把 parent 左乘到 matrices 中的每个矩阵上，matrices 的布局与 options 相同，矩阵之外的数据原样保留
+static int l_multiply(lua_State *L) {
+	mat4 **parent = luaL_checkudata(L, 1, FLN_USERTYPE_TRANSFORM);
+	if (!*parent) {
+		return fln_error(L, "invalid transform");
+	}
+	size_t matrices_size;
+	const char *matrices = luaL_checklstring(L, 2, &matrices_size);
+	batch_layout layout;
+	check_batch_layout(L, 3, &layout);
+	glm_mat4_copy(**parent, layout.parent);
+	layout.has_parent = true;
+	layout.base = matrices;
+	layout.base_size = matrices_size;
+	size_t record_size = layout.stride * sizeof(float);
+	if (matrices_size % record_size != 0) {
+		return fln_error(L, "matrices size must be a multiple of the stride (%d bytes)", (int)record_size);
+	}
+	size_t count = matrices_size / record_size;
+
+	luaL_Buffer buffer;
+	size_t size;
+	char *out = batch_output(L, &buffer, &layout, count, &size);
+	for (size_t i = 0; i < count; i++) {
+		mat4 m;
+		memcpy(m, matrices + (i * layout.stride + layout.offset) * sizeof(float), sizeof(mat4));
+		batch_store(out, &layout, i, m);
+	}
+	luaL_pushresultsize(&buffer, size);
+	return 1;
+}
+
 int fln_luaopen_math(lua_State *L) {
 	const luaL_Reg methsransform[] = {
 		{ "translate", l_mransformranslate },
@@ -210,6 +368,8 @@ int fln_luaopen_math(lua_State *L) {
 	luaL_setfuncs(L, methsransform, 0);
 	const luaL_Reg func[] = {
 		{ "transform", lransform },
+		{ "compose", l_compose },
+		{ "multiply", l_multiply },
 		{ nullptr, nullptr },
 	};
 	luaL_newlib(L, func);
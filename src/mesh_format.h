@@ -0,0 +1,93 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// flandre 的预处理网格格式（.flm）
+// 文件布局：header | 顶点数据 | 索引数据，数据段按 FLN_MESH_BLOB_ALIGNMENT 对齐
+// 顶点数据就是 `graphics.mesh` 所要求的交错 float 数组，索引为 uint32
+// 所有字段均为小端序，文件可以直接 mmap 后交给 glBufferData
+
+#define FLN_MESH_BLOB_MAGIC "FLNMESH"
+#define FLN_MESH_BLOB_VERSION 1
+#define FLN_MESH_BLOB_ALIGNMENT 16
+#define FLN_MESH_MAX_ATTRIBUTES 16
+
+typedef struct fln_mesh_blob_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t attributes_count;
+	uint32_t attributes[FLN_MESH_MAX_ATTRIBUTES]; // 每个属性的 float 数量
+	uint32_t divisors[FLN_MESH_MAX_ATTRIBUTES]; // 实例化除数，0 表示逐顶点
+	uint64_t vertices_offset;
+	uint64_t vertices_size;
+	uint64_t indices_offset;
+	uint64_t indices_size;
+} fln_mesh_blob_header;
+
+static inline uint64_t fln_mesh_blob_align(uint64_t offset) {
+	return (offset + FLN_MESH_BLOB_ALIGNMENT - 1) & ~(uint64_t)(FLN_MESH_BLOB_ALIGNMENT - 1);
+}
+
+static inline uint64_t fln_mesh_blob_stride(const fln_mesh_blob_header *header) {
+	uint64_t stride = 0;
+	for (uint32_t i = 0; i < header->attributes_count; i++) {
+		stride += header->attributes[i] * sizeof(float);
+	}
+	return stride;
+}
+
+static inline bool fln_mesh_blob_has_divisors(const fln_mesh_blob_header *header) {
+	for (uint32_t i = 0; i < header->attributes_count; i++) {
+		if (header->divisors[i] != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// 检查 header 以及数据段是否都落在文件范围内
+// 返回 nullptr 表示合法，否则返回错误描述
+static inline const char *fln_mesh_blob_validate(const void *data, uint64_t size) {
+	if (size < sizeof(fln_mesh_blob_header)) {
+		return "file too small";
+	}
+	const fln_mesh_blob_header *header = data;
+	if (memcmp(header->magic, FLN_MESH_BLOB_MAGIC, sizeof(header->magic)) != 0) {
+		return "bad magic";
+	}
+	if (header->version != FLN_MESH_BLOB_VERSION) {
+		return "unsupported version";
+	}
+	if (header->attributes_count == 0 || header->attributes_count > FLN_MESH_MAX_ATTRIBUTES) {
+		return "invalid attributes count";
+	}
+	// 空的模型可以加载，但提交时才会以 "invalid mesh" 失败，这里直接拒绝
+	if (header->vertices_size == 0) {
+		return "model has no vertices";
+	}
+	if (header->indices_size == 0) {
+		return "model has no indices";
+	}
+	uint64_t stride = fln_mesh_blob_stride(header);
+	if (stride == 0 || header->vertices_size % stride != 0) {
+		return "vertices size does not match the attribute layout";
+	}
+	if (header->indices_size % sizeof(uint32_t) != 0) {
+		return "invalid indices size";
+	}
+	if (header->vertices_offset > size || header->vertices_size > size - header->vertices_offset) {
+		return "vertices out of range";
+	}
+	if (header->indices_offset > size || header->indices_size > size - header->indices_offset) {
+		return "indices out of range";
+	}
+	return nullptr;
+}
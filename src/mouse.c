@@ -11,18 +11,41 @@
 #include <lauxlib.h>
 #include <lua.h>
 
+#include "error.h"
+#include "memory.h"
+#include "replay.h"
+
+// 一次移动事件
+typedef struct mouse_sample {
+	uint64_t timestamp; // 纳秒
+	float x, y;
+	float dx, dy;
+} mouse_sample;
+
+// 每帧处理完事件后的状态，脚本在这一帧内读到的都是它
+typedef struct mouse_snapshot {
+	float x, y;
+	float dx, dy; // 这一帧内的相对移动之和
+	SDL_MouseButtonFlags buttons;
+} mouse_snapshot;
+
+static SDL_Window *window = nullptr;
 static float mouse_wheel_status = 0; //
+// 位置和按键由事件维护，而不是直接查询 SDL，这样回放注入的事件也能生效
+static mouse_snapshot current; // 随事件更新
+static mouse_snapshot snapshot;
+static mouse_sample *samples = nullptr; // 这一帧的所有移动事件
+static size_t samples_count = 0;
+static size_t samples_capacity = 0;
 
 static int l_position(lua_State *L) {
-	float x, y;
-	SDL_GetMouseState(&x, &y);
-	lua_pushnumber(L, x);
-	lua_pushnumber(L, y);
+	lua_pushnumber(L, snapshot.x);
+	lua_pushnumber(L, snapshot.y);
 	return 2;
 }
 
 static int l_button(lua_State *L) {
-	SDL_MouseButtonFlags flag = SDL_GetMouseState(nullptr, nullptr);
+	SDL_MouseButtonFlags flag = snapshot.buttons;
 	lua_pushboolean(L, flag & SDL_BUTTON_LMASK);
 	lua_pushboolean(L, flag & SDL_BUTTON_RMASK);
 	lua_pushboolean(L, flag & SDL_BUTTON_MMASK);
@@ -38,17 +61,128 @@ static int l_wheel(lua_State *L) {
 	return 1;
 }
 
+// 这一帧的相对移动之和，相对模式下位置不变，只能用它
+static int l_delta(lua_State *L) {
+	lua_pushnumber(L, snapshot.dx);
+	lua_pushnumber(L, snapshot.dy);
+	return 2;
+}
+
+// mouse.samples([t]) -> t, n
+// 这一帧的所有移动事件按顺序平铺在 t 中，每个占 5 项：x, y, dx, dy, timestamp（纳秒）
+// 传入的表会被复用，只有前 n * 5 项有效
+static int l_samples(lua_State *L) {
+	if (lua_istable(L, 1)) {
+		lua_settop(L, 1);
+	} else {
+		lua_createtable(L, (int)(samples_count * 5), 0);
+	}
+	for (size_t i = 0; i < samples_count; i++) {
+		const mouse_sample *sample = &samples[i];
+		lua_Integer base = (lua_Integer)i * 5;
+		lua_pushnumber(L, sample->x);
+		lua_rawseti(L, -2, base + 1);
+		lua_pushnumber(L, sample->y);
+		lua_rawseti(L, -2, base + 2);
+		lua_pushnumber(L, sample->dx);
+		lua_rawseti(L, -2, base + 3);
+		lua_pushnumber(L, sample->dy);
+		lua_rawseti(L, -2, base + 4);
+		lua_pushinteger(L, (lua_Integer)sample->timestamp);
+		lua_rawseti(L, -2, base + 5);
+	}
+	lua_pushinteger(L, (lua_Integer)samples_count);
+	return 2;
+}
+
+// mouse.relative(enabled) 开关相对模式（隐藏并锁定光标，只报告相对移动），不传参数时返回当前状态
+static int l_relative(lua_State *L) {
+	if (lua_isnone(L, 1)) {
+		lua_pushboolean(L, window && SDL_GetWindowRelativeMouseMode(window));
+		return 1;
+	}
+	luaL_checktype(L, 1, LUA_TBOOLEAN);
+	if (!window || !SDL_SetWindowRelativeMouseMode(window, lua_toboolean(L, 1))) {
+		return fln_error(L, "failed to set relative mouse mode: %s", SDL_GetError());
+	}
+	return 0;
+}
+
+static void push_sample(const SDL_MouseMotionEvent *motion) {
+	if (samples_count == samples_capacity) {
+		size_t capacity = samples_capacity ? samples_capacity * 2 : 64;
+		mouse_sample *data = fln_realloc(samples, capacity * sizeof(mouse_sample));
+		if (!data) {
+			return;
+		}
+		samples = data;
+		samples_capacity = capacity;
+	}
+	samples[samples_count++] = (mouse_sample){ motion->timestamp, motion->x, motion->y, motion->xrel, motion->yrel };
+}
+
+void fln_mouse_init(fln_app_state *appstate) {
+	window = appstate->window;
+	// 启动时光标已经在窗口内的话，在第一个事件之前也能读到位置和按键
+	// 录制和回放时不查询，两次运行都从同样的状态开始
+	if (!fln_replay_active()) {
+		current.buttons = SDL_GetMouseState(&current.x, &current.y);
+		snapshot = current;
+	}
+}
+
+void fln_mouse_new_frame(void) {
+	samples_count = 0;
+	current.dx = 0.0f;
+	current.dy = 0.0f;
+}
+
 void fln_receive_mouse_events(const SDL_Event *event) {
-	if (event->type == SDL_EVENT_MOUSE_WHEEL) {
-		mouse_wheel_status += event->wheel.y;
+	switch (event->type) {
+		case SDL_EVENT_MOUSE_WHEEL:
+			mouse_wheel_status += event->wheel.y;
+			break;
+		case SDL_EVENT_MOUSE_MOTION:
+			current.x = event->motion.x;
+			current.y = event->motion.y;
+			current.dx += event->motion.xrel;
+			current.dy += event->motion.yrel;
+			push_sample(&event->motion);
+			break;
+		case SDL_EVENT_MOUSE_BUTTON_DOWN:
+		case SDL_EVENT_MOUSE_BUTTON_UP:
+			current.x = event->button.x;
+			current.y = event->button.y;
+			if (event->button.down) {
+				current.buttons |= SDL_BUTTON_MASK(event->button.button);
+			} else {
+				current.buttons &= ~SDL_BUTTON_MASK(event->button.button);
+			}
+			break;
+		default:
+			break;
 	}
 }
 
+void fln_mouse_update(void) {
+	snapshot = current;
+}
+
+void fln_mouse_quit(void) {
+	fln_free(samples);
+	samples = nullptr;
+	samples_count = 0;
+	samples_capacity = 0;
+}
+
 int fln_luaopen_mouse(lua_State *L) {
 	const luaL_Reg funcs[] = {
 		{ "position", l_position },
 		{ "button", l_button },
 		{ "wheel", l_wheel },
+		{ "delta", l_delta },
+		{ "samples", l_samples },
+		{ "relative", l_relative },
 		{ nullptr, nullptr },
 	};
 	luaL_newlib(L, funcs);
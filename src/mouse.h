@@ -10,6 +10,20 @@
 #include <SDL3/SDL_events.h>
 #include <lua.h>
 
+#include "appstate.h"
+
+// 鼠标：事件更新内部状态并记录这一帧的所有移动，处理完事件后生成这一帧的快照，脚本读到的都是快照
+
+void fln_mouse_init(fln_app_state *appstate);
+
+// 每帧处理事件之前调用
+void fln_mouse_new_frame(void);
+
 void fln_receive_mouse_events(const SDL_Event *);
 
+// 每帧处理完事件之后调用
+void fln_mouse_update(void);
+
+void fln_mouse_quit(void);
+
 int fln_luaopen_mouse(lua_State *);
\ No newline at end of file
@@ -0,0 +1,156 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "pacing.h"
+
+#include <SDL3/SDL_timer.h>
+#include <lauxlib.h>
+
+#include "error.h"
+#include "graphics.h"
+#include "profiler.h"
+
+#define NS_PER_SECOND 1000000000ull
+// 睡眠的精度取决于系统调度，最后这段时间改为自旋
+#define SPIN_NS 1500000ull
+
+typedef enum vsync_mode {
+	VSYNC_OFF,
+	VSYNC_ON,
+	VSYNC_ADAPTIVE, // 赶不上刷新率时不等待，直接交换
+} vsync_mode;
+
+static const char *const vsync_names[] = { "off", "on", "adaptive", nullptr };
+
+static fln_app_state *app = nullptr;
+static vsync_mode vsync = VSYNC_ON;
+static double fps = 0.0; // 帧率上限，0 表示不限制
+static double idle_fps = 10.0; // 窗口不可见时的帧率
+static bool minimized = false;
+static bool occluded = false;
+static bool hidden = false;
+static uint64_t deadline = 0; // 下一帧最早的开始时间
+
+static void apply_vsync(void) {
+	if (fln_gfx_set_vsync(app, vsync == VSYNC_OFF ? 0 : (vsync == VSYNC_ON ? 1 : -1))) {
+		return;
+	}
+	// 不支持 adaptive 时退回普通的垂直同步
+	if (vsync == VSYNC_ADAPTIVE) {
+		fln_warning("adaptive vsync is not supported, falling back to vsync on\n");
+		vsync = VSYNC_ON;
+		fln_gfx_set_vsync(app, 1);
+	}
+}
+
+void fln_pacing_init(fln_app_state *appstate) {
+	app = appstate;
+	apply_vsync();
+}
+
+static bool idle(void) {
+	return minimized || occluded || hidden;
+}
+
+void fln_pacing_wait(void) {
+	double rate = idle() ? idle_fps : fps;
+	if (rate <= 0.0) {
+		deadline = 0;
+		return;
+	}
+	uint64_t period = (uint64_t)((double)NS_PER_SECOND / rate);
+	uint64_t now = SDL_GetTicksNS();
+	// 以上一帧的截止时间为基准累加，避免误差累积；落后超过一帧时不追赶
+	deadline = deadline ? deadline + period : now + period;
+	if (deadline + period < now) {
+		deadline = now;
+		return;
+	}
+	if (deadline <= now) {
+		return;
+	}
+	FLN_ZONE_BEGIN("pacing");
+	uint64_t remaining = deadline - now;
+	if (remaining > SPIN_NS) {
+		SDL_DelayNS(remaining - SPIN_NS);
+	}
+	while (SDL_GetTicksNS() < deadline) {
+	}
+	FLN_ZONE_END();
+}
+
+void fln_pacing_receive_events(const SDL_Event *event) {
+	switch (event->type) {
+		case SDL_EVENT_WINDOW_MINIMIZED:
+			minimized = true;
+			break;
+		case SDL_EVENT_WINDOW_RESTORED:
+		case SDL_EVENT_WINDOW_MAXIMIZED:
+			minimized = false;
+			break;
+		case SDL_EVENT_WINDOW_OCCLUDED:
+			occluded = true;
+			break;
+		case SDL_EVENT_WINDOW_EXPOSED:
+			occluded = false;
+			break;
+		case SDL_EVENT_WINDOW_HIDDEN:
+			hidden = true;
+			break;
+		case SDL_EVENT_WINDOW_SHOWN:
+			hidden = false;
+			break;
+		default:
+			break;
+	}
+}
+
+// system.pacing{ vsync = "off" | "on" | "adaptive", fps = 帧率上限（0 为不限制）, idle_fps = 不可见时的帧率 }
+// 不带参数时返回当前设置以及窗口是否处于空闲状态
+static int l_pacing(lua_State *L) {
+	if (lua_isnoneornil(L, 1)) {
+		lua_createtable(L, 0, 4);
+		lua_pushstring(L, vsync_names[vsync]);
+		lua_setfield(L, -2, "vsync");
+		lua_pushnumber(L, fps);
+		lua_setfield(L, -2, "fps");
+		lua_pushnumber(L, idle_fps);
+		lua_setfield(L, -2, "idle_fps");
+		lua_pushboolean(L, idle());
+		lua_setfield(L, -2, "idle");
+		return 1;
+	}
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_getfield(L, 1, "vsync");
+	lua_getfield(L, 1, "fps");
+	lua_getfield(L, 1, "idle_fps");
+	vsync_mode new_vsync = lua_isnil(L, -3) ? vsync : (vsync_mode)luaL_checkoption(L, -3, nullptr, vsync_names);
+	double new_fps = luaL_optnumber(L, -2, fps);
+	double new_idle_fps = luaL_optnumber(L, -1, idle_fps);
+	lua_pop(L, 3);
+	if (new_fps < 0.0) {
+		return fln_error(L, "invalid fps: %f", new_fps);
+	}
+	if (new_idle_fps < 0.0) {
+		return fln_error(L, "invalid idle fps: %f", new_idle_fps);
+	}
+	fps = new_fps;
+	idle_fps = new_idle_fps;
+	deadline = 0;
+	if (new_vsync != vsync) {
+		vsync = new_vsync;
+		if (app) {
+			apply_vsync();
+		}
+	}
+	return 0;
+}
+
+void fln_pacing_setfuncs(lua_State *L) {
+	lua_pushcfunction(L, l_pacing);
+	lua_setfield(L, -2, "pacing");
+}
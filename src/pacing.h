@@ -0,0 +1,26 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <SDL3/SDL_events.h>
+#include <lua.h>
+
+#include "appstate.h"
+
+// 帧节奏：垂直同步、帧率上限（先粗略睡眠再短暂自旋），以及窗口最小化或被遮挡时降低帧率
+
+// 图形后端初始化之后调用
+void fln_pacing_init(fln_app_state *appstate);
+
+// 每帧结束时调用，等待到下一帧的开始时间
+void fln_pacing_wait(void);
+
+void fln_pacing_receive_events(const SDL_Event *event);
+
+// 在栈顶的表（flandre.system）中注册 pacing 函数
+void fln_pacing_setfuncs(lua_State *L);
@@ -0,0 +1,216 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "profiler.h"
+
+#include <SDL3/SDL_atomic.h>
+#include <SDL3/SDL_thread.h>
+#include <SDL3/SDL_timer.h>
+#include <stdio.h>
+#include <string.h>
+#include <uthash.h>
+
+#include "memory.h"
+
+// 每个线程最多保留的事件数，写满后覆盖最早的
+#define RING_CAPACITY (1 << 16)
+#define THREAD_NAME_SIZE 32
+
+typedef struct zone_event {
+	const char *name; // 结束事件为 nullptr
+	uint64_t ticks;
+} zone_event;
+
+// 只有所属线程写入，导出时其他线程读取 written 之前的部分
+typedef struct thread_buffer {
+	zone_event *events; // 第一次记录时才分配
+	atomic_uint_fast64_t written; // 累计写入的事件数
+	SDL_ThreadID thread_id;
+	char name[THREAD_NAME_SIZE];
+	struct thread_buffer *next;
+} thread_buffer;
+
+typedef struct intern_entry {
+	UT_hash_handle hh;
+	char name[];
+} intern_entry;
+
+atomic_bool fln_profiler_active = false;
+thread_local int fln_profiler_depth = 0;
+
+static thread_local thread_buffer *local_buffer = nullptr;
+static SDL_SpinLock lock = 0; // 保护 buffers 与 interned
+static thread_buffer *buffers = nullptr; // 所有线程的缓冲区，线程退出后仍然保留到 fln_profiler_quit
+static intern_entry *interned = nullptr;
+static uint64_t start_ticks = 0;
+
+static thread_buffer *get_buffer(void) {
+	if (local_buffer) {
+		return local_buffer;
+	}
+	thread_buffer *buffer = fln_calloc(1, sizeof(thread_buffer));
+	if (!buffer) {
+		return nullptr;
+	}
+	atomic_init(&buffer->written, 0);
+	buffer->thread_id = SDL_GetCurrentThreadID();
+	SDL_LockSpinlock(&lock);
+	buffer->next = buffers;
+	buffers = buffer;
+	SDL_UnlockSpinlock(&lock);
+	local_buffer = buffer;
+	return buffer;
+}
+
+static bool record(const char *name) {
+	uint64_t ticks = SDL_GetPerformanceCounter();
+	thread_buffer *buffer = get_buffer();
+	if (!buffer) {
+		return false;
+	}
+	if (!buffer->events) {
+		buffer->events = fln_alloc(sizeof(zone_event) * RING_CAPACITY);
+		if (!buffer->events) {
+			return false;
+		}
+	}
+	uint_fast64_t index = atomic_load_explicit(&buffer->written, memory_order_relaxed);
+	zone_event *event = &buffer->events[index & (RING_CAPACITY - 1)];
+	event->name = name;
+	event->ticks = ticks;
+	atomic_store_explicit(&buffer->written, index + 1, memory_order_release);
+	return true;
+}
+
+void fln_profiler_begin(const char *name) {
+	if (record(name)) {
+		fln_profiler_depth++;
+	}
+}
+
+void fln_profiler_end(void) {
+	fln_profiler_depth--;
+	record(nullptr);
+}
+
+void fln_profiler_enable(bool enable) {
+	if (enable && start_ticks == 0) {
+		start_ticks = SDL_GetPerformanceCounter();
+	}
+	atomic_store_explicit(&fln_profiler_active, enable, memory_order_relaxed);
+}
+
+void fln_profiler_thread_name(const char *name) {
+	thread_buffer *buffer = get_buffer();
+	if (buffer) {
+		strncpy(buffer->name, name, THREAD_NAME_SIZE - 1);
+	}
+}
+
+const char *fln_profiler_intern(const char *name) {
+	size_t len = strlen(name);
+	SDL_LockSpinlock(&lock);
+	intern_entry *entry = nullptr;
+	HASH_FIND(hh, interned, name, len, entry);
+	if (!entry) {
+		entry = fln_alloc(sizeof(intern_entry) + len + 1);
+		if (entry) {
+			memcpy(entry->name, name, len + 1);
+			HASH_ADD_KEYPTR(hh, interned, entry->name, len, entry);
+		}
+	}
+	SDL_UnlockSpinlock(&lock);
+	return entry ? entry->name : nullptr;
+}
+
+static void write_string(FILE *file, const char *s) {
+	fputc('"', file);
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\') {
+			fputc('\\', file);
+			fputc(c, file);
+		} else if (c < 0x20) {
+			fprintf(file, "\\u%04x", c);
+		} else {
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool fln_profiler_write_trace(const char *path, const char **err) {
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		*err = "failed to open file";
+		return false;
+	}
+	double scale = 1e6 / (double)SDL_GetPerformanceFrequency(); // 计数 -> 微秒
+	bool first = true;
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+	SDL_LockSpinlock(&lock);
+	thread_buffer *list = buffers;
+	SDL_UnlockSpinlock(&lock);
+	// 新线程只会插在链表头，从拿到的头开始遍历是安全的
+	for (thread_buffer *buffer = list; buffer; buffer = buffer->next) {
+		unsigned int tid = (unsigned int)buffer->thread_id;
+		if (buffer->name[0]) {
+			fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", tid);
+			write_string(file, buffer->name);
+			fputs("}}", file);
+			first = false;
+		}
+		if (!buffer->events) {
+			continue;
+		}
+		uint_fast64_t written = atomic_load_explicit(&buffer->written, memory_order_acquire);
+		uint_fast64_t begin = written > RING_CAPACITY ? written - RING_CAPACITY : 0;
+		// 环形缓冲区写满后，最早的几个结束事件对应的开始事件可能已经被覆盖，跳过它们，否则查看器会错误地嵌套
+		int depth = 0;
+		for (uint_fast64_t i = begin; i < written; i++) {
+			const zone_event *event = &buffer->events[i & (RING_CAPACITY - 1)];
+			if (event->name) {
+				depth++;
+			} else if (depth > 0) {
+				depth--;
+			} else {
+				continue;
+			}
+			double ts = event->ticks >= start_ticks ? (double)(event->ticks - start_ticks) * scale : 0.0;
+			fprintf(file, "%s{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", first ? "" : ",\n", event->name ? 'B' : 'E', tid, ts);
+			if (event->name) {
+				fputs(",\"name\":", file);
+				write_string(file, event->name);
+			}
+			fputc('}', file);
+			first = false;
+		}
+	}
+	fputs("\n]}\n", file);
+	if (fclose(file) != 0) {
+		*err = "failed to write file";
+		return false;
+	}
+	return true;
+}
+
+// 必须在所有其他线程结束之后调用
+void fln_profiler_quit(void) {
+	atomic_store_explicit(&fln_profiler_active, false, memory_order_relaxed);
+	while (buffers) {
+		thread_buffer *next = buffers->next;
+		fln_free(buffers->events);
+		fln_free(buffers);
+		buffers = next;
+	}
+	local_buffer = nullptr;
+	intern_entry *entry, *tmp;
+	HASH_ITER(hh, interned, entry, tmp) {
+		HASH_DEL(interned, entry);
+		fln_free(entry);
+	}
+}
@@ -0,0 +1,46 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stdatomic.h>
+
+// CPU 区段分析器：每个线程一个环形缓冲区，记录区段的开始/结束事件，可以导出为 Chrome trace JSON（Perfetto 可以直接打开）
+// 关闭时每个区段只有一次 relaxed 原子读的开销
+
+extern atomic_bool fln_profiler_active;
+extern thread_local int fln_profiler_depth; // 当前线程已记录但未结束的区段数
+
+// name 必须在导出之前一直有效（字符串字面量，或者 fln_profiler_intern 的结果）
+void fln_profiler_begin(const char *name);
+void fln_profiler_end(void);
+
+#define FLN_ZONE_BEGIN(name) \
+	do { \
+		if (atomic_load_explicit(&fln_profiler_active, memory_order_relaxed)) \
+			fln_profiler_begin(name); \
+	} while (0)
+
+// 开启时记录过的区段即使中途关闭了分析器也会正常结束
+#define FLN_ZONE_END() \
+	do { \
+		if (fln_profiler_depth > 0) \
+			fln_profiler_end(); \
+	} while (0)
+
+void fln_profiler_enable(bool enable);
+
+// 给当前线程命名，显示在 trace 中
+void fln_profiler_thread_name(const char *name);
+
+// 返回与 name 内容相同、直到 fln_profiler_quit 都有效的字符串，失败时返回 nullptr
+const char *fln_profiler_intern(const char *name);
+
+// 导出所有线程缓冲区中的事件，失败时 err 指向错误信息
+bool fln_profiler_write_trace(const char *path, const char **err);
+
+void fln_profiler_quit(void);
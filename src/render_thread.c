@@ -0,0 +1,198 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "render_thread.h"
+
+#include <SDL3/SDL_mutex.h>
+#include <SDL3/SDL_thread.h>
+#include <stdio.h>
+
+#include "memory.h"
+#include "profiler.h"
+
+void *fln_cmdlist_push(fln_cmdlist *list, size_t size) {
+	size = FLN_CMDLIST_ALIGN(size);
+	if (list->size + size > list->capacity) {
+		size_t capacity = list->capacity ? list->capacity : 64 * 1024;
+		while (capacity < list->size + size) {
+			capacity *= 2;
+		}
+		unsigned char *data = fln_realloc(list->data, capacity);
+		if (!data) {
+			return nullptr;
+		}
+		list->data = data;
+		list->capacity = capacity;
+	}
+	void *result = list->data + list->size;
+	list->size += size;
+	return result;
+}
+
+void fln_cmdlist_free(fln_cmdlist *list) {
+	fln_free(list->data);
+	list->data = nullptr;
+	list->size = 0;
+	list->capacity = 0;
+}
+
+static SDL_Thread *thread = nullptr;
+static SDL_ThreadID thread_id = 0;
+static SDL_Mutex *mutex = nullptr;
+static SDL_Condition *cond = nullptr; // 所有状态变化都广播这一个条件变量
+static fln_render_thread_desc desc;
+static fln_cmdlist lists[2];
+static int recording = 0; // 主线程正在录制的列表，另一个归渲染线程
+static bool frame_pending = false;
+static bool call_pending = false;
+static fln_render_func call_func = nullptr;
+static void *call_userdata = nullptr;
+static bool quitting = false;
+static bool init_done = false;
+static bool init_ok = false;
+
+static int thread_main(void *data) {
+	fln_profiler_thread_name("render");
+	bool ok = desc.init ? desc.init(desc.userdata) : true;
+	SDL_LockMutex(mutex);
+	thread_id = SDL_GetCurrentThreadID();
+	init_ok = ok;
+	init_done = true;
+	SDL_BroadcastCondition(cond);
+	if (!ok) {
+		SDL_UnlockMutex(mutex);
+		return 1;
+	}
+	while (true) {
+		while (!frame_pending && !call_pending && !quitting) {
+			SDL_WaitCondition(cond, mutex);
+		}
+		if (frame_pending) {
+			const fln_cmdlist *list = &lists[1 - recording];
+			SDL_UnlockMutex(mutex);
+			FLN_ZONE_BEGIN("replay");
+			desc.frame(list, desc.userdata);
+			FLN_ZONE_END();
+			SDL_LockMutex(mutex);
+			frame_pending = false;
+			SDL_BroadcastCondition(cond);
+		} else if (call_pending) {
+			SDL_UnlockMutex(mutex);
+			call_func(call_userdata);
+			SDL_LockMutex(mutex);
+			call_pending = false;
+			SDL_BroadcastCondition(cond);
+		} else {
+			break;
+		}
+	}
+	SDL_UnlockMutex(mutex);
+	if (desc.quit) {
+		desc.quit(desc.userdata);
+	}
+	return 0;
+}
+
+static void destroy_primitives(void) {
+	SDL_DestroyCondition(cond);
+	SDL_DestroyMutex(mutex);
+	cond = nullptr;
+	mutex = nullptr;
+	fln_cmdlist_free(&lists[0]);
+	fln_cmdlist_free(&lists[1]);
+}
+
+bool fln_render_thread_start(const fln_render_thread_desc *desc_) {
+	if (thread) {
+		return true;
+	}
+	desc = *desc_;
+	mutex = SDL_CreateMutex();
+	cond = SDL_CreateCondition();
+	if (!mutex || !cond) {
+		printf("failed to create render thread primitives: %s\n", SDL_GetError());
+		destroy_primitives();
+		return false;
+	}
+	recording = 0;
+	frame_pending = false;
+	call_pending = false;
+	quitting = false;
+	init_done = false;
+	thread = SDL_CreateThread(thread_main, "flandre-render", nullptr);
+	if (!thread) {
+		printf("failed to create render thread: %s\n", SDL_GetError());
+		destroy_primitives();
+		return false;
+	}
+	SDL_LockMutex(mutex);
+	while (!init_done) {
+		SDL_WaitCondition(cond, mutex);
+	}
+	SDL_UnlockMutex(mutex);
+	if (!init_ok) {
+		SDL_WaitThread(thread, nullptr);
+		thread = nullptr;
+		thread_id = 0;
+		destroy_primitives();
+		return false;
+	}
+	return true;
+}
+
+void fln_render_thread_stop(void) {
+	if (!thread) {
+		return;
+	}
+	SDL_LockMutex(mutex);
+	while (frame_pending || call_pending) {
+		SDL_WaitCondition(cond, mutex);
+	}
+	quitting = true;
+	SDL_BroadcastCondition(cond);
+	SDL_UnlockMutex(mutex);
+	SDL_WaitThread(thread, nullptr);
+	thread = nullptr;
+	thread_id = 0;
+	destroy_primitives();
+}
+
+bool fln_render_thread_running(void) {
+	return thread != nullptr;
+}
+
+bool fln_render_thread_is_current(void) {
+	return thread && SDL_GetCurrentThreadID() == thread_id;
+}
+
+fln_cmdlist *fln_render_thread_list(void) {
+	return &lists[recording];
+}
+
+void fln_render_thread_submit(void) {
+	SDL_LockMutex(mutex);
+	while (frame_pending) {
+		SDL_WaitCondition(cond, mutex);
+	}
+	recording = 1 - recording;
+	lists[recording].size = 0;
+	frame_pending = true;
+	SDL_BroadcastCondition(cond);
+	SDL_UnlockMutex(mutex);
+}
+
+void fln_render_thread_call(fln_render_func func, void *userdata) {
+	SDL_LockMutex(mutex);
+	call_func = func;
+	call_userdata = userdata;
+	call_pending = true;
+	SDL_BroadcastCondition(cond);
+	while (call_pending) {
+		SDL_WaitCondition(cond, mutex);
+	}
+	SDL_UnlockMutex(mutex);
+}
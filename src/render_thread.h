@@ -0,0 +1,58 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stddef.h>
+
+// 渲染线程：主线程把一帧的绘制录制成命令列表，渲染线程在下一帧脚本执行的同时回放上一帧的列表
+// 两个列表轮流使用，主线程最多领先渲染线程一帧
+
+#define FLN_CMDLIST_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+// 只追加的命令缓冲区，每次追加的内存按 16 字节对齐（FLN_CMDLIST_ALIGN）
+typedef struct fln_cmdlist {
+	unsigned char *data;
+	size_t size;
+	size_t capacity;
+} fln_cmdlist;
+
+// 失败时返回 nullptr，之前返回的指针可能因扩容而失效
+void *fln_cmdlist_push(fln_cmdlist *list, size_t size);
+
+void fln_cmdlist_free(fln_cmdlist *list);
+
+typedef bool (*fln_render_init_func)(void *userdata);
+typedef void (*fln_render_func)(void *userdata);
+typedef void (*fln_render_frame_func)(const fln_cmdlist *list, void *userdata);
+
+typedef struct fln_render_thread_desc {
+	fln_render_init_func init; // 在渲染线程上最先执行（例如让 GL 上下文在该线程上生效），返回 false 时线程退出
+	fln_render_frame_func frame; // 回放一帧
+	fln_render_func quit; // 在渲染线程上最后执行
+	void *userdata;
+} fln_render_thread_desc;
+
+bool fln_render_thread_start(const fln_render_thread_desc *desc);
+
+// 等待正在回放的帧和同步调用结束后停止线程
+void fln_render_thread_stop(void);
+
+bool fln_render_thread_running(void);
+
+// 调用者是否在渲染线程上
+bool fln_render_thread_is_current(void);
+
+// 主线程正在录制的列表
+fln_cmdlist *fln_render_thread_list(void);
+
+// 等待上一帧回放完成，交出正在录制的列表并开始录制新的列表
+void fln_render_thread_submit(void);
+
+// 在渲染线程上执行 func 并等待其完成，执行时没有帧在回放
+// 只能在主线程上调用
+void fln_render_thread_call(fln_render_func func, void *userdata);
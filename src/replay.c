@@ -0,0 +1,280 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "replay.h"
+
+#include <SDL3/SDL_timer.h>
+#include <lua.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "timer.h"
+
+#define REPLAY_MAGIC "FLNR"
+#define REPLAY_VERSION 1
+#define REPLAY_STEP_NS (1000000000ull / 60)
+
+// 日志按本机字节序写入，只在同一台机器（或同样字节序的机器）之间使用
+typedef struct replay_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t seed;
+	uint64_t step_ns;
+	int32_t window_width;
+	int32_t window_height;
+} replay_header;
+
+// 每条 40 字节，没有填充
+typedef struct replay_entry {
+	uint32_t frame;
+	uint32_t type; // SDL_EventType，0 表示录制结束
+	uint64_t timestamp;
+	int32_t code; // scancode 或鼠标按键
+	uint16_t mod;
+	uint8_t down;
+	uint8_t repeat;
+	float x, y; // 位置、滚轮量或窗口尺寸
+	float dx, dy;
+} replay_entry;
+
+typedef enum replay_mode {
+	REPLAY_OFF,
+	REPLAY_RECORD,
+	REPLAY_PLAY,
+} replay_mode;
+
+static replay_mode mode = REPLAY_OFF;
+static FILE *file = nullptr;
+static uint32_t frame = 0;
+static replay_entry next_entry; // 回放时预读的下一条
+static bool has_next = false;
+static bool finished = false;
+
+static void read_next(void) {
+	has_next = fread(&next_entry, sizeof(next_entry), 1, file) == 1;
+	if (!has_next) {
+		// 没有结束标记（录制时崩溃）时在最后一条之后结束
+		finished = true;
+	}
+}
+
+static bool open_record(fln_app_state *appstate, const char *path, replay_header *header) {
+	file = fopen(path, "wb");
+	if (!file) {
+		printf("failed to open '%s' for recording\n", path);
+		return false;
+	}
+	memcpy(header->magic, REPLAY_MAGIC, 4);
+	header->version = REPLAY_VERSION;
+	header->seed = SDL_GetPerformanceCounter();
+	header->step_ns = REPLAY_STEP_NS;
+	int width, height;
+	SDL_GetWindowSize(appstate->window, &width, &height);
+	header->window_width = width;
+	header->window_height = height;
+	if (fwrite(header, sizeof(*header), 1, file) != 1) {
+		printf("failed to write '%s'\n", path);
+		return false;
+	}
+	mode = REPLAY_RECORD;
+	return true;
+}
+
+static bool open_replay(fln_app_state *appstate, const char *path, replay_header *header) {
+	file = fopen(path, "rb");
+	if (!file) {
+		printf("failed to open replay '%s'\n", path);
+		return false;
+	}
+	if (fread(header, sizeof(*header), 1, file) != 1 || memcmp(header->magic, REPLAY_MAGIC, 4) != 0) {
+		printf("'%s' is not a replay file\n", path);
+		return false;
+	}
+	if (header->version != REPLAY_VERSION) {
+		printf("unsupported replay version %u (expected %d)\n", header->version, REPLAY_VERSION);
+		return false;
+	}
+	SDL_SetWindowSize(appstate->window, header->window_width, header->window_height);
+	mode = REPLAY_PLAY;
+	read_next();
+	return true;
+}
+
+bool fln_replay_init(fln_app_state *appstate, const char *record_path, const char *replay_path) {
+	if (!record_path && !replay_path) {
+		return true;
+	}
+	if (record_path && replay_path) {
+		printf("--record and --replay cannot be used together\n");
+		return false;
+	}
+	replay_header header;
+	bool ok = record_path ? open_record(appstate, record_path, &header) : open_replay(appstate, replay_path, &header);
+	if (!ok) {
+		fln_replay_quit();
+		return false;
+	}
+	fln_timer_set_fixed_step(header.step_ns);
+	// 脚本里的随机数也要可复现
+	lua_State *L = appstate->L;
+	if (lua_getglobal(L, "math") == LUA_TTABLE) {
+		if (lua_getfield(L, -1, "randomseed") == LUA_TFUNCTION) {
+			lua_pushinteger(L, (lua_Integer)header.seed);
+			lua_call(L, 1, 0);
+		} else {
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+	printf("%s input: seed %llu\n", mode == REPLAY_RECORD ? "recording" : "replaying", (unsigned long long)header.seed);
+	return true;
+}
+
+static bool is_input(const SDL_Event *event) {
+	switch (event->type) {
+		case SDL_EVENT_KEY_DOWN:
+		case SDL_EVENT_KEY_UP:
+		case SDL_EVENT_MOUSE_BUTTON_DOWN:
+		case SDL_EVENT_MOUSE_BUTTON_UP:
+		case SDL_EVENT_MOUSE_MOTION:
+		case SDL_EVENT_MOUSE_WHEEL:
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool fln_replay_active(void) {
+	return mode != REPLAY_OFF;
+}
+
+bool fln_replay_accept(const SDL_Event *event) {
+	return mode != REPLAY_PLAY || !is_input(event);
+}
+
+void fln_replay_record(const SDL_Event *event) {
+	if (mode != REPLAY_RECORD || (!is_input(event) && event->type != SDL_EVENT_WINDOW_RESIZED)) {
+		return;
+	}
+	replay_entry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.frame = frame;
+	entry.type = event->type;
+	entry.timestamp = event->common.timestamp;
+	switch (event->type) {
+		case SDL_EVENT_KEY_DOWN:
+		case SDL_EVENT_KEY_UP:
+			entry.code = event->key.scancode;
+			entry.mod = event->key.mod;
+			entry.down = event->key.down;
+			entry.repeat = event->key.repeat;
+			break;
+		case SDL_EVENT_MOUSE_BUTTON_DOWN:
+		case SDL_EVENT_MOUSE_BUTTON_UP:
+			entry.code = event->button.button;
+			entry.down = event->button.down;
+			entry.x = event->button.x;
+			entry.y = event->button.y;
+			break;
+		case SDL_EVENT_MOUSE_MOTION:
+			entry.x = event->motion.x;
+			entry.y = event->motion.y;
+			entry.dx = event->motion.xrel;
+			entry.dy = event->motion.yrel;
+			break;
+		case SDL_EVENT_MOUSE_WHEEL:
+			entry.x = event->wheel.x;
+			entry.y = event->wheel.y;
+			break;
+		case SDL_EVENT_WINDOW_RESIZED:
+			entry.x = (float)event->window.data1;
+			entry.y = (float)event->window.data2;
+			break;
+		default:
+			break;
+	}
+	fwrite(&entry, sizeof(entry), 1, file);
+}
+
+bool fln_replay_next(fln_app_state *appstate, SDL_Event *event) {
+	while (mode == REPLAY_PLAY && has_next && next_entry.frame <= frame) {
+		replay_entry entry = next_entry;
+		if (entry.type == 0) {
+			finished = true;
+			has_next = false;
+			return false;
+		}
+		read_next();
+		if (entry.type == SDL_EVENT_WINDOW_RESIZED) {
+			// 改变真实的窗口尺寸，产生的事件照常处理
+			SDL_SetWindowSize(appstate->window, (int)entry.x, (int)entry.y);
+			continue;
+		}
+		memset(event, 0, sizeof(*event));
+		event->type = entry.type;
+		event->common.timestamp = fln_timer_now_ns();
+		switch (entry.type) {
+			case SDL_EVENT_KEY_DOWN:
+			case SDL_EVENT_KEY_UP:
+				event->key.scancode = (SDL_Scancode)entry.code;
+				event->key.mod = entry.mod;
+				event->key.down = entry.down;
+				event->key.repeat = entry.repeat;
+				break;
+			case SDL_EVENT_MOUSE_BUTTON_DOWN:
+			case SDL_EVENT_MOUSE_BUTTON_UP:
+				event->button.button = (Uint8)entry.code;
+				event->button.down = entry.down;
+				event->button.x = entry.x;
+				event->button.y = entry.y;
+				break;
+			case SDL_EVENT_MOUSE_MOTION:
+				event->motion.x = entry.x;
+				event->motion.y = entry.y;
+				event->motion.xrel = entry.dx;
+				event->motion.yrel = entry.dy;
+				break;
+			case SDL_EVENT_MOUSE_WHEEL:
+				event->wheel.x = entry.x;
+				event->wheel.y = entry.y;
+				break;
+			default:
+				break;
+		}
+		return true;
+	}
+	return false;
+}
+
+void fln_replay_end_frame(void) {
+	if (mode != REPLAY_OFF) {
+		frame++;
+	}
+}
+
+bool fln_replay_finished(void) {
+	if (mode != REPLAY_PLAY) {
+		return false;
+	}
+	// 下一条是结束标记时，这一帧就不再运行
+	return finished || (has_next && next_entry.type == 0 && next_entry.frame <= frame);
+}
+
+void fln_replay_quit(void) {
+	if (mode == REPLAY_RECORD && file) {
+		// 结束标记，回放到这一帧时退出
+		replay_entry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.frame = frame;
+		fwrite(&entry, sizeof(entry), 1, file);
+	}
+	if (file) {
+		fclose(file);
+		file = nullptr;
+	}
+	mode = REPLAY_OFF;
+}
@@ -0,0 +1,39 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <SDL3/SDL_events.h>
+
+#include "appstate.h"
+
+// 输入录制与回放：--record=path 把每帧处理的键盘、鼠标事件和窗口尺寸变化连同帧号写入二进制日志，
+// --replay=path 在同样的帧把它们重新注入，此时忽略真实的键盘和鼠标输入
+// 两种模式下时间都按固定步长前进，math.random 使用日志中的种子，配合 headless 后端可以得到可复现的运行
+
+// 在执行根脚本之前调用，失败时返回 false
+bool fln_replay_init(fln_app_state *appstate, const char *record_path, const char *replay_path);
+
+// 正在录制或回放：这时输入状态只能来自事件，否则回放时得不到同样的初始状态
+bool fln_replay_active(void);
+
+// 回放时真实的键盘和鼠标事件被丢弃
+bool fln_replay_accept(const SDL_Event *event);
+
+// 录制一个已处理的事件
+void fln_replay_record(const SDL_Event *event);
+
+// 依次取出当前帧要注入的事件
+bool fln_replay_next(fln_app_state *appstate, SDL_Event *event);
+
+// 事件处理完后调用，帧号加一
+void fln_replay_end_frame(void);
+
+// 回放到了录制结束的那一帧，每帧开始时检查
+bool fln_replay_finished(void);
+
+void fln_replay_quit(void);
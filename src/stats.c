@@ -0,0 +1,124 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "stats.h"
+
+#include <SDL3/SDL_timer.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 帧时间的滑动窗口，百分位数和直方图都基于最近这么多帧
+#define FRAME_WINDOW 240
+#define HISTOGRAM_BUCKETS 64 // 每个桶 1 毫秒，最后一个桶包含更长的帧
+
+fln_frame_counters fln_counters;
+
+static fln_frame_counters last_counters;
+static uint64_t frame_begin = 0;
+static uint64_t last_frame_end = 0;
+static double last_cpu_ms = 0.0; // begin_frame 到 end_frame 之间
+static double last_frame_ms = 0.0; // 相邻两次 end_frame 之间
+static size_t lua_memory = 0;
+static uint64_t frames = 0;
+static float window[FRAME_WINDOW];
+static int window_count = 0;
+static int window_index = 0;
+
+static double ticks_to_ms(uint64_t ticks) {
+	return (double)ticks * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+void fln_stats_begin_frame(void) {
+	frame_begin = SDL_GetPerformanceCounter();
+}
+
+void fln_stats_end_frame(lua_State *L) {
+	uint64_t now = SDL_GetPerformanceCounter();
+	last_cpu_ms = frame_begin ? ticks_to_ms(now - frame_begin) : 0.0;
+	if (last_frame_end) {
+		last_frame_ms = ticks_to_ms(now - last_frame_end);
+		window[window_index] = (float)last_frame_ms;
+		window_index = (window_index + 1) % FRAME_WINDOW;
+		if (window_count < FRAME_WINDOW) {
+			window_count++;
+		}
+	}
+	last_frame_end = now;
+	lua_memory = (size_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + (size_t)lua_gc(L, LUA_GCCOUNTB, 0);
+	last_counters = fln_counters;
+	memset(&fln_counters, 0, sizeof(fln_counters));
+	frames++;
+}
+
+static int compare_float(const void *a, const void *b) {
+	float x = *(const float *)a, y = *(const float *)b;
+	return (x > y) - (x < y);
+}
+
+static void set_integer(lua_State *L, const char *name, uint64_t value) {
+	lua_pushinteger(L, (lua_Integer)value);
+	lua_setfield(L, -2, name);
+}
+
+static void set_number(lua_State *L, const char *name, double value) {
+	lua_pushnumber(L, value);
+	lua_setfield(L, -2, name);
+}
+
+static void push_frame_time(lua_State *L) {
+	float sorted[FRAME_WINDOW];
+	memcpy(sorted, window, sizeof(float) * window_count);
+	qsort(sorted, window_count, sizeof(float), compare_float);
+	double sum = 0.0;
+	int histogram[HISTOGRAM_BUCKETS] = { 0 };
+	for (int i = 0; i < window_count; i++) {
+		sum += sorted[i];
+		int bucket = (int)sorted[i];
+		histogram[bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1]++;
+	}
+
+	lua_createtable(L, 0, 9);
+	set_number(L, "last", last_frame_ms);
+	set_number(L, "cpu", last_cpu_ms);
+	set_integer(L, "samples", window_count);
+	if (window_count > 0) {
+		// 最近秩法
+		set_number(L, "mean", sum / window_count);
+		set_number(L, "min", sorted[0]);
+		set_number(L, "max", sorted[window_count - 1]);
+		set_number(L, "p50", sorted[(window_count * 50 + 99) / 100 - 1]);
+		set_number(L, "p95", sorted[(window_count * 95 + 99) / 100 - 1]);
+		set_number(L, "p99", sorted[(window_count * 99 + 99) / 100 - 1]);
+	}
+	// histogram[i] 为耗时在 [i - 1, i) 毫秒之间的帧数
+	lua_createtable(L, HISTOGRAM_BUCKETS, 0);
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		lua_pushinteger(L, histogram[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_setfield(L, -2, "histogram");
+}
+
+int fln_stats_push(lua_State *L) {
+	const fln_frame_counters *c = &last_counters;
+	lua_createtable(L, 0, 16);
+	set_integer(L, "frames", frames);
+	set_integer(L, "draw_calls", c->draw_calls);
+	set_integer(L, "triangles", c->triangles);
+	set_integer(L, "instances", c->instances);
+	set_integer(L, "program_binds", c->program_binds);
+	set_integer(L, "vao_binds", c->vao_binds);
+	set_integer(L, "texture_binds", c->texture_binds);
+	set_integer(L, "uniform_calls", c->uniform_calls);
+	set_integer(L, "buffer_upload_bytes", c->buffer_upload_bytes);
+	set_integer(L, "texture_upload_bytes", c->texture_upload_bytes);
+	set_integer(L, "lua_memory", lua_memory);
+	set_number(L, "gc_time", ticks_to_ms(c->gc_ticks));
+	push_frame_time(L);
+	lua_setfield(L, -2, "frame_time");
+	return 1;
+}
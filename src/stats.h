@@ -0,0 +1,34 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <lua.h>
+#include <stdint.h>
+
+// 当前帧的引擎计数，由图形后端在主线程上累加，帧结束时清零
+typedef struct fln_frame_counters {
+	uint64_t draw_calls;
+	uint64_t triangles;
+	uint64_t instances; // 实例化绘制的实例数
+	uint64_t program_binds;
+	uint64_t vao_binds;
+	uint64_t texture_binds;
+	uint64_t uniform_calls;
+	uint64_t buffer_upload_bytes;
+	uint64_t texture_upload_bytes;
+	uint64_t gc_ticks; // 引擎主动执行 GC 步进的耗时
+} fln_frame_counters;
+
+extern fln_frame_counters fln_counters;
+
+// 在主循环中每帧开始和结束时调用
+void fln_stats_begin_frame(void);
+void fln_stats_end_frame(lua_State *L);
+
+// 压入上一帧的统计表，供 `flandre.system.stats()` 使用
+int fln_stats_push(lua_State *L);
@@ -8,6 +8,9 @@
 #include "system.h"
 
 #include "error.h"
+#include "gc.h"
+#include "pacing.h"
+#include "stats.h"
 #include <SDL3/SDL_video.h>
 #include <lauxlib.h>
 #include <lua.h>
@@ -86,6 +89,11 @@ static int lerminate(lua_State *L) {
 	return 0;
 }
 
+// 上一帧的统计，时间的单位均为毫秒，内存为字节
+static int l_stats(lua_State *L) {
+	return fln_stats_push(L);
+}
+
 void fln_system_init(fln_app_state *appstate) // WHAAAAT
 {
 	window = appstate->window;
@@ -99,8 +107,11 @@ int fln_luaopen_system(lua_State *L) {
 	const luaL_Reg funcs[] = {
 		{ "window", l_window },
 		{ "terminate", lerminate },
+		{ "stats", l_stats },
 		{ nullptr, nullptr }
 	};
 	luaL_newlib(L, funcs);
+	fln_gc_setfuncs(L);
+	fln_pacing_setfuncs(L);
 	return 1;
 }
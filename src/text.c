@@ -0,0 +1,591 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "text.h"
+
+#include <lauxlib.h>
+#include <string.h>
+#include <uthash.h>
+
+#include "data.h"
+#include "error.h"
+#include "gfx_interface.h"
+#include "memory.h"
+
+#define RUN_CACHE_SOFT_LIMIT 512
+#define RUN_CACHE_MAX_AGE 120 // 帧
+
+// 排版参数，和字符串一起组成缓存的键
+typedef struct run_params {
+	uint32_t font; // fln_font.serial
+	uint32_t size;
+	float max_width;
+	float line_spacing;
+	int32_t align;
+} run_params;
+
+typedef struct run_entry {
+	char *key;
+	size_t key_len;
+	fln_text_quad *quads;
+	size_t count;
+	float width;
+	float height;
+	fln_glyph_shelf_ref *shelves; // 用到的 shelf，复用时需要刷新它们的 LRU 时间，其中任何一个淘汰过字形说明 UV 可能已经失效
+	size_t shelves_count;
+	bool incomplete; // 有字形被推迟，只在排版的这一帧内复用
+	uint64_t last_used;
+	UT_hash_handle hh;
+} run_entry;
+
+static run_entry *runs = nullptr;
+static size_t runs_count = 0;
+static uint64_t frame = 0;
+
+// 排版时使用的临时缓冲区
+static char *scratch_key = nullptr;
+static size_t scratch_key_capacity = 0;
+static fln_text_quad *scratch_quads = nullptr;
+static size_t scratch_quads_capacity = 0;
+static fln_glyph_shelf_ref *scratch_shelves = nullptr;
+static size_t scratch_shelves_capacity = 0;
+
+static bool reserve(void **data, size_t *capacity, size_t count, size_t elem_size) {
+	if (count <= *capacity) {
+		return true;
+	}
+	size_t new_capacity = *capacity ? *capacity : 64;
+	while (new_capacity < count) {
+		new_capacity *= 2;
+	}
+	void *new_data = fln_realloc(*data, new_capacity * elem_size);
+	if (!new_data) {
+		return false;
+	}
+	*data = new_data;
+	*capacity = new_capacity;
+	return true;
+}
+
+static void free_run(run_entry *entry) {
+	HASH_DEL(runs, entry);
+	runs_count--;
+	fln_free(entry->key);
+	fln_free(entry->quads);
+	fln_free(entry->shelves);
+	fln_free(entry);
+}
+
+// 按对齐方式平移一行
+static void finish_line(fln_text_quad *quads, size_t begin, size_t end, float line_width, float max_width, fln_text_align align) {
+	if (align == FLN_TEXT_ALIGN_LEFT || max_width <= 0.0f) {
+		return;
+	}
+	float dx = max_width - line_width;
+	if (align == FLN_TEXT_ALIGN_CENTER) {
+		dx *= 0.5f;
+	}
+	for (size_t i = begin; i < end; i++) {
+		quads[i].x0 += dx;
+		quads[i].x1 += dx;
+	}
+}
+
+static bool add_shelf(const fln_glyph_atlas *atlas, size_t *count, int shelf) {
+	if (shelf < 0) {
+		return true;
+	}
+	for (size_t i = 0; i < *count; i++) {
+		if (scratch_shelves[i].shelf == shelf) {
+			return true;
+		}
+	}
+	if (!reserve((void **)&scratch_shelves, &scratch_shelves_capacity, *count + 1, sizeof(fln_glyph_shelf_ref))) {
+		return false;
+	}
+	scratch_shelves[(*count)++] = (fln_glyph_shelf_ref){ shelf, atlas->shelves[shelf].generation };
+	return true;
+}
+
+// 实际的排版：结果写入 scratch_quads / scratch_shelves
+static bool layout(fln_font *font, const char *text, size_t len, unsigned int size, float max_width, fln_text_align align, float line_spacing, size_t *count, size_t *shelves_count, float *width, float *height, bool *incomplete) {
+	if (!fln_font_set_size(font, size)) {
+		return false;
+	}
+	const FT_Size_Metrics *metrics = &font->face->size->metrics;
+	float ascender = metrics->ascender / 64.0f;
+	float line_height = metrics->height / 64.0f * line_spacing;
+	float scale = fln_font_scale(font, size);
+	float kerning_scale = (float)size / font->face->units_per_EM;
+	bool has_kerning = FT_HAS_KERNING(font->face);
+	const fln_glyph_atlas *atlas = fln_font_atlas();
+	if (!atlas) {
+		return false;
+	}
+
+	*count = 0;
+	*shelves_count = 0;
+	unsigned int deferrals = atlas->deferrals;
+	float pen_x = 0.0f;
+	float baseline = ascender;
+	float max_line_width = 0.0f;
+	size_t line_begin = 0;
+	float line_width = 0.0f; // 不含行尾空白
+	size_t break_quad = 0; // 最近一个空白之后的第一个四边形
+	float break_x = 0.0f; // 该空白之后的 pen_x
+	float break_width = 0.0f; // 在该空白处断开时这一行的宽度（不含空白）
+	bool has_break = false;
+	uint32_t previous = 0;
+
+	const char *cursor = text;
+	const char *end = text + len;
+	while (cursor < end) {
+		uint32_t codepoint = fln_utf8_next(&cursor, end);
+		if (codepoint == '\n') {
+			finish_line(scratch_quads, line_begin, *count, line_width, max_width, align);
+			if (max_line_width < line_width) {
+				max_line_width = line_width;
+			}
+			pen_x = 0.0f;
+			line_width = 0.0f;
+			baseline += line_height;
+			line_begin = *count;
+			has_break = false;
+			previous = 0;
+			continue;
+		}
+		if (codepoint == '\r') {
+			continue;
+		}
+
+		uint32_t glyph_index = FT_Get_Char_Index(font->face, codepoint);
+		if (has_kerning && previous && glyph_index) {
+			FT_Vector kerning;
+			if (FT_Get_Kerning(font->face, previous, glyph_index, FT_KERNING_UNSCALED, &kerning) == FT_Err_Ok) {
+				pen_x += kerning.x * kerning_scale;
+			}
+		}
+		previous = glyph_index;
+
+		const fln_glyph *glyph = fln_font_glyph(font, glyph_index, size);
+		if (!glyph) {
+			continue;
+		}
+		float advance = glyph->advance * scale;
+		bool is_space = codepoint == ' ' || codepoint == '\t' || codepoint == 0x3000;
+
+		// 自动换行：优先在最近的空白处断开，整行没有空白时直接在当前字符前断开
+		if (max_width > 0.0f && !is_space && pen_x + advance > max_width && pen_x > 0.0f) {
+			float finished_width;
+			if (has_break && break_quad > line_begin) {
+				// 空白之后的半个单词移到下一行，不计入这一行的宽度
+				finished_width = break_width;
+				finish_line(scratch_quads, line_begin, break_quad, finished_width, max_width, align);
+				for (size_t i = break_quad; i < *count; i++) {
+					scratch_quads[i].x0 -= break_x;
+					scratch_quads[i].x1 -= break_x;
+					scratch_quads[i].y0 += line_height;
+					scratch_quads[i].y1 += line_height;
+				}
+				pen_x -= break_x;
+				line_begin = break_quad;
+			} else {
+				finished_width = line_width;
+				finish_line(scratch_quads, line_begin, *count, finished_width, max_width, align);
+				pen_x = 0.0f;
+				line_begin = *count;
+			}
+			if (max_line_width < finished_width) {
+				max_line_width = finished_width;
+			}
+			line_width = pen_x; // 即 pen_x - break_x
+			baseline += line_height;
+			has_break = false;
+		}
+
+		if (glyph->width > 0 && glyph->height > 0) {
+			if (!reserve((void **)&scratch_quads, &scratch_quads_capacity, *count + 1, sizeof(fln_text_quad))) {
+				return false;
+			}
+			fln_text_quad *quad = &scratch_quads[(*count)++];
+			quad->x0 = pen_x + glyph->bearing_x * scale;
+			quad->y0 = baseline - glyph->bearing_y * scale;
+			quad->x1 = quad->x0 + glyph->width * scale;
+			quad->y1 = quad->y0 + glyph->height * scale;
+			quad->u0 = (float)glyph->x / atlas->width;
+			quad->v0 = (float)glyph->y / atlas->height;
+			quad->u1 = (float)(glyph->x + glyph->width) / atlas->width;
+			quad->v1 = (float)(glyph->y + glyph->height) / atlas->height;
+			if (!add_shelf(atlas, shelves_count, glyph->shelf)) {
+				return false;
+			}
+		}
+		pen_x += advance;
+		if (is_space) {
+			has_break = true;
+			break_quad = *count;
+			break_x = pen_x;
+			break_width = line_width;
+		} else {
+			line_width = pen_x;
+		}
+	}
+	finish_line(scratch_quads, line_begin, *count, line_width, max_width, align);
+	if (max_line_width < line_width) {
+		max_line_width = line_width;
+	}
+	*width = max_line_width;
+	*height = baseline - ascender + line_height;
+	*incomplete = atlas->deferrals != deferrals;
+	return true;
+}
+
+bool fln_text_layout_run(fln_font *font, const char *text, size_t len, unsigned int size, float max_width, fln_text_align align, float line_spacing, fln_text_layout *out) {
+	if (!font->face) {
+		return false;
+	}
+	const fln_glyph_atlas *atlas = fln_font_atlas();
+	if (!atlas) {
+		return false;
+	}
+
+	run_params params;
+	memset(&params, 0, sizeof(params));
+	params.font = font->serial;
+	params.size = size;
+	params.max_width = max_width;
+	params.line_spacing = line_spacing;
+	params.align = align;
+	size_t key_len = sizeof(params) + len;
+	if (!reserve((void **)&scratch_key, &scratch_key_capacity, key_len, 1)) {
+		return false;
+	}
+	memcpy(scratch_key, &params, sizeof(params));
+	memcpy(scratch_key + sizeof(params), text, len);
+
+	run_entry *entry = nullptr;
+	HASH_FIND(hh, runs, scratch_key, key_len, entry);
+	if (entry && (!entry->incomplete || entry->last_used == frame) && fln_font_atlas_touch(entry->shelves, entry->shelves_count)) {
+		entry->last_used = frame;
+		out->quads = entry->quads;
+		out->count = entry->count;
+		out->shelves = entry->shelves;
+		out->shelves_count = entry->shelves_count;
+		out->width = entry->width;
+		out->height = entry->height;
+		out->incomplete = entry->incomplete;
+		return true;
+	}
+	if (entry) {
+		free_run(entry);
+	}
+
+	size_t count, shelves_count;
+	float width, height;
+	bool incomplete;
+	if (!layout(font, text, len, size, max_width, align, line_spacing, &count, &shelves_count, &width, &height, &incomplete)) {
+		return false;
+	}
+	// 排版过程中前面字形所在的 shelf 被淘汰了，它们的 UV 可能已经失效，重新排一次
+	if (!fln_font_atlas_touch(scratch_shelves, shelves_count)) {
+		if (!layout(font, text, len, size, max_width, align, line_spacing, &count, &shelves_count, &width, &height, &incomplete)) {
+			return false;
+		}
+	}
+
+	entry = fln_calloc(1, sizeof(run_entry));
+	if (!entry) {
+		return false;
+	}
+	entry->key = fln_alloc(key_len);
+	entry->quads = count ? fln_alloc(count * sizeof(fln_text_quad)) : nullptr;
+	entry->shelves = shelves_count ? fln_alloc(shelves_count * sizeof(fln_glyph_shelf_ref)) : nullptr;
+	if (!entry->key || (count && !entry->quads) || (shelves_count && !entry->shelves)) {
+		fln_free(entry->key);
+		fln_free(entry->quads);
+		fln_free(entry->shelves);
+		fln_free(entry);
+		return false;
+	}
+	memcpy(entry->key, scratch_key, key_len);
+	entry->key_len = key_len;
+	if (count) {
+		memcpy(entry->quads, scratch_quads, count * sizeof(fln_text_quad));
+	}
+	if (shelves_count) {
+		memcpy(entry->shelves, scratch_shelves, shelves_count * sizeof(fln_glyph_shelf_ref));
+	}
+	entry->count = count;
+	entry->shelves_count = shelves_count;
+	entry->width = width;
+	entry->height = height;
+	entry->incomplete = incomplete;
+	entry->last_used = frame;
+	HASH_ADD_KEYPTR(hh, runs, entry->key, entry->key_len, entry);
+	runs_count++;
+
+	out->quads = entry->quads;
+	out->count = entry->count;
+	out->shelves = entry->shelves;
+	out->shelves_count = entry->shelves_count;
+	out->width = entry->width;
+	out->height = entry->height;
+	out->incomplete = entry->incomplete;
+	return true;
+}
+
+// buffer ----------------------------------------------------------------------
+
+void fln_text_buffer_init(fln_text_buffer *buffer) {
+	buffer->vertices = nullptr;
+	buffer->count = 0;
+	buffer->capacity = 0;
+	buffer->spans = nullptr;
+	buffer->spans_count = 0;
+	buffer->spans_capacity = 0;
+	buffer->shelves = nullptr;
+	buffer->shelves_count = 0;
+	buffer->shelves_capacity = 0;
+	buffer->incomplete = false;
+	buffer->layout_frame = 0;
+	buffer->color[0] = 1.0f;
+	buffer->color[1] = 1.0f;
+	buffer->color[2] = 1.0f;
+	buffer->color[3] = 1.0f;
+	buffer->max_width = 0.0f;
+	buffer->line_spacing = 1.0f;
+	buffer->align = FLN_TEXT_ALIGN_LEFT;
+	buffer->dirty = false;
+}
+
+static void clear_buffer(fln_text_buffer *buffer) {
+	for (size_t i = 0; i < buffer->spans_count; i++) {
+		fln_free(buffer->spans[i].text);
+	}
+	buffer->spans_count = 0;
+	buffer->shelves_count = 0;
+	buffer->count = 0;
+	buffer->incomplete = false;
+}
+
+void fln_text_buffer_free(fln_text_buffer *buffer) {
+	clear_buffer(buffer);
+	fln_free(buffer->vertices);
+	fln_free(buffer->spans);
+	fln_free(buffer->shelves);
+	buffer->vertices = nullptr;
+	buffer->spans = nullptr;
+	buffer->shelves = nullptr;
+	buffer->capacity = 0;
+	buffer->spans_capacity = 0;
+	buffer->shelves_capacity = 0;
+}
+
+// 排版一段文字并把顶点和用到的 shelf 追加到批次中
+static bool append_span(fln_text_buffer *buffer, const fln_text_span *span) {
+	fln_text_layout run;
+	if (!fln_text_layout_run(span->font, span->text, span->len, span->size, span->max_width, span->align, span->line_spacing, &run)) {
+		return false;
+	}
+	if (!reserve((void **)&buffer->vertices, &buffer->capacity, buffer->count + run.count * 4, sizeof(fln_text_vertex))) {
+		return false;
+	}
+	const float x = span->x, y = span->y;
+	const float r = span->color[0], g = span->color[1], b = span->color[2], a = span->color[3];
+	fln_text_vertex *v = buffer->vertices + buffer->count;
+	for (size_t i = 0; i < run.count; i++, v += 4) {
+		const fln_text_quad *q = &run.quads[i];
+		v[0] = (fln_text_vertex){ x + q->x0, y + q->y0, q->u0, q->v0, r, g, b, a };
+		v[1] = (fln_text_vertex){ x + q->x1, y + q->y0, q->u1, q->v0, r, g, b, a };
+		v[2] = (fln_text_vertex){ x + q->x1, y + q->y1, q->u1, q->v1, r, g, b, a };
+		v[3] = (fln_text_vertex){ x + q->x0, y + q->y1, q->u0, q->v1, r, g, b, a };
+	}
+	buffer->count += run.count * 4;
+	if (run.incomplete) {
+		buffer->incomplete = true;
+		buffer->layout_frame = frame;
+	}
+
+	// 同一个 shelf 只记录一次，generation 不同时保留先记录的，提交前检查时会发现前面的顶点已经失效
+	for (size_t i = 0; i < run.shelves_count; i++) {
+		bool found = false;
+		for (size_t j = 0; j < buffer->shelves_count && !found; j++) {
+			found = buffer->shelves[j].shelf == run.shelves[i].shelf;
+		}
+		if (found) {
+			continue;
+		}
+		if (!reserve((void **)&buffer->shelves, &buffer->shelves_capacity, buffer->shelves_count + 1, sizeof(fln_glyph_shelf_ref))) {
+			return false;
+		}
+		buffer->shelves[buffer->shelves_count++] = run.shelves[i];
+	}
+	return true;
+}
+
+bool fln_text_buffer_add(fln_text_buffer *buffer, fln_font *font, const char *text, size_t len, float x, float y, unsigned int size) {
+	if (!reserve((void **)&buffer->spans, &buffer->spans_capacity, buffer->spans_count + 1, sizeof(fln_text_span))) {
+		return false;
+	}
+	fln_text_span *span = &buffer->spans[buffer->spans_count];
+	span->font = font;
+	span->text = fln_alloc(len ? len : 1);
+	if (!span->text) {
+		return false;
+	}
+	memcpy(span->text, text, len);
+	span->len = len;
+	span->x = x;
+	span->y = y;
+	span->size = size;
+	memcpy(span->color, buffer->color, sizeof(span->color));
+	span->max_width = buffer->max_width;
+	span->line_spacing = buffer->line_spacing;
+	span->align = buffer->align;
+
+	if (!append_span(buffer, span)) {
+		fln_free(span->text);
+		return false;
+	}
+	buffer->spans_count++;
+	buffer->dirty = true;
+	return true;
+}
+
+static bool relayout(fln_text_buffer *buffer) {
+	buffer->count = 0;
+	buffer->shelves_count = 0;
+	buffer->incomplete = false;
+	for (size_t i = 0; i < buffer->spans_count; i++) {
+		if (!append_span(buffer, &buffer->spans[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool fln_text_buffer_prepare(fln_text_buffer *buffer) {
+	if ((!buffer->incomplete || buffer->layout_frame == frame) && fln_font_atlas_touch(buffer->shelves, buffer->shelves_count)) {
+		return true;
+	}
+	buffer->dirty = true;
+	if (!relayout(buffer)) {
+		buffer->count = 0;
+		return false;
+	}
+	// 后面几段的排版淘汰了前面几段用到的 shelf，它们的 UV 可能已经失效，再排一次
+	if (!fln_font_atlas_touch(buffer->shelves, buffer->shelves_count) && !relayout(buffer)) {
+		buffer->count = 0;
+		return false;
+	}
+	return true;
+}
+
+// lua -------------------------------------------------------------------------
+
+static int l_text_add(lua_State *L) {
+	fln_text_buffer *buffer = luaL_checkudata(L, 1, FLN_USERTYPE_TEXT);
+	fln_font *font = luaL_checkudata(L, 2, FLN_USERTYPE_FONT);
+	if (!font->face) {
+		return fln_error(L, "invalid font");
+	}
+	size_t len;
+	const char *text = luaL_checklstring(L, 3, &len);
+	float x = luaL_checknumber(L, 4);
+	float y = luaL_checknumber(L, 5);
+	lua_Integer size = luaL_checkinteger(L, 6);
+	luaL_argcheck(L, size > 0 && size <= 1024, 6, "invalid font size");
+	if (!fln_text_buffer_add(buffer, font, text, len, x, y, (unsigned int)size)) {
+		return fln_error(L, "failed to lay out text");
+	}
+	// 批次记录了字体指针，用 uservalue 中的表引用字体，防止它先被回收
+	if (lua_getiuservalue(L, 1, 1) != LUA_TTABLE) {
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_setiuservalue(L, 1, 1);
+	}
+	lua_pushvalue(L, 2);
+	lua_pushboolean(L, 1);
+	lua_rawset(L, -3);
+	lua_pop(L, 1);
+	return 0;
+}
+
+static int l_text_color(lua_State *L) {
+	fln_text_buffer *buffer = luaL_checkudata(L, 1, FLN_USERTYPE_TEXT);
+	buffer->color[0] = luaL_checknumber(L, 2);
+	buffer->color[1] = luaL_checknumber(L, 3);
+	buffer->color[2] = luaL_checknumber(L, 4);
+	buffer->color[3] = luaL_optnumber(L, 5, 1.0);
+	return 0;
+}
+
+static int l_text_wrap(lua_State *L) {
+	static const char *const aligns[] = { "left", "center", "right", nullptr };
+	fln_text_buffer *buffer = luaL_checkudata(L, 1, FLN_USERTYPE_TEXT);
+	buffer->max_width = luaL_optnumber(L, 2, 0.0);
+	buffer->align = (fln_text_align)luaL_checkoption(L, 3, "left", aligns);
+	buffer->line_spacing = luaL_optnumber(L, 4, 1.0);
+	return 0;
+}
+
+static int l_text_clear(lua_State *L) {
+	fln_text_buffer *buffer = luaL_checkudata(L, 1, FLN_USERTYPE_TEXT);
+	clear_buffer(buffer);
+	buffer->dirty = true;
+	lua_pushnil(L);
+	lua_setiuservalue(L, 1, 1);
+	return 0;
+}
+
+static int l_text_count(lua_State *L) {
+	fln_text_buffer *buffer = luaL_checkudata(L, 1, FLN_USERTYPE_TEXT);
+	lua_pushinteger(L, buffer->count / 4);
+	return 1;
+}
+
+void fln_text_setfuncs(lua_State *L) {
+	const luaL_Reg meths[] = {
+		{ "add", l_text_add },
+		{ "color", l_text_color },
+		{ "wrap", l_text_wrap },
+		{ "clear", l_text_clear },
+		{ "count", l_text_count },
+		{ nullptr, nullptr }
+	};
+	luaL_setfuncs(L, meths, 0);
+}
+
+void fln_text_new_frame(void) {
+	frame++;
+	if (runs_count <= RUN_CACHE_SOFT_LIMIT) {
+		return;
+	}
+	run_entry *entry, *tmp;
+	HASH_ITER(hh, runs, entry, tmp) {
+		if (frame - entry->last_used > RUN_CACHE_MAX_AGE) {
+			free_run(entry);
+		}
+	}
+}
+
+void fln_text_quit(void) {
+	run_entry *entry, *tmp;
+	HASH_ITER(hh, runs, entry, tmp) {
+		free_run(entry);
+	}
+	fln_free(scratch_key);
+	fln_free(scratch_quads);
+	fln_free(scratch_shelves);
+	scratch_key = nullptr;
+	scratch_quads = nullptr;
+	scratch_shelves = nullptr;
+	scratch_key_capacity = 0;
+	scratch_quads_capacity = 0;
+	scratch_shelves_capacity = 0;
+}
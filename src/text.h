@@ -0,0 +1,97 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <lua.h>
+#include <stddef.h>
+
+#include "font.h"
+
+// 文字排版与批量绘制的 CPU 部分
+// 坐标系为 y 轴向下，原点在文字框左上角，第一行的基线位于 ascender 处
+
+typedef enum fln_text_align {
+	FLN_TEXT_ALIGN_LEFT,
+	FLN_TEXT_ALIGN_CENTER,
+	FLN_TEXT_ALIGN_RIGHT,
+} fln_text_align;
+
+// 一个字形四边形（相对于文字框原点）
+typedef struct fln_text_quad {
+	float x0, y0, x1, y1;
+	float u0, v0, u1, v1;
+} fln_text_quad;
+
+// 与内置 text/sdf_text 着色器的顶点格式一致
+typedef struct fln_text_vertex {
+	float x, y;
+	float u, v;
+	float r, g, b, a;
+} fln_text_vertex;
+
+typedef struct fln_text_layout {
+	const fln_text_quad *quads;
+	size_t count;
+	const fln_glyph_shelf_ref *shelves; // 用到的图集 shelf
+	size_t shelves_count;
+	float width;
+	float height;
+	bool incomplete; // 有字形因为图集已满被推迟，下一帧需要重新排版
+} fln_text_layout;
+
+// 排版结果按 (字体, 大小, 换行宽度, 对齐, 行距, 字符串) 缓存，返回的数据在下一帧之前有效
+bool fln_text_layout_run(fln_font *font, const char *text, size_t len, unsigned int size, float max_width, fln_text_align align, float line_spacing, fln_text_layout *out);
+
+// 一次 add 的参数，图集淘汰字形后据此重新排版
+typedef struct fln_text_span {
+	fln_font *font; // 由批次 userdata 的 uservalue 引用，不会先于批次被回收
+	char *text;
+	size_t len;
+	float x, y;
+	unsigned int size;
+	float color[4];
+	float max_width;
+	float line_spacing;
+	fln_text_align align;
+} fln_text_span;
+
+// 顶点流，图形后端的文字批次对象必须把它放在第一个成员
+typedef struct fln_text_buffer {
+	fln_text_vertex *vertices;
+	size_t count;
+	size_t capacity;
+	fln_text_span *spans;
+	size_t spans_count;
+	size_t spans_capacity;
+	fln_glyph_shelf_ref *shelves; // 顶点用到的图集 shelf，每次提交时刷新它们的 LRU 时间，其中任何一个淘汰过字形时重新排版
+	size_t shelves_count;
+	size_t shelves_capacity;
+	bool incomplete; // 有字形被推迟，之后的帧提交时重新排版
+	uint64_t layout_frame;
+	float color[4];
+	float max_width;
+	float line_spacing;
+	fln_text_align align;
+	bool dirty; // 顶点有变化，需要重新上传
+} fln_text_buffer;
+
+void fln_text_buffer_init(fln_text_buffer *buffer);
+
+void fln_text_buffer_free(fln_text_buffer *buffer);
+
+bool fln_text_buffer_add(fln_text_buffer *buffer, fln_font *font, const char *text, size_t len, float x, float y, unsigned int size);
+
+// 后端提交批次前调用：刷新用到的 shelf，其中有 shelf 淘汰过字形时按记录的 add 重新生成顶点（并置 dirty）
+bool fln_text_buffer_prepare(fln_text_buffer *buffer);
+
+// 向栈顶的元表中注册与后端无关的方法（add, color, wrap, clear, count）
+void fln_text_setfuncs(lua_State *L);
+
+void fln_text_new_frame(void);
+
+void fln_text_quit(void);
@@ -12,26 +12,106 @@
 
 #include <SDL3/SDL_timer.h>
 
+#include "error.h"
+#include "profiler.h"
+
+static uint64_t fixed_step_ns = 0; // 0 表示使用真实时间
+static uint64_t virtual_ns = 0;
+
+uint64_t fln_timer_now_ns(void) {
+	return fixed_step_ns ? virtual_ns : SDL_GetTicksNS();
+}
+
+void fln_timer_set_fixed_step(uint64_t step_ns) {
+	fixed_step_ns = step_ns;
+	virtual_ns = 0;
+}
+
+void fln_timer_new_frame(void) {
+	virtual_ns += fixed_step_ns;
+}
+
 static int l_milliseconds(lua_State *L) {
-	lua_pushinteger(L, (lua_Integer)SDL_GetTicks());
+	lua_pushinteger(L, (lua_Integer)(fln_timer_now_ns() / 1000000));
 	return 1;
 }
 
 static int l_nanoseconds(lua_State *L) {
-	lua_pushinteger(L, (lua_Integer)SDL_GetTicksNS());
+	lua_pushinteger(L, (lua_Integer)fln_timer_now_ns());
 	return 1;
 }
 
+// counter 始终是真实时间，用来测量耗时
+
 static int l_counter(lua_State *L) {
 	lua_pushinteger(L, (lua_Integer)SDL_GetPerformanceCounter());
 	return 1;
 }
 
+// 脚本开启且实际记录了的区段数，与引擎自己的区段分开计数
+// 没有对应 zone_begin 的 zone_end 被忽略，不会结束引擎的 draw、iterate 等区段
+static int script_zones = 0;
+
+// 区段名会被复制保存，脚本可以使用拼接出来的字符串
+static int l_zone_begin(lua_State *L) {
+	const char *name = luaL_checkstring(L, 1);
+	if (!atomic_load_explicit(&fln_profiler_active, memory_order_relaxed)) {
+		return 0;
+	}
+	const char *interned = fln_profiler_intern(name);
+	if (interned) {
+		int depth = fln_profiler_depth;
+		fln_profiler_begin(interned);
+		if (fln_profiler_depth > depth) {
+			script_zones++;
+		}
+	}
+	return 0;
+}
+
+static int l_zone_end(lua_State *L) {
+	if (script_zones > 0) {
+		script_zones--;
+		FLN_ZONE_END();
+	}
+	return 0;
+}
+
+void fln_timer_end_script_zones(void) {
+	while (script_zones > 0) {
+		script_zones--;
+		FLN_ZONE_END();
+	}
+}
+
+static int l_profiler(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TBOOLEAN);
+	fln_profiler_enable(lua_toboolean(L, 1));
+	return 0;
+}
+
+// 导出为 Chrome trace JSON，成功时返回 true，否则返回 nil 和错误信息
+static int l_trace(lua_State *L) {
+	const char *path = luaL_checkstring(L, 1);
+	const char *err = nullptr;
+	if (!fln_profiler_write_trace(path, &err)) {
+		lua_pushnil(L);
+		lua_pushstring(L, err);
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	return 1;
+}
+
 int fln_luaopenimer(lua_State *L) {
 	const luaL_Reg funcs[] = {
 		{ "milliseconds", l_milliseconds },
 		{ "nanoseconds", l_nanoseconds },
 		{ "counter", l_counter },
+		{ "zone_begin", l_zone_begin },
+		{ "zone_end", l_zone_end },
+		{ "profiler", l_profiler },
+		{ "trace", l_trace },
 		{ nullptr, nullptr },
 	};
 	luaL_newlib(L, funcs);
@@ -8,5 +8,17 @@
 #pragma once
 
 #include <lua.h>
+#include <stdint.h>
+
+// 引擎使用的时间（纳秒）。设置了固定步长后每帧只前进一个步长，与真实时间无关（用于录制和回放）
+uint64_t fln_timer_now_ns(void);
+
+void fln_timer_set_fixed_step(uint64_t step_ns);
+
+// 每帧开始时调用
+void fln_timer_new_frame(void);
+
+// 结束脚本开启后没有结束的区段（出错跳过了 zone_end 等），每次调用脚本回调之后调用
+void fln_timer_end_script_zones(void);
 
 int fln_luaopenimer(lua_State *L);
\ No newline at end of file
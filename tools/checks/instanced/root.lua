@@ -0,0 +1,100 @@
+--[[
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+]]
+
+-- 用 math.compose 的结果作为实例属性，通过 submit_instanced 绘制 3x3 个三角形
+-- 在这个目录下运行：
+--   flandre --headless --frames=10   （同时把画面保存为 instanced.png）
+--   flandre --gfx=null --frames=10
+-- 出错或者统计的实例数不对时以非零状态退出
+
+local flandre = require("flandre")
+local graphics = flandre.graphics
+
+local COUNT = 9
+local STRIDE = 2 + 16 -- 逐顶点的 vec2 位置 + 逐实例的 mat4
+
+local function fail(message)
+	print("instanced check failed: " .. message)
+	os.exit(1)
+end
+
+local pipeline = graphics.pipeline({
+	shaders = {
+		vertex = [[
+#version 460 core
+layout(location = 0) in vec2 position;
+layout(location = 1) in mat4 model;
+void main() {
+	gl_Position = model * vec4(position, 0.0, 1.0);
+}
+]],
+		fragment = [[
+#version 460 core
+out vec4 color;
+void main() {
+	color = vec4(1.0, 0.5, 0.2, 1.0);
+}
+]],
+	},
+})
+
+-- 交错的顶点数据：每条记录 STRIDE 个 float，前 3 条的位置是三角形的顶点，第 i 条的矩阵属于第 i 个实例
+local base = {}
+local triangle = { -1, -1, 1, -1, 0, 1 }
+for i = 1, COUNT do
+	local x = triangle[i * 2 - 1] or 0
+	local y = triangle[i * 2] or 0
+	base[#base + 1] = string.pack("ff", x, y) .. string.rep("\0", 16 * 4)
+end
+base = table.concat(base)
+
+local positions, scales = {}, {}
+for i = 0, COUNT - 1 do
+	local x = (i % 3 - 1) * 0.6
+	local y = (i // 3 - 1) * 0.6
+	positions[#positions + 1] = string.pack("fff", x, y, 0)
+	scales[#scales + 1] = string.pack("fff", 0.2, 0.2, 1)
+end
+
+local vertices = flandre.math.compose(table.concat(positions), nil, table.concat(scales), {
+	stride = STRIDE,
+	offset = 2,
+	base = base,
+})
+if #vertices ~= COUNT * STRIDE * 4 then
+	fail("unexpected compose output size " .. #vertices)
+end
+
+local mesh = graphics.mesh(
+	vertices,
+	string.pack("I4I4I4", 0, 1, 2),
+	string.pack("I4I4I4I4I4", 2, 4, 4, 4, 4),
+	string.pack("I4I4I4I4I4", 0, 1, 1, 1, 1)
+)
+
+local frame = 0
+flandre.callback.draw(function()
+	frame = frame + 1
+	local ok, err = pcall(pipeline.submit_instanced, pipeline, mesh, COUNT)
+	if not ok then
+		fail(err)
+	end
+	-- stats() 返回上一帧的计数
+	if frame > 1 then
+		local instances = flandre.system.stats().instances
+		if instances ~= COUNT then
+			fail("expected " .. COUNT .. " instances, got " .. tostring(instances))
+		end
+	end
+	if frame == 2 and graphics.backend ~= "null" then
+		graphics.capture("instanced.png")
+	end
+	if frame == 8 then
+		print("instanced check passed (" .. graphics.backend .. ")")
+	end
+end)
@@ -0,0 +1,231 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include <SDL3/SDL_filesystem.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode_format.h"
+
+// 用法：flandre-luac [-g] <script dir> <output.fla>
+// 递归编译目录下所有 .lua 文件，默认去掉调试信息，-g 保留（错误信息中有行号）
+
+typedef struct luac_script {
+	char name[FLN_BYTECODE_NAME_SIZE];
+	char *bytecode;
+	size_t size;
+} luac_script;
+
+typedef struct luac_context {
+	lua_State *L;
+	bool strip;
+	size_t root_len;
+	luac_script *scripts;
+	size_t scripts_count;
+	size_t scripts_capacity;
+	bool failed;
+} luac_context;
+
+typedef struct luac_buffer {
+	char *data;
+	size_t size;
+	size_t capacity;
+} luac_buffer;
+
+static int buffer_writer(lua_State *L, const void *p, size_t size, void *ud) {
+	luac_buffer *buffer = ud;
+	if (buffer->size + size > buffer->capacity) {
+		size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+		while (capacity < buffer->size + size) {
+			capacity *= 2;
+		}
+		char *data = realloc(buffer->data, capacity);
+		if (!data) {
+			return 1;
+		}
+		buffer->data = data;
+		buffer->capacity = capacity;
+	}
+	memcpy(buffer->data + buffer->size, p, size);
+	buffer->size += size;
+	return 0;
+}
+
+static bool has_lua_extension(const char *path) {
+	size_t len = strlen(path);
+	return len > 4 && strcmp(path + len - 4, ".lua") == 0;
+}
+
+static bool compile(luac_context *context, const char *path, const char *name) {
+	if (strlen(name) >= FLN_BYTECODE_NAME_SIZE) {
+		printf("path too long: '%s'\n", name);
+		return false;
+	}
+	size_t size;
+	char *source = SDL_LoadFile(path, &size);
+	if (!source) {
+		printf("failed to read '%s': %s\n", path, SDL_GetError());
+		return false;
+	}
+	// 跳过 UTF-8 BOM
+	size_t skip = size >= 3 && memcmp(source, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+	lua_State *L = context->L;
+	// chunkname 使用归档中的名字，保留调试信息时错误信息与运行时的路径一致
+	lua_pushfstring(L, "@%s", name);
+	int status = luaL_loadbufferx(L, source + skip, size - skip, lua_tostring(L, -1), "t");
+	SDL_free(source);
+	if (status != LUA_OK) {
+		printf("%s\n", lua_tostring(L, -1));
+		lua_pop(L, 2);
+		return false;
+	}
+	luac_buffer buffer = { nullptr, 0, 0 };
+	if (lua_dump(L, buffer_writer, &buffer, context->strip) != 0) {
+		printf("failed to dump '%s'\n", path);
+		free(buffer.data);
+		lua_pop(L, 2);
+		return false;
+	}
+	lua_pop(L, 2);
+
+	if (context->scripts_count == context->scripts_capacity) {
+		size_t capacity = context->scripts_capacity ? context->scripts_capacity * 2 : 64;
+		luac_script *scripts = realloc(context->scripts, capacity * sizeof(luac_script));
+		if (!scripts) {
+			free(buffer.data);
+			return false;
+		}
+		context->scripts = scripts;
+		context->scripts_capacity = capacity;
+	}
+	luac_script *script = &context->scripts[context->scripts_count++];
+	memset(script, 0, sizeof(*script));
+	strcpy(script->name, name);
+	script->bytecode = buffer.data;
+	script->size = buffer.size;
+	return true;
+}
+
+static SDL_EnumerationResult enumerate(void *userdata, const char *dirname, const char *fname) {
+	luac_context *context = userdata;
+	char path[1024];
+	snprintf(path, sizeof(path), "%s%s", dirname, fname);
+	SDL_PathInfo info;
+	if (!SDL_GetPathInfo(path, &info)) {
+		return SDL_ENUM_CONTINUE;
+	}
+	if (info.type == SDL_PATHTYPE_DIRECTORY) {
+		if (!SDL_EnumerateDirectory(path, enumerate, context)) {
+			context->failed = true;
+		}
+	} else if (info.type == SDL_PATHTYPE_FILE && has_lua_extension(fname)) {
+		// 归档中的名字相对于脚本根目录，统一使用 '/'
+		char name[1024];
+		snprintf(name, sizeof(name), "%s", path + context->root_len);
+		for (char *p = name; *p; p++) {
+			if (*p == '\\') {
+				*p = '/';
+			}
+		}
+		if (!compile(context, path, name)) {
+			context->failed = true;
+		}
+	}
+	return context->failed ? SDL_ENUM_FAILURE : SDL_ENUM_CONTINUE;
+}
+
+static int compare_script(const void *a, const void *b) {
+	return strcmp(((const luac_script *)a)->name, ((const luac_script *)b)->name);
+}
+
+static bool write_archive(const char *path, luac_script *scripts, size_t count) {
+	qsort(scripts, count, sizeof(luac_script), compare_script);
+
+	fln_bytecode_archive_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FLN_BYTECODE_ARCHIVE_MAGIC, sizeof(header.magic));
+	header.version = FLN_BYTECODE_ARCHIVE_VERSION;
+	header.lua_version = LUA_VERSION_RELEASE_NUM;
+	header.entries_count = (uint32_t)count;
+
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		printf("failed to open '%s' for writing\n", path);
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	uint64_t offset = sizeof(header) + count * sizeof(fln_bytecode_archive_entry);
+	for (size_t i = 0; ok && i < count; i++) {
+		fln_bytecode_archive_entry entry;
+		memset(&entry, 0, sizeof(entry));
+		strcpy(entry.name, scripts[i].name);
+		entry.offset = offset;
+		entry.size = scripts[i].size;
+		offset += entry.size;
+		ok = fwrite(&entry, sizeof(entry), 1, fp) == 1;
+	}
+	for (size_t i = 0; ok && i < count; i++) {
+		ok = fwrite(scripts[i].bytecode, 1, scripts[i].size, fp) == scripts[i].size;
+	}
+	if (fclose(fp) != 0) {
+		ok = false;
+	}
+	if (!ok) {
+		printf("failed to write '%s'\n", path);
+	}
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	luac_context context;
+	memset(&context, 0, sizeof(context));
+	context.strip = true;
+	int first = 1;
+	if (argc > 1 && strcmp(argv[1], "-g") == 0) {
+		context.strip = false;
+		first = 2;
+	}
+	if (argc - first != 2) {
+		printf("usage: %s [-g] <script dir> <output.fla>\n", argv[0]);
+		return 1;
+	}
+	const char *output = argv[first + 1];
+
+	// 目录统一以分隔符结尾，SDL 枚举时传回的 dirname 也是如此
+	char root[1024];
+	size_t len = strlen(argv[first]);
+	bool has_separator = len > 0 && (argv[first][len - 1] == '/' || argv[first][len - 1] == '\\');
+	snprintf(root, sizeof(root), "%s%s", argv[first], has_separator ? "" : "/");
+	context.root_len = strlen(root);
+
+	context.L = luaL_newstate();
+	if (!context.L) {
+		printf("cannot create lua_State\n");
+		return 1;
+	}
+	if (!SDL_EnumerateDirectory(root, enumerate, &context) && !context.failed) {
+		printf("failed to read '%s': %s\n", root, SDL_GetError());
+		context.failed = true;
+	}
+	bool ok = !context.failed && write_archive(output, context.scripts, context.scripts_count);
+	if (ok) {
+		size_t total = 0;
+		for (size_t i = 0; i < context.scripts_count; i++) {
+			total += context.scripts[i].size;
+		}
+		printf("%s: %zu scripts, %zu bytes of bytecode\n", output, context.scripts_count, total);
+	}
+	for (size_t i = 0; i < context.scripts_count; i++) {
+		free(context.scripts[i].bytecode);
+	}
+	free(context.scripts);
+	lua_close(context.L);
+	return ok ? 0 : 1;
+}
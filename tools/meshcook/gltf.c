@@ -0,0 +1,190 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "meshcook.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CGLTF_IMPLEMENTATION
+#include <cgltf.h>
+
+typedef struct gltf_layout {
+	bool has_texcoords;
+	bool has_normals;
+} gltf_layout;
+
+static const cgltf_accessor *find_attribute(const cgltf_primitive *primitive, cgltf_attribute_type type, cgltf_int index) {
+	for (cgltf_size i = 0; i < primitive->attributes_count; i++) {
+		if (primitive->attributes[i].type == type && primitive->attributes[i].index == index) {
+			return primitive->attributes[i].data;
+		}
+	}
+	return nullptr;
+}
+
+static void transform_point(const float m[16], float v[3]) {
+	float x = v[0], y = v[1], z = v[2];
+	v[0] = m[0] * x + m[4] * y + m[8] * z + m[12];
+	v[1] = m[1] * x + m[5] * y + m[9] * z + m[13];
+	v[2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+}
+
+// 法线只使用矩阵的 3x3 部分再归一化，非均匀缩放时会有少许偏差
+static void transform_normal(const float m[16], float v[3]) {
+	float x = v[0], y = v[1], z = v[2];
+	v[0] = m[0] * x + m[4] * y + m[8] * z;
+	v[1] = m[1] * x + m[5] * y + m[9] * z;
+	v[2] = m[2] * x + m[6] * y + m[10] * z;
+	float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (len > 0.0f) {
+		v[0] /= len;
+		v[1] /= len;
+		v[2] /= len;
+	}
+}
+
+static bool append_primitive(meshcook_mesh *mesh, const cgltf_primitive *primitive, const float world[16], gltf_layout layout) {
+	if (primitive->type != cgltf_primitive_type_triangles) {
+		return true;
+	}
+	const cgltf_accessor *position = find_attribute(primitive, cgltf_attribute_type_position, 0);
+	if (!position) {
+		return true;
+	}
+	const cgltf_accessor *texcoord = find_attribute(primitive, cgltf_attribute_type_texcoord, 0);
+	const cgltf_accessor *normal = find_attribute(primitive, cgltf_attribute_type_normal, 0);
+
+	size_t stride = 0;
+	for (uint32_t i = 0; i < mesh->attributes_count; i++) {
+		stride += mesh->attributes[i];
+	}
+	size_t base = mesh->vertices_count / stride;
+	if (base + position->count > UINT32_MAX) {
+		printf("too many vertices\n");
+		return false;
+	}
+
+	for (cgltf_size i = 0; i < position->count; i++) {
+		float vertex[8] = { 0 };
+		size_t n = 0;
+		cgltf_accessor_read_float(position, i, vertex, 3);
+		if (world) {
+			transform_point(world, vertex);
+		}
+		n += 3;
+		if (layout.has_texcoords) {
+			if (texcoord) {
+				cgltf_accessor_read_float(texcoord, i, vertex + n, 2);
+			}
+			n += 2;
+		}
+		if (layout.has_normals) {
+			if (normal) {
+				cgltf_accessor_read_float(normal, i, vertex + n, 3);
+				if (world) {
+					transform_normal(world, vertex + n);
+				}
+			}
+			n += 3;
+		}
+		if (!meshcook_push_vertex(mesh, vertex, n)) {
+			return false;
+		}
+	}
+
+	if (primitive->indices) {
+		for (cgltf_size i = 0; i < primitive->indices->count; i++) {
+			if (!meshcook_push_index(mesh, (uint32_t)(base + cgltf_accessor_read_index(primitive->indices, i)))) {
+				return false;
+			}
+		}
+	} else {
+		for (cgltf_size i = 0; i < position->count; i++) {
+			if (!meshcook_push_index(mesh, (uint32_t)(base + i))) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool append_mesh(meshcook_mesh *mesh, const cgltf_mesh *source, const float world[16], gltf_layout layout) {
+	for (cgltf_size i = 0; i < source->primitives_count; i++) {
+		if (!append_primitive(mesh, &source->primitives[i], world, layout)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool append_node(meshcook_mesh *mesh, const cgltf_node *node, gltf_layout layout) {
+	if (node->mesh) {
+		float world[16];
+		cgltf_node_transform_world(node, world);
+		if (!append_mesh(mesh, node->mesh, world, layout)) {
+			return false;
+		}
+	}
+	for (cgltf_size i = 0; i < node->children_count; i++) {
+		if (!append_node(mesh, node->children[i], layout)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// 所有网格（按场景中节点的世界变换）合并成一个 mesh
+bool meshcook_load_gltf(const char *path, meshcook_mesh *mesh) {
+	cgltf_options options;
+	memset(&options, 0, sizeof(options));
+	cgltf_data *data = nullptr;
+	if (cgltf_parse_file(&options, path, &data) != cgltf_result_success) {
+		printf("failed to parse '%s'\n", path);
+		return false;
+	}
+	if (cgltf_load_buffers(&options, data, path) != cgltf_result_success || cgltf_validate(data) != cgltf_result_success) {
+		printf("failed to load buffers of '%s'\n", path);
+		cgltf_free(data);
+		return false;
+	}
+
+	gltf_layout layout = { false, false };
+	for (cgltf_size i = 0; i < data->meshes_count; i++) {
+		for (cgltf_size j = 0; j < data->meshes[i].primitives_count; j++) {
+			const cgltf_primitive *primitive = &data->meshes[i].primitives[j];
+			layout.has_texcoords |= find_attribute(primitive, cgltf_attribute_type_texcoord, 0) != nullptr;
+			layout.has_normals |= find_attribute(primitive, cgltf_attribute_type_normal, 0) != nullptr;
+		}
+	}
+	mesh->attributes_count = 0;
+	mesh->attributes[mesh->attributes_count++] = 3;
+	if (layout.has_texcoords) {
+		mesh->attributes[mesh->attributes_count++] = 2;
+	}
+	if (layout.has_normals) {
+		mesh->attributes[mesh->attributes_count++] = 3;
+	}
+
+	bool ok = true;
+	const cgltf_scene *scene = data->scene ? data->scene : (data->scenes_count > 0 ? &data->scenes[0] : nullptr);
+	if (scene) {
+		for (cgltf_size i = 0; i < scene->nodes_count && ok; i++) {
+			ok = append_node(mesh, scene->nodes[i], layout);
+		}
+	} else {
+		for (cgltf_size i = 0; i < data->meshes_count && ok; i++) {
+			ok = append_mesh(mesh, &data->meshes[i], nullptr, layout);
+		}
+	}
+	cgltf_free(data);
+	if (!ok) {
+		printf("failed to convert '%s'\n", path);
+	}
+	return ok;
+}
@@ -0,0 +1,153 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "meshcook.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 用法：flandre-meshcook <input.obj|input.gltf|input.glb> <output.flm>
+
+bool meshcook_push_vertex(meshcook_mesh *mesh, const float *vertex, size_t count) {
+	if (mesh->vertices_count + count > mesh->vertices_capacity) {
+		size_t capacity = mesh->vertices_capacity ? mesh->vertices_capacity * 2 : 1024;
+		while (capacity < mesh->vertices_count + count) {
+			capacity *= 2;
+		}
+		float *vertices = realloc(mesh->vertices, capacity * sizeof(float));
+		if (!vertices) {
+			return false;
+		}
+		mesh->vertices = vertices;
+		mesh->vertices_capacity = capacity;
+	}
+	memcpy(mesh->vertices + mesh->vertices_count, vertex, count * sizeof(float));
+	mesh->vertices_count += count;
+	return true;
+}
+
+bool meshcook_push_index(meshcook_mesh *mesh, uint32_t index) {
+	if (mesh->indices_count == mesh->indices_capacity) {
+		size_t capacity = mesh->indices_capacity ? mesh->indices_capacity * 2 : 1024;
+		uint32_t *indices = realloc(mesh->indices, capacity * sizeof(uint32_t));
+		if (!indices) {
+			return false;
+		}
+		mesh->indices = indices;
+		mesh->indices_capacity = capacity;
+	}
+	mesh->indices[mesh->indices_count++] = index;
+	return true;
+}
+
+void meshcook_mesh_free(meshcook_mesh *mesh) {
+	free(mesh->vertices);
+	free(mesh->indices);
+	memset(mesh, 0, sizeof(meshcook_mesh));
+}
+
+static bool has_extension(const char *path, const char *ext) {
+	size_t len = strlen(path);
+	size_t ext_len = strlen(ext);
+	if (len < ext_len) {
+		return false;
+	}
+	const char *tail = path + len - ext_len;
+	for (size_t i = 0; i < ext_len; i++) {
+		char c = tail[i];
+		if (c >= 'A' && c <= 'Z') {
+			c += 'a' - 'A';
+		}
+		if (c != ext[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool write_padding(FILE *fp, uint64_t from, uint64_t to) {
+	static const unsigned char zeros[FLN_MESH_BLOB_ALIGNMENT] = { 0 };
+	return to - from == 0 || fwrite(zeros, 1, to - from, fp) == to - from;
+}
+
+static bool write_blob(const char *path, const meshcook_mesh *mesh) {
+	// 运行时会拒绝加载空的模型
+	if (mesh->vertices_count == 0 || mesh->indices_count == 0) {
+		printf("no geometry to write to '%s'\n", path);
+		return false;
+	}
+	fln_mesh_blob_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FLN_MESH_BLOB_MAGIC, sizeof(header.magic));
+	header.version = FLN_MESH_BLOB_VERSION;
+	header.attributes_count = mesh->attributes_count;
+	memcpy(header.attributes, mesh->attributes, sizeof(header.attributes));
+	header.vertices_offset = fln_mesh_blob_align(sizeof(header));
+	header.vertices_size = mesh->vertices_count * sizeof(float);
+	header.indices_offset = fln_mesh_blob_align(header.vertices_offset + header.vertices_size);
+	header.indices_size = mesh->indices_count * sizeof(uint32_t);
+
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		printf("failed to open '%s' for writing\n", path);
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+			&& write_padding(fp, sizeof(header), header.vertices_offset)
+			&& fwrite(mesh->vertices, 1, header.vertices_size, fp) == header.vertices_size
+			&& write_padding(fp, header.vertices_offset + header.vertices_size, header.indices_offset)
+			&& fwrite(mesh->indices, 1, header.indices_size, fp) == header.indices_size;
+	if (fclose(fp) != 0) {
+		ok = false;
+	}
+	if (!ok) {
+		printf("failed to write '%s'\n", path);
+	}
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		printf("usage: %s <input.obj|input.gltf|input.glb> <output.flm>\n", argv[0]);
+		return 1;
+	}
+	const char *input = argv[1];
+	const char *output = argv[2];
+
+	meshcook_mesh mesh;
+	memset(&mesh, 0, sizeof(mesh));
+	bool loaded;
+	if (has_extension(input, ".obj")) {
+		loaded = meshcook_load_obj(input, &mesh);
+	} else if (has_extension(input, ".gltf") || has_extension(input, ".glb")) {
+		loaded = meshcook_load_gltf(input, &mesh);
+	} else {
+		printf("unsupported input format: '%s'\n", input);
+		return 1;
+	}
+	if (!loaded) {
+		meshcook_mesh_free(&mesh);
+		return 1;
+	}
+	if (mesh.indices_count == 0) {
+		printf("'%s' does not contain any triangles\n", input);
+		meshcook_mesh_free(&mesh);
+		return 1;
+	}
+
+	bool ok = write_blob(output, &mesh);
+	if (ok) {
+		uint32_t stride = 0;
+		for (uint32_t i = 0; i < mesh.attributes_count; i++) {
+			stride += mesh.attributes[i];
+		}
+		printf("%s: %zu vertices, %zu indices, %u attributes\n", output, mesh.vertices_count / stride, mesh.indices_count, mesh.attributes_count);
+	}
+	meshcook_mesh_free(&mesh);
+	return ok ? 0 : 1;
+}
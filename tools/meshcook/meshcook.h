@@ -0,0 +1,35 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mesh_format.h"
+
+// 转换过程中的中间网格：交错 float 顶点 + uint32 索引
+typedef struct meshcook_mesh {
+	float *vertices;
+	size_t vertices_count; // float 的数量
+	size_t vertices_capacity;
+	uint32_t *indices;
+	size_t indices_count;
+	size_t indices_capacity;
+	uint32_t attributes[FLN_MESH_MAX_ATTRIBUTES];
+	uint32_t attributes_count;
+} meshcook_mesh;
+
+bool meshcook_push_vertex(meshcook_mesh *mesh, const float *vertex, size_t count);
+
+bool meshcook_push_index(meshcook_mesh *mesh, uint32_t index);
+
+void meshcook_mesh_free(meshcook_mesh *mesh);
+
+bool meshcook_load_obj(const char *path, meshcook_mesh *mesh);
+
+bool meshcook_load_gltf(const char *path, meshcook_mesh *mesh);
@@ -0,0 +1,255 @@
+/*
+	This file is part of Flandre
+	Copyright (c) 2025 Teabagus
+
+	Flandre is free software: you can redistribute it and/or modify
+	it under the terms of the MIT License.  See `LICENSE` for more details
+*/
+#include "meshcook.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uthash.h>
+
+// OBJ 面上的一个角：位置 / 纹理坐标 / 法线的索引（从 0 开始，-1 表示缺省）
+typedef struct obj_corner {
+	int v;
+	int vt;
+	int vn;
+} obj_corner;
+
+// 用于合并重复顶点
+typedef struct obj_vertex_entry {
+	obj_corner key;
+	uint32_t index;
+	UT_hash_handle hh;
+} obj_vertex_entry;
+
+typedef struct obj_floats {
+	float *data;
+	size_t count;
+	size_t capacity;
+} obj_floats;
+
+typedef struct obj_corners {
+	obj_corner *data;
+	size_t count;
+	size_t capacity;
+} obj_corners;
+
+static bool push_floats(obj_floats *array, const float *values, size_t count) {
+	if (array->count + count > array->capacity) {
+		size_t capacity = array->capacity ? array->capacity * 2 : 1024;
+		float *data = realloc(array->data, capacity * sizeof(float));
+		if (!data) {
+			return false;
+		}
+		array->data = data;
+		array->capacity = capacity;
+	}
+	memcpy(array->data + array->count, values, count * sizeof(float));
+	array->count += count;
+	return true;
+}
+
+static bool push_corner(obj_corners *array, obj_corner corner) {
+	if (array->count == array->capacity) {
+		size_t capacity = array->capacity ? array->capacity * 2 : 1024;
+		obj_corner *data = realloc(array->data, capacity * sizeof(obj_corner));
+		if (!data) {
+			return false;
+		}
+		array->data = data;
+		array->capacity = capacity;
+	}
+	array->data[array->count++] = corner;
+	return true;
+}
+
+// OBJ 的索引从 1 开始，负数表示从末尾往前数
+static int resolve_index(long index, size_t count) {
+	if (index > 0) {
+		return index - 1 < (long)count ? (int)(index - 1) : -2;
+	} else if (index < 0) {
+		return (long)count + index >= 0 ? (int)((long)count + index) : -2;
+	}
+	return -1;
+}
+
+// 解析 "v", "v/vt", "v//vn", "v/vt/vn"
+static bool parse_corner(const char **cursor, obj_corner *corner, size_t v_count, size_t vt_count, size_t vn_count) {
+	char *end;
+	long v = strtol(*cursor, &end, 10);
+	if (end == *cursor) {
+		return false;
+	}
+	long vt = 0;
+	long vn = 0;
+	if (*end == '/') {
+		end++;
+		if (*end != '/') {
+			vt = strtol(end, &end, 10);
+		}
+		if (*end == '/') {
+			end++;
+			vn = strtol(end, &end, 10);
+		}
+	}
+	*cursor = end;
+	corner->v = resolve_index(v, v_count);
+	corner->vt = resolve_index(vt, vt_count);
+	corner->vn = resolve_index(vn, vn_count);
+	return corner->v >= 0 && corner->vt != -2 && corner->vn != -2;
+}
+
+static char *read_text_file(const char *path) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		return nullptr;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	char *text = size >= 0 ? malloc(size + 1) : nullptr;
+	if (text) {
+		if (fread(text, 1, size, fp) != (size_t)size) {
+			free(text);
+			text = nullptr;
+		} else {
+			text[size] = '\0';
+		}
+	}
+	fclose(fp);
+	return text;
+}
+
+bool meshcook_load_obj(const char *path, meshcook_mesh *mesh) {
+	char *text = read_text_file(path);
+	if (!text) {
+		printf("failed to read '%s'\n", path);
+		return false;
+	}
+
+	obj_floats positions = { 0 };
+	obj_floats texcoords = { 0 };
+	obj_floats normals = { 0 };
+	obj_corners corners = { 0 };
+	bool ok = true;
+	size_t line_number = 0;
+
+	// 第一遍：收集所有属性以及三角化后的角
+	for (char *line = text; line && *line && ok;) {
+		char *next = strchr(line, '\n');
+		if (next) {
+			*next++ = '\0';
+		}
+		line_number++;
+		while (*line == ' ' || *line == '\t') {
+			line++;
+		}
+		if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+			float value[3] = { 0 };
+			sscanf(line + 2, "%f %f %f", &value[0], &value[1], &value[2]);
+			ok = push_floats(&positions, value, 3);
+		} else if (line[0] == 'v' && line[1] == 't' && (line[2] == ' ' || line[2] == '\t')) {
+			float value[2] = { 0 };
+			sscanf(line + 3, "%f %f", &value[0], &value[1]);
+			ok = push_floats(&texcoords, value, 2);
+		} else if (line[0] == 'v' && line[1] == 'n' && (line[2] == ' ' || line[2] == '\t')) {
+			float value[3] = { 0 };
+			sscanf(line + 3, "%f %f %f", &value[0], &value[1], &value[2]);
+			ok = push_floats(&normals, value, 3);
+		} else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+			const char *cursor = line + 2;
+			obj_corner first, previous, current;
+			int count = 0;
+			while (ok) {
+				while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r') {
+					cursor++;
+				}
+				if (*cursor == '\0') {
+					break;
+				}
+				if (!parse_corner(&cursor, &current, positions.count / 3, texcoords.count / 2, normals.count / 3)) {
+					printf("%s:%zu: invalid face\n", path, line_number);
+					ok = false;
+					break;
+				}
+				// 多边形按扇形三角化
+				if (count == 0) {
+					first = current;
+				} else if (count >= 2) {
+					ok = push_corner(&corners, first) && push_corner(&corners, previous) && push_corner(&corners, current);
+				}
+				previous = current;
+				count++;
+			}
+		}
+		line = next;
+	}
+	free(text);
+
+	bool has_texcoords = false;
+	bool has_normals = false;
+	for (size_t i = 0; i < corners.count; i++) {
+		has_texcoords |= corners.data[i].vt >= 0;
+		has_normals |= corners.data[i].vn >= 0;
+	}
+	mesh->attributes_count = 0;
+	mesh->attributes[mesh->attributes_count++] = 3;
+	if (has_texcoords) {
+		mesh->attributes[mesh->attributes_count++] = 2;
+	}
+	if (has_normals) {
+		mesh->attributes[mesh->attributes_count++] = 3;
+	}
+
+	// 第二遍：合并相同的 (v, vt, vn) 组合，生成索引
+	obj_vertex_entry *vertices = nullptr;
+	uint32_t vertices_count = 0;
+	for (size_t i = 0; i < corners.count && ok; i++) {
+		obj_corner corner = corners.data[i];
+		obj_vertex_entry *entry = nullptr;
+		HASH_FIND(hh, vertices, &corner, sizeof(obj_corner), entry);
+		if (!entry) {
+			float vertex[8];
+			size_t n = 0;
+			memcpy(vertex + n, positions.data + corner.v * 3, 3 * sizeof(float));
+			n += 3;
+			if (has_texcoords) {
+				vertex[n++] = corner.vt >= 0 ? texcoords.data[corner.vt * 2] : 0.0f;
+				vertex[n++] = corner.vt >= 0 ? texcoords.data[corner.vt * 2 + 1] : 0.0f;
+			}
+			if (has_normals) {
+				for (int k = 0; k < 3; k++) {
+					vertex[n++] = corner.vn >= 0 ? normals.data[corner.vn * 3 + k] : 0.0f;
+				}
+			}
+			entry = malloc(sizeof(obj_vertex_entry));
+			if (!entry || !meshcook_push_vertex(mesh, vertex, n)) {
+				free(entry);
+				ok = false;
+				break;
+			}
+			entry->key = corner;
+			entry->index = vertices_count++;
+			HASH_ADD(hh, vertices, key, sizeof(obj_corner), entry);
+		}
+		ok = meshcook_push_index(mesh, entry->index);
+	}
+
+	obj_vertex_entry *entry, *tmp;
+	HASH_ITER(hh, vertices, entry, tmp) {
+		HASH_DEL(vertices, entry);
+		free(entry);
+	}
+	free(positions.data);
+	free(texcoords.data);
+	free(normals.data);
+	free(corners.data);
+	if (!ok) {
+		printf("failed to load '%s'\n", path);
+	}
+	return ok;
+}
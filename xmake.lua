@@ -2,10 +2,31 @@ add_rules("mode.debug", "mode.release")
 
 add_languages("c23")
 
-add_requires("sdl3", "lua", "uthash", "cglm", "libpng", "freetype")
+add_requires("sdl3", "lua", "uthash", "cglm", "libpng", "freetype", "cgltf")
 
 target("flandre")
     set_kind("binary")
     add_packages("sdl3", "lua", "uthash", "cglm", "libpng", "freetype")
     add_headerfiles("src/**.h")
     add_files("src/**.c")
+    -- headless 后端（EGL surfaceless）只在 Linux 上可用
+    if is_plat("linux") then
+        add_defines("FLN_HEADLESS_EGL")
+        add_syslinks("EGL")
+    end
+
+-- 离线工具：把 glTF/OBJ 转换成 flandre 的 .flm 网格
+target("flandre-meshcook")
+    set_kind("binary")
+    set_default(false)
+    add_packages("uthash", "cgltf")
+    add_includedirs("src")
+    add_files("tools/meshcook/*.c")
+
+-- 离线工具：把脚本目录预编译成 flandre 的 .fla 字节码归档
+target("flandre-luac")
+    set_kind("binary")
+    set_default(false)
+    add_packages("sdl3", "lua")
+    add_includedirs("src")
+    add_files("tools/luac/*.c")